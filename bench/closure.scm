@@ -0,0 +1,29 @@
+; Closure creation, higher-order calls and mutation of captured variables
+(define (make-counter)
+  (let ((count 0))
+    (lambda ()
+      (set! count (+ count 1))
+      count)))
+
+(define (compose f g)
+  (lambda (x) (f (g x))))
+
+(define (fold f acc n)
+  (if (= n 0)
+      acc
+      (fold f (f acc n) (- n 1))))
+
+(define (unit)
+  (let ((counter (make-counter))
+        (add1 (lambda (x) (+ x 1))))
+    (let ((add2 (compose add1 add1)))
+      (fold (lambda (acc i)
+              (counter)
+              (+ acc ((compose add2 (lambda (y) (modulo y 7))) i)))
+            0
+            2000))))
+
+(define (run scale)
+  (if (= scale 1)
+      (unit)
+      (begin (unit) (run (- scale 1)))))
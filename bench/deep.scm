@@ -0,0 +1,20 @@
+; Deep non-tail recursion: interpreter stack depth and frame churn
+(define (sum-to n)
+  (if (= n 0)
+      0
+      (+ n (sum-to (- n 1)))))
+
+(define (build n)
+  (if (= n 0)
+      '()
+      (cons n (build (- n 1)))))
+
+(define (sum-list lst)
+  (if (null? lst)
+      0
+      (+ (car lst) (sum-list (cdr lst)))))
+
+(define (run scale)
+  (if (= scale 1)
+      (+ (sum-to 10000) (sum-list (build 10000)))
+      (begin (sum-to 10000) (sum-list (build 10000)) (run (- scale 1)))))
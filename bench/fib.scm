@@ -0,0 +1,10 @@
+; Doubly recursive fib: procedure calls and fixnum arithmetic
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+
+(define (run scale)
+  (if (= scale 1)
+      (fib 22)
+      (begin (fib 22) (run (- scale 1)))))
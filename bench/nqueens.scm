@@ -0,0 +1,29 @@
+; Count the solutions of 8 queens: list building and backtracking
+(define (ok? row dist placed)
+  (if (null? placed)
+      #t
+      (and (not (= (car placed) (+ row dist)))
+           (not (= (car placed) (- row dist)))
+           (not (= (car placed) row))
+           (ok? row (+ dist 1) (cdr placed)))))
+
+(define (try-rows row n placed)
+  (if (> row n)
+      0
+      (+ (if (ok? row 1 placed)
+             (queens n (cons row placed))
+             0)
+         (try-rows (+ row 1) n placed))))
+
+(define (length-of lst)
+  (if (null? lst) 0 (+ 1 (length-of (cdr lst)))))
+
+(define (queens n placed)
+  (if (= (length-of placed) n)
+      1
+      (try-rows 1 n placed)))
+
+(define (run scale)
+  (if (= scale 1)
+      (queens 8 '())
+      (begin (queens 8 '()) (run (- scale 1)))))
@@ -0,0 +1,28 @@
+; Traversal of quoted constants: symbols, nested lists and association lists
+(define table
+  '((apple . 1) (banana . 2) (cherry . 3) (date . 4) (elder . 5)
+    (fig . 6) (grape . 7) (honeydew . 8) (kiwi . 9) (lemon . 10)))
+
+(define (lookup key alist)
+  (cond ((null? alist) 0)
+        ((eq? key (car (car alist))) (cdr (car alist)))
+        (else (lookup key (cdr alist)))))
+
+(define (leaves tree)
+  (cond ((null? tree) 0)
+        ((pair? tree) (+ (leaves (car tree)) (leaves (cdr tree))))
+        (else 1)))
+
+(define (unit n acc)
+  (if (= n 0)
+      acc
+      (unit (- n 1)
+            (+ acc
+               (lookup 'lemon table)
+               (lookup 'fig table)
+               (leaves '((a b (c d)) (e (f (g h))) i (j k l)))))))
+
+(define (run scale)
+  (if (= scale 1)
+      (unit 1000 0)
+      (begin (unit 1000 0) (run (- scale 1)))))
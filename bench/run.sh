@@ -0,0 +1,54 @@
+#!/bin/bash
+# Run the workloads in this directory and print one tab-separated row per
+# run: wall time, peak RSS and allocation counters as reported by --stats.
+#
+# usage: bench/run.sh CODE [SCALE [WORKLOAD...]]
+#   CODE      interpreter binary (build/code)
+#   SCALE     repetitions of each workload's unit of work (default 1,
+#             or $BENCH_SCALE)
+#   WORKLOAD  names such as fib or sort (default: every bench/*.scm)
+#
+# Both backends are measured unless $BENCH_BACKENDS is set, e.g. to "vm".
+# Each workload defines (run scale); the harness appends (run SCALE).
+
+if [ $# -lt 1 ]; then
+    sed -n '2,12p' "$0" | sed 's/^# \{0,1\}//'
+    exit 2
+fi
+
+CODE=$1
+SCALE=${2:-${BENCH_SCALE:-1}}
+shift
+[ $# -gt 0 ] && shift
+DIR="$(cd "$(dirname "$0")" && pwd)"
+BACKENDS=${BENCH_BACKENDS:-"tree vm"}
+
+if [ $# -gt 0 ]; then
+    WORKLOADS="$*"
+else
+    WORKLOADS=$(cd "$DIR" && ls *.scm | sed 's/\.scm$//')
+fi
+
+printf "benchmark\tbackend\tscale\twall_ms\tpeak_rss_kb\tallocated\tcollections\tstatus\n"
+failed=0
+for name in $WORKLOADS; do
+    for backend in $BACKENDS; do
+        flags="--stats"
+        [ "$backend" = vm ] && flags="$flags --vm"
+        start=$(date +%s%N)
+        out=$( (cat "$DIR/$name.scm"; echo "(run $SCALE)"; echo "(exit)") | "$CODE" $flags 2>&1)
+        rc=$?
+        end=$(date +%s%N)
+        stats=$(echo "$out" | grep '^stats:')
+        field() { echo "$stats" | sed -n "s/.*$1=\([0-9]*\).*/\1/p"; }
+        status=ok
+        if [ $rc -ne 0 ] || [ -z "$stats" ] || echo "$out" | grep -q RuntimeError; then
+            status=fail
+            failed=1
+        fi
+        printf "%s\t%s\t%s\t%d\t%s\t%s\t%s\t%s\n" "$name" "$backend" "$SCALE" \
+            $(( (end - start) / 1000000 )) "$(field peak_rss_kb)" "$(field allocated)" \
+            "$(field collections)" "$status"
+    done
+done
+exit $failed
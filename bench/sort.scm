@@ -0,0 +1,34 @@
+; Merge sort of a pseudo-random list: allocation-heavy list traffic
+(define (random-list n seed)
+  (if (= n 0)
+      '()
+      (cons seed (random-list (- n 1) (modulo (+ (* seed 1103) 12345) 65536)))))
+
+(define (split lst)
+  (if (or (null? lst) (null? (cdr lst)))
+      (cons lst '())
+      (let ((rest (split (cdr (cdr lst)))))
+        (cons (cons (car lst) (car rest))
+              (cons (car (cdr lst)) (cdr rest))))))
+
+(define (merge a b)
+  (cond ((null? a) b)
+        ((null? b) a)
+        ((< (car a) (car b)) (cons (car a) (merge (cdr a) b)))
+        (else (cons (car b) (merge a (cdr b))))))
+
+(define (sort lst)
+  (if (or (null? lst) (null? (cdr lst)))
+      lst
+      (let ((halves (split lst)))
+        (merge (sort (car halves)) (sort (cdr halves))))))
+
+(define (sorted? lst)
+  (or (null? lst)
+      (null? (cdr lst))
+      (and (<= (car lst) (car (cdr lst))) (sorted? (cdr lst)))))
+
+(define (run scale)
+  (if (= scale 1)
+      (sorted? (sort (random-list 2000 42)))
+      (begin (sort (random-list 2000 scale)) (run (- scale 1)))))
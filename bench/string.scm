@@ -0,0 +1,26 @@
+; String literals flowing through lists, predicates and display
+(define words '("alpha" "beta" "gamma" "delta" "epsilon" "zeta" "eta" "theta"))
+
+(define (make-strings n acc)
+  (if (= n 0)
+      acc
+      (make-strings (- n 1) (cons "literal" (cons (car words) acc)))))
+
+(define (count-strings lst)
+  (cond ((null? lst) 0)
+        ((string? (car lst)) (+ 1 (count-strings (cdr lst))))
+        (else (count-strings (cdr lst)))))
+
+(define (show-all lst)
+  (if (null? lst)
+      (void)
+      (begin (display (car lst)) (show-all (cdr lst)))))
+
+(define (unit)
+  (show-all words)
+  (count-strings (make-strings 1000 words)))
+
+(define (run scale)
+  (if (= scale 1)
+      (unit)
+      (begin (unit) (run (- scale 1)))))
@@ -0,0 +1,12 @@
+; Takeuchi function: deep non-tail call trees with three arguments
+(define (tak x y z)
+  (if (not (< y x))
+      z
+      (tak (tak (- x 1) y z)
+           (tak (- y 1) z x)
+           (tak (- z 1) x y))))
+
+(define (run scale)
+  (if (= scale 1)
+      (tak 18 12 6)
+      (begin (tak 18 12 6) (run (- scale 1)))))
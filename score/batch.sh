@@ -0,0 +1,27 @@
+#!/bin/bash
+# 批处理模式测试: 检查 code FILE / code -e EXPR 的输出, stderr 与退出码
+
+cd "$(dirname "$0")"
+
+fail=0
+# check NAME EXPECTED_STDOUT EXPECTED_STDERR EXPECTED_STATUS ARGS...
+check() {
+    local name=$1 want_out=$2 want_err=$3 want_status=$4
+    shift 4
+    local out err status
+    out=$(../build/code "$@" 2>batch_err.txt)
+    status=$?
+    err=$(cat batch_err.txt)
+    rm -f batch_err.txt
+    if [ "$out" != "$want_out" ] || [ "$err" != "$want_err" ] || [ $status -ne $want_status ]; then
+        echo "Wrong answer in BATCH TEST $name (status $status)"
+        fail=1
+    fi
+}
+
+check "-e complete" "3" "" 0 -e '(+ 1 2)'
+check "-e unterminated list" "" "-e: RuntimeError: unexpected end of input" 1 -e '(+ 1'
+check "-e unterminated string" "" "-e: RuntimeError: unexpected end of input" 1 -e '"abc'
+check "truncated file" "before" "batch/truncated.scm: RuntimeError: unexpected end of input" 1 batch/truncated.scm
+
+exit $fail
@@ -0,0 +1,3 @@
+(display "before")
+(define (f x)
+  (+ x 1)
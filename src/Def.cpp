@@ -8,16 +8,20 @@
  */
 
 #include "Def.hpp"
+#include <memory>
+#include <unordered_map>
+
 
 /**
  * @brief Mapping of primitive function names to expression types
  * 
- * This map contains all built-in functions that can be called in Scheme.
+ * This table contains all built-in functions that can be called in Scheme.
  * These are functions that have direct implementations in the interpreter
  * and can be used in function application contexts.
  * 
  * Categories:
  * - Arithmetic: +, -, *, /, modulo, expt
+ * - Inexact: exact->inexact, inexact->exact, sqrt, exp, log, sin, cos, tan, asin, acos, atan
  * - Comparison: <, <=, =, >=, >
  * - List operations: cons, car, cdr, list, set-car!, set-cdr!
  * - Logic: not, and, or (and/or support short-circuit evaluation)
@@ -25,7 +29,7 @@
  * - I/O: display
  * - Control: void, exit
  */
-std::map<std::string, ExprType> primitives = {
+const KeywordDef primitive_names[] = {
     // Arithmetic operations
     {"+",        E_PLUS},
     {"-",        E_MINUS},
@@ -33,6 +37,17 @@ std::map<std::string, ExprType> primitives = {
     {"/",        E_DIV},
     {"modulo",   E_MODULO},
     {"expt",     E_EXPT},
+    {"exact->inexact", E_EXACT_TO_INEXACT},
+    {"inexact->exact", E_INEXACT_TO_EXACT},
+    {"sqrt",     E_SQRT},
+    {"exp",      E_EXP},
+    {"log",      E_LOG},
+    {"sin",      E_SIN},
+    {"cos",      E_COS},
+    {"tan",      E_TAN},
+    {"asin",     E_ASIN},
+    {"acos",     E_ACOS},
+    {"atan",     E_ATAN},
     
     // Comparison operations
     {"<",        E_LT},
@@ -73,10 +88,12 @@ std::map<std::string, ExprType> primitives = {
     {"exit",      E_EXIT}
 };
 
+const size_t primitive_count = sizeof(primitive_names) / sizeof(primitive_names[0]);
+
 /**
  * @brief Mapping of reserved words (special forms) to expression types
  * 
- * This map contains Scheme special forms that have special syntax and
+ * This table contains Scheme special forms that have special syntax and
  * evaluation rules. These cannot be used as regular function names and
  * have special parsing and evaluation semantics.
  * 
@@ -91,7 +108,7 @@ std::map<std::string, ExprType> primitives = {
  * Note: and/or have been moved to primitives to support function-style usage
  * while maintaining their short-circuit evaluation behavior.
  */
-std::map<std::string, ExprType> reserved_words = {
+const KeywordDef reserved_names[] = {
     // Control flow constructs
     {"begin",   E_BEGIN},    
     {"quote",   E_QUOTE},    
@@ -113,3 +130,39 @@ std::map<std::string, ExprType> reserved_words = {
     // Assignment
     {"set!",    E_SET}      
 };
+
+const size_t reserved_count = sizeof(reserved_names) / sizeof(reserved_names[0]);
+
+typedef std::unordered_map<std::string, std::unique_ptr<NameEntry>> NameTable;
+
+static NameEntry *insert(NameTable &table, const std::string &s) {
+    auto it = table.find(s);
+    if (it != table.end())
+        return it->second.get();
+    NameEntry *entry = new NameEntry{s, -1, -1, -1};
+    table.emplace(s, std::unique_ptr<NameEntry>(entry));
+    return entry;
+}
+
+/**
+ * @brief Table of interned names
+ *
+ * Entries are never freed, so a Name stays valid for the whole run. The table
+ * is a function-local static so Names built during static initialization
+ * (e.g. keyword constants) see it constructed, already holding the keywords.
+ */
+static NameEntry *intern(const std::string &s) {
+    static NameTable &table = [] () -> NameTable & {
+        NameTable *t = new NameTable;
+        for (size_t i = 0; i < primitive_count; ++i)
+            insert(*t, primitive_names[i].name)->primitive = primitive_names[i].type;
+        for (size_t i = 0; i < reserved_count; ++i)
+            insert(*t, reserved_names[i].name)->reserved = reserved_names[i].type;
+        return *t;
+    }();
+    return insert(table, s);
+}
+
+Name::Name(const std::string &s) : entry(intern(s)) {}
+
+Name::Name(const char *s) : entry(intern(s)) {}
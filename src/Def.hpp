@@ -20,8 +20,42 @@
 struct Syntax;
 struct Expr;
 struct Value;
+struct ValueSpan;
 struct AssocList;
 struct Assoc;
+struct Frame;
+struct Env;
+struct TailCall;
+struct Chunk;
+
+/**
+ * @brief Entry of the global name table; one per distinct identifier
+ */
+struct NameEntry {
+    std::string s;   ///< Characters of the name
+    int global_slot; ///< Slot in the global table, -1 until first referenced
+    int primitive;   ///< ExprType of the primitive of this name, or -1
+    int reserved;    ///< ExprType of the special form of this name, or -1
+};
+
+/**
+ * @brief Interned identifier
+ *
+ * The reader interns every symbol once; syntax, variables, parameters,
+ * symbol values and environments then share the handle. Copying a Name is a
+ * pointer copy and two Names are equal exactly when their entries are.
+ */
+class Name {
+    NameEntry *entry;
+
+public:
+    Name(const std::string &); ///< Interns s
+    Name(const char *);
+    const std::string &str() const { return entry->s; }
+    NameEntry *operator->() const { return entry; }
+    bool operator==(const Name &other) const { return entry == other.entry; }
+    bool operator!=(const Name &other) const { return entry != other.entry; }
+};
 
 /**
  * @brief Expression types enumeration
@@ -46,6 +80,17 @@ enum ExprType {
     E_DIV,
     E_MODULO,
     E_EXPT,
+    E_EXACT_TO_INEXACT,
+    E_INEXACT_TO_EXACT,
+    E_SQRT,
+    E_EXP,
+    E_LOG,
+    E_SIN,
+    E_COS,
+    E_TAN,
+    E_ASIN,
+    E_ACOS,
+    E_ATAN,
 
     // Comparison operations
     E_LT,              
@@ -101,8 +146,27 @@ enum ExprType {
 
     // I/O operations
     E_DISPLAY,         
+
+    // Guard of an inlined call, made by the optimizer and never parsed
+    E_SAME_TEMPLATE,
 };
 
+/**
+ * @brief Name of a primitive or special form and its expression type
+ *
+ * The name table is seeded from primitive_names and reserved_names, so the
+ * parser reads a keyword's type straight off its Name.
+ */
+struct KeywordDef {
+    const char *name;
+    ExprType type;
+};
+
+extern const KeywordDef primitive_names[];
+extern const size_t primitive_count;
+extern const KeywordDef reserved_names[];
+extern const size_t reserved_count;
+
 /**
  * @brief Value types enumeration
  * 
@@ -111,15 +175,20 @@ enum ExprType {
  */
 enum ValueType {
     V_INT,              
+    V_BIGNUM,           // exact integer outside the fixnum range
     V_RATIONAL,         
+    V_FLONUM,           // inexact real, stored inline as a double
     V_BOOL,             
     V_SYM,              
     V_NULL,             
     V_STRING,           
     V_PAIR,             
     V_PROC,             
+    V_PRIMITIVE,        // built-in procedure used as a value
     V_VOID,            
-    V_TERMINATE        
+    V_TERMINATE,
+    V_BOX,              // shared cell of a captured variable, never seen by Scheme code
+    V_UNBOUND           // no value yet: unassigned binding slot, never seen by Scheme code
 };
 
 #endif // DEF_HPP
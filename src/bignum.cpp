@@ -0,0 +1,592 @@
+/**
+ * @file bignum.cpp
+ * @brief Exact integer arithmetic on fixnums and bignums
+ *
+ * Magnitudes are vectors of base 2^32 limbs, least significant first, with
+ * no high zero limb (zero is the empty vector). The limb routines work on
+ * magnitudes only; the exported functions attach signs and convert results
+ * back to canonical Values.
+ */
+
+#include "bignum.hpp"
+#include "RE.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+typedef uint64_t Wide;
+
+// Operands shorter than this many limbs are multiplied by the schoolbook method
+static const size_t kKaratsubaCutoff = 40;
+
+// ============================================================================
+// Magnitudes
+// ============================================================================
+
+static void trim(Limbs &a) {
+    while (!a.empty() && a.back() == 0) {
+        a.pop_back();
+    }
+}
+
+static int compareMag(const Limbs &a, const Limbs &b) {
+    if (a.size() != b.size()) {
+        return a.size() < b.size() ? -1 : 1;
+    }
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static Limbs addMag(const Limbs &a, const Limbs &b) {
+    const Limbs &longer = a.size() >= b.size() ? a : b;
+    const Limbs &shorter = a.size() >= b.size() ? b : a;
+    Limbs sum(longer.size() + 1);
+    Wide carry = 0;
+    for (size_t i = 0; i < longer.size(); ++i) {
+        carry += (Wide)longer[i] + (i < shorter.size() ? shorter[i] : 0);
+        sum[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    sum[longer.size()] = (uint32_t)carry;
+    trim(sum);
+    return sum;
+}
+
+// a - b, where a >= b
+static Limbs subMag(const Limbs &a, const Limbs &b) {
+    Limbs diff(a.size());
+    Wide borrow = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        Wide sub = (i < b.size() ? b[i] : 0) + borrow;
+        borrow = a[i] < sub ? 1 : 0;
+        diff[i] = (uint32_t)(a[i] - sub);
+    }
+    trim(diff);
+    return diff;
+}
+
+// acc += x * 2^(32 * shift)
+static void addShifted(Limbs &acc, const Limbs &x, size_t shift) {
+    if (acc.size() < x.size() + shift) {
+        acc.resize(x.size() + shift, 0);
+    }
+    Wide carry = 0;
+    size_t i = shift;
+    for (size_t j = 0; j < x.size(); ++i, ++j) {
+        carry += (Wide)acc[i] + x[j];
+        acc[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    for (; carry != 0; ++i) {
+        if (i == acc.size()) {
+            acc.push_back(0);
+        }
+        carry += acc[i];
+        acc[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+// Limbs [from, to) of a, trimmed
+static Limbs slice(const Limbs &a, size_t from, size_t to) {
+    to = std::min(to, a.size());
+    if (from >= to) {
+        return Limbs();
+    }
+    Limbs part(a.begin() + from, a.begin() + to);
+    trim(part);
+    return part;
+}
+
+static Limbs mulMag(const Limbs &a, const Limbs &b) {
+    if (a.empty() || b.empty()) {
+        return Limbs();
+    }
+    if (a.size() < kKaratsubaCutoff || b.size() < kKaratsubaCutoff) {
+        // Schoolbook; each step fits: (2^32-1)^2 + 2 * (2^32-1) < 2^64
+        Limbs product(a.size() + b.size(), 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            Wide digit = a[i];
+            if (digit == 0) {
+                continue;
+            }
+            Wide carry = 0;
+            for (size_t j = 0; j < b.size(); ++j) {
+                carry += digit * b[j] + product[i + j];
+                product[i + j] = (uint32_t)carry;
+                carry >>= 32;
+            }
+            product[i + b.size()] = (uint32_t)carry;
+        }
+        trim(product);
+        return product;
+    }
+    // Karatsuba: with x = x1 * B + x0, x * y = z2 * B^2 + z1 * B + z0 where
+    // z1 = (x0 + x1)(y0 + y1) - z2 - z0 costs one multiplication, not two
+    size_t half = (std::max(a.size(), b.size()) + 1) / 2;
+    Limbs a0 = slice(a, 0, half), a1 = slice(a, half, a.size());
+    Limbs b0 = slice(b, 0, half), b1 = slice(b, half, b.size());
+    Limbs z0 = mulMag(a0, b0);
+    Limbs z2 = mulMag(a1, b1);
+    Limbs z1 = subMag(subMag(mulMag(addMag(a0, a1), addMag(b0, b1)), z0), z2);
+    Limbs product = z0;
+    addShifted(product, z1, half);
+    addShifted(product, z2, 2 * half);
+    trim(product);
+    return product;
+}
+
+// a = a / d; returns a % d
+static uint32_t divSmall(Limbs &a, uint32_t d) {
+    Wide rem = 0;
+    for (size_t i = a.size(); i-- > 0;) {
+        Wide cur = (rem << 32) | a[i];
+        a[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    trim(a);
+    return (uint32_t)rem;
+}
+
+// a = a * m + add
+static void mulAddSmall(Limbs &a, uint32_t m, uint32_t add) {
+    Wide carry = add;
+    for (size_t i = 0; i < a.size(); ++i) {
+        carry += (Wide)a[i] * m;
+        a[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry != 0) {
+        a.push_back((uint32_t)carry);
+    }
+}
+
+// Knuth, TAOCP vol. 2, 4.3.1, algorithm D
+static void divMag(const Limbs &a, const Limbs &b, Limbs &q, Limbs &r) {
+    if (compareMag(a, b) < 0) {
+        q.clear();
+        r = a;
+        return;
+    }
+    if (b.size() == 1) {
+        q = a;
+        uint32_t rem = divSmall(q, b[0]);
+        r.clear();
+        if (rem != 0) {
+            r.push_back(rem);
+        }
+        return;
+    }
+    // Normalize so the divisor's top limb has its high bit set, which keeps
+    // each estimated quotient digit at most two too large
+    int s = __builtin_clz(b.back());
+    size_t n = b.size(), m = a.size() - n;
+    Limbs u(a.size() + 1), v(n);
+    for (size_t i = 0; i < n; ++i) {
+        v[i] = (b[i] << s) | (s && i > 0 ? b[i - 1] >> (32 - s) : 0);
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        u[i] = (a[i] << s) | (s && i > 0 ? a[i - 1] >> (32 - s) : 0);
+    }
+    u[a.size()] = s ? a.back() >> (32 - s) : 0;
+
+    q.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        Wide top = ((Wide)u[j + n] << 32) | u[j + n - 1];
+        Wide qhat = top / v[n - 1];
+        Wide rhat = top % v[n - 1];
+        while (qhat > 0xFFFFFFFFu || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])) {
+            --qhat;
+            rhat += v[n - 1];
+            if (rhat > 0xFFFFFFFFu) {
+                break;
+            }
+        }
+        // u[j..j+n] -= qhat * v
+        Wide carry = 0, borrow = 0;
+        for (size_t i = 0; i < n; ++i) {
+            Wide p = qhat * v[i] + carry;
+            carry = p >> 32;
+            Wide sub = (p & 0xFFFFFFFFu) + borrow;
+            borrow = u[i + j] < sub ? 1 : 0;
+            u[i + j] = (uint32_t)(u[i + j] - sub);
+        }
+        Wide sub = carry + borrow;
+        bool negative = u[j + n] < sub;
+        u[j + n] = (uint32_t)(u[j + n] - sub);
+        if (negative) {
+            // qhat was one too large: add v back
+            --qhat;
+            Wide c = 0;
+            for (size_t i = 0; i < n; ++i) {
+                c += (Wide)u[i + j] + v[i];
+                u[i + j] = (uint32_t)c;
+                c >>= 32;
+            }
+            u[j + n] = (uint32_t)(u[j + n] + c);
+        }
+        q[j] = (uint32_t)qhat;
+    }
+    trim(q);
+    r.assign(n, 0);
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = (u[i] >> s) | (s ? u[i + 1] << (32 - s) : 0);
+    }
+    trim(r);
+}
+
+static size_t bitLength(const Limbs &a) {
+    return a.empty() ? 0 : 32 * a.size() - __builtin_clz(a.back());
+}
+
+// a * 2^bits
+static Limbs shiftLeft(const Limbs &a, size_t bits) {
+    size_t limbs = bits / 32, s = bits % 32;
+    Limbs out(a.size() + limbs + 1, 0);
+    for (size_t i = 0; i < a.size(); ++i) {
+        out[i + limbs] |= a[i] << s;
+        if (s != 0) {
+            out[i + limbs + 1] = a[i] >> (32 - s);
+        }
+    }
+    trim(out);
+    return out;
+}
+
+// a / 2^bits, rounded down; sticky is set if a bit shifted out was 1
+static Limbs shiftRight(const Limbs &a, size_t bits, bool &sticky) {
+    size_t limbs = bits / 32, s = bits % 32;
+    if (limbs >= a.size()) {
+        sticky = sticky || !a.empty();
+        return Limbs();
+    }
+    for (size_t i = 0; i < limbs; ++i) {
+        sticky = sticky || a[i] != 0;
+    }
+    if (s != 0 && (a[limbs] & ((1u << s) - 1)) != 0) {
+        sticky = true;
+    }
+    Limbs out(a.size() - limbs);
+    for (size_t i = 0; i < out.size(); ++i) {
+        out[i] = (a[i + limbs] >> s) | (s && i + limbs + 1 < a.size() ? a[i + limbs + 1] << (32 - s) : 0);
+    }
+    trim(out);
+    return out;
+}
+
+static std::string magnitudeToString(const Limbs &mag) {
+    if (mag.empty()) {
+        return "0";
+    }
+    // Peel off nine decimal digits at a time, least significant first
+    Limbs rest = mag;
+    std::vector<uint32_t> chunks;
+    while (!rest.empty()) {
+        chunks.push_back(divSmall(rest, 1000000000u));
+    }
+    std::string text = std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        std::string digits = std::to_string(chunks[i]);
+        text.append(9 - digits.size(), '0');
+        text += digits;
+    }
+    return text;
+}
+
+// ============================================================================
+// Signed integers
+// ============================================================================
+
+Bignum::Bignum(bool negative, Limbs &&magnitude) : ValueBase(V_BIGNUM), negative(negative), magnitude(std::move(magnitude)) {}
+
+void Bignum::show(std::ostream &os) {
+    if (negative) {
+        os << '-';
+    }
+    os << magnitudeToString(magnitude);
+}
+
+Value BignumV(bool negative, Limbs &&mag) {
+    trim(mag);
+    if (mag.empty()) {
+        return IntegerV(0);
+    }
+    if (mag.size() == 1 && mag[0] <= (negative ? 0x80000000u : 0x7FFFFFFFu)) {
+        return IntegerV(negative ? (int)(0u - mag[0]) : (int)mag[0]);
+    }
+    return Value(new Bignum(negative, std::move(mag)));
+}
+
+// Sign and magnitude of an integer; a fixnum's single limb goes in scratch
+static const Limbs &magnitudeOf(const Value &v, Limbs &scratch, bool &negative) {
+    if (v.v_type == V_INT) {
+        negative = v.n < 0;
+        uint32_t m = negative ? 0u - (uint32_t)v.n : (uint32_t)v.n;
+        scratch.clear();
+        if (m != 0) {
+            scratch.push_back(m);
+        }
+        return scratch;
+    }
+    Bignum *big = static_cast<Bignum *>(v.get());
+    negative = big->negative;
+    return big->magnitude;
+}
+
+Value Integer64V(long long x) {
+    if (x >= INT_MIN && x <= INT_MAX) {
+        return IntegerV((int)x);
+    }
+    Wide m = x < 0 ? 0ull - (Wide)x : (Wide)x;
+    return BignumV(x < 0, Limbs{(uint32_t)m, (uint32_t)(m >> 32)});
+}
+
+bool isExactInteger(const Value &v) {
+    return v.v_type == V_INT || v.v_type == V_BIGNUM;
+}
+
+int intSign(const Value &v) {
+    if (v.v_type == V_INT) {
+        return (v.n > 0) - (v.n < 0);
+    }
+    return static_cast<Bignum *>(v.get())->negative ? -1 : 1;
+}
+
+size_t intBitLength(const Value &v) {
+    if (v.v_type == V_INT) {
+        uint32_t m = v.n < 0 ? 0u - (uint32_t)v.n : (uint32_t)v.n;
+        return m == 0 ? 0 : 32 - __builtin_clz(m);
+    }
+    return bitLength(static_cast<Bignum *>(v.get())->magnitude);
+}
+
+int intCompare(const Value &a, const Value &b) {
+    if (a.v_type == V_INT && b.v_type == V_INT) {
+        return (a.n > b.n) - (a.n < b.n);
+    }
+    int sa = intSign(a), sb = intSign(b);
+    if (sa != sb) {
+        return sa < sb ? -1 : 1;
+    }
+    // Same sign, and at least one is a bignum, so neither is zero
+    Limbs scratch_a, scratch_b;
+    bool na, nb;
+    int c = compareMag(magnitudeOf(a, scratch_a, na), magnitudeOf(b, scratch_b, nb));
+    return sa < 0 ? -c : c;
+}
+
+Value intNegate(const Value &v) {
+    if (v.v_type == V_INT) {
+        return Integer64V(-(long long)v.n);
+    }
+    Bignum *big = static_cast<Bignum *>(v.get());
+    return BignumV(!big->negative, Limbs(big->magnitude));
+}
+
+Value intAdd(const Value &a, const Value &b) {
+    if (a.v_type == V_INT && b.v_type == V_INT) {
+        return Integer64V((long long)a.n + b.n);
+    }
+    Limbs scratch_a, scratch_b;
+    bool na, nb;
+    const Limbs &ma = magnitudeOf(a, scratch_a, na);
+    const Limbs &mb = magnitudeOf(b, scratch_b, nb);
+    if (na == nb) {
+        return BignumV(na, addMag(ma, mb));
+    }
+    int c = compareMag(ma, mb);
+    if (c == 0) {
+        return IntegerV(0);
+    }
+    return c > 0 ? BignumV(na, subMag(ma, mb)) : BignumV(nb, subMag(mb, ma));
+}
+
+Value intSub(const Value &a, const Value &b) {
+    if (a.v_type == V_INT && b.v_type == V_INT) {
+        return Integer64V((long long)a.n - b.n);
+    }
+    return intAdd(a, intNegate(b));
+}
+
+Value intMul(const Value &a, const Value &b) {
+    if (a.v_type == V_INT && b.v_type == V_INT) {
+        return Integer64V((long long)a.n * b.n);
+    }
+    Limbs scratch_a, scratch_b;
+    bool na, nb;
+    const Limbs &ma = magnitudeOf(a, scratch_a, na);
+    const Limbs &mb = magnitudeOf(b, scratch_b, nb);
+    return BignumV(na != nb, mulMag(ma, mb));
+}
+
+void intDivide(const Value &a, const Value &b, Value *quotient, Value *remainder) {
+    if (intSign(b) == 0) {
+        throw RuntimeError("Division by zero");
+    }
+    if (a.v_type == V_INT && b.v_type == V_INT) {
+        // In 64 bits INT_MIN / -1 does not overflow
+        long long x = a.n, y = b.n;
+        if (quotient) {
+            *quotient = Integer64V(x / y);
+        }
+        if (remainder) {
+            *remainder = Integer64V(x % y);
+        }
+        return;
+    }
+    Limbs scratch_a, scratch_b, q, r;
+    bool na, nb;
+    divMag(magnitudeOf(a, scratch_a, na), magnitudeOf(b, scratch_b, nb), q, r);
+    if (quotient) {
+        *quotient = BignumV(na != nb, std::move(q));
+    }
+    if (remainder) {
+        *remainder = BignumV(na, std::move(r));
+    }
+}
+
+uint64_t gcdWord(uint64_t a, uint64_t b) {
+    if (a == 0) {
+        return b;
+    }
+    if (b == 0) {
+        return a;
+    }
+    int shift = __builtin_ctzll(a | b);
+    a >>= __builtin_ctzll(a);
+    while (b != 0) {
+        b >>= __builtin_ctzll(b);
+        if (a > b) {
+            std::swap(a, b);
+        }
+        b -= a;
+    }
+    return a << shift;
+}
+
+Value intGcd(const Value &a, const Value &b) {
+    if (a.v_type == V_INT && b.v_type == V_INT) {
+        Wide x = a.n < 0 ? 0ull - (Wide)(long long)a.n : (Wide)a.n;
+        Wide y = b.n < 0 ? 0ull - (Wide)(long long)b.n : (Wide)b.n;
+        return Integer64V((long long)gcdWord(x, y));
+    }
+    // Euclid on magnitudes until both fit in a word
+    Limbs scratch_a, scratch_b;
+    bool na, nb;
+    Limbs x = magnitudeOf(a, scratch_a, na);
+    Limbs y = magnitudeOf(b, scratch_b, nb);
+    while (x.size() > 2 || y.size() > 2) {
+        if (compareMag(x, y) < 0) {
+            std::swap(x, y);
+        }
+        if (y.empty()) {
+            return BignumV(false, std::move(x));
+        }
+        Limbs q, r;
+        divMag(x, y, q, r);
+        x.swap(y);
+        y.swap(r);
+    }
+    auto word = [](const Limbs &l) {
+        return (l.size() > 0 ? (Wide)l[0] : 0) | (l.size() > 1 ? (Wide)l[1] << 32 : 0);
+    };
+    Wide g = gcdWord(word(x), word(y));
+    return BignumV(false, Limbs{(uint32_t)g, (uint32_t)(g >> 32)});
+}
+
+double intToDouble(const Value &v) {
+    if (v.v_type == V_INT) {
+        return (double)v.n;
+    }
+    return ratioToDouble(v, IntegerV(1));
+}
+
+double ratioToDouble(const Value &num, const Value &den) {
+    Limbs scratch_n, scratch_d;
+    bool negative, unused;
+    const Limbs &n = magnitudeOf(num, scratch_n, negative);
+    const Limbs &d = magnitudeOf(den, scratch_d, unused);
+    if (n.empty()) {
+        return 0.0;
+    }
+    // q = floor(n * 2^shift / d) has 55 or 56 bits; sticky records whether
+    // anything below q was lost, so the one rounding below is exact
+    long shift = (long)bitLength(d) - (long)bitLength(n) + 55;
+    bool sticky = false;
+    Limbs scaled = shift >= 0 ? shiftLeft(n, shift) : shiftRight(n, -shift, sticky);
+    Limbs quotient, remainder;
+    divMag(scaled, d, quotient, remainder);
+    sticky = sticky || !remainder.empty();
+    Wide q = quotient[0] | (quotient.size() > 1 ? (Wide)quotient[1] << 32 : 0);
+
+    // Keep 53 bits, or fewer where the result is subnormal: bit i of q
+    // weighs 2^(i - shift) and nothing below 2^-1074 is representable
+    long q_bits = (long)bitLength(quotient);
+    long drop = std::max(q_bits - 53, shift - 1074);
+    if (drop > q_bits) {
+        return negative ? -0.0 : 0.0; // under half the smallest subnormal
+    }
+    Wide kept = q >> drop;
+    Wide rest = q & (((Wide)1 << drop) - 1);
+    Wide half = (Wide)1 << (drop - 1);
+    if (rest > half || (rest == half && (sticky || (kept & 1)))) {
+        ++kept; // to nearest, ties to even
+    }
+    double result = std::ldexp((double)kept, (int)(drop - shift));
+    return negative ? -result : result;
+}
+
+Value exactFromDouble(double x) {
+    if (!std::isfinite(x)) {
+        throw RuntimeError("inexact->exact: no exact value for " + std::string(std::isnan(x) ? "+nan.0" : x > 0 ? "+inf.0" : "-inf.0"));
+    }
+    if (x == std::trunc(x) && x >= INT_MIN && x <= INT_MAX) {
+        return IntegerV((int)x);
+    }
+    // x = m * 2^e with m a 53-bit integer
+    int e;
+    double fraction = std::frexp(x, &e);
+    long long m = (long long)std::ldexp(fraction, 53);
+    e -= 53;
+    Limbs power(e >= 0 ? e / 32 + 1 : -e / 32 + 1, 0);
+    power.back() = 1u << ((e >= 0 ? e : -e) % 32);
+    Value scale = BignumV(false, std::move(power));
+    if (e >= 0) {
+        return intMul(Integer64V(m), scale);
+    }
+    return RationalV(Integer64V(m), scale);
+}
+
+std::string intToString(const Value &v) {
+    if (v.v_type == V_INT) {
+        return std::to_string(v.n);
+    }
+    Bignum *big = static_cast<Bignum *>(v.get());
+    return (big->negative ? "-" : "") + magnitudeToString(big->magnitude);
+}
+
+Value parseInteger(const char *s, size_t len) {
+    bool negative = false;
+    size_t i = 0;
+    if (len > 0 && (s[0] == '-' || s[0] == '+')) {
+        negative = s[0] == '-';
+        i = 1;
+    }
+    // Nine digits at a time: mag = mag * 10^k + chunk
+    Limbs mag;
+    while (i < len) {
+        size_t k = std::min(len - i, (size_t)9);
+        uint32_t chunk = 0, scale = 1;
+        for (size_t j = 0; j < k; ++j) {
+            chunk = chunk * 10 + (uint32_t)(s[i + j] - '0');
+            scale *= 10;
+        }
+        mulAddSmall(mag, scale, chunk);
+        i += k;
+    }
+    return BignumV(negative, std::move(mag));
+}
@@ -0,0 +1,53 @@
+#ifndef BIGNUM_HPP
+#define BIGNUM_HPP
+
+/**
+ * @file bignum.hpp
+ * @brief Exact integer arithmetic on fixnums and bignums
+ *
+ * An exact integer is a V_INT immediate or, outside the int range, a
+ * Bignum. Every operation here takes and returns integers in that canonical
+ * form. When both operands are fixnums the result is computed in 64 bits
+ * and nothing is allocated unless it no longer fits in an int; limb
+ * arithmetic only runs once a bignum is involved. Multiplication switches
+ * from schoolbook to Karatsuba on long operands and division is Knuth's
+ * algorithm D.
+ */
+
+#include "value.hpp"
+#include <string>
+
+typedef std::vector<uint32_t> Limbs;
+
+// Canonical integers: a fixnum whenever the value fits in an int
+Value Integer64V(long long);
+Value BignumV(bool negative, Limbs &&magnitude);
+
+bool isExactInteger(const Value &); ///< V_INT or V_BIGNUM
+int intSign(const Value &);         ///< -1, 0 or 1
+int intCompare(const Value &, const Value &);
+size_t intBitLength(const Value &); ///< Bits in the magnitude; 0 for zero
+
+Value intNegate(const Value &);
+Value intAdd(const Value &, const Value &);
+Value intSub(const Value &, const Value &);
+Value intMul(const Value &, const Value &);
+// Truncating division: quotient rounds toward zero, the remainder takes the
+// sign of the dividend. Either output may be null.
+void intDivide(const Value &, const Value &, Value *quotient, Value *remainder);
+Value intGcd(const Value &, const Value &); ///< Non-negative; gcd(0, 0) is 0
+uint64_t gcdWord(uint64_t, uint64_t);      ///< Binary GCD of two words
+
+// Nearest doubles, rounded once (ties to even); they can overflow to
+// infinity
+double intToDouble(const Value &);
+double ratioToDouble(const Value &num, const Value &den);
+// The exact value of a finite double: an integer or a ratio with a
+// power-of-two denominator
+Value exactFromDouble(double);
+
+std::string intToString(const Value &);
+// Decimal digits with an optional sign; the caller has checked the syntax
+Value parseInteger(const char *, size_t);
+
+#endif // BIGNUM_HPP
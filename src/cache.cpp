@@ -0,0 +1,589 @@
+/**
+ * @file cache.cpp
+ * @brief Serialization of parsed programs for the on-disk cache
+ */
+
+#include "cache.hpp"
+#include "RE.hpp"
+#include "bignum.hpp"
+#include "value.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kCacheMagic[4] = {'S', 'C', 'M', 'C'};
+static const uint32_t kCacheVersion = 8;
+
+std::vector<ParseDependency> *parse_dependencies = nullptr;
+
+bool dependenciesHold(const std::vector<ParseDependency> &deps) {
+    for (const ParseDependency &dep : deps) {
+        if (isGlobalBound(dep.name) != dep.bound)
+            return false;
+    }
+    return true;
+}
+
+// FNV-1a; the cache is named after it and also checks the length
+static uint64_t hashSource(const char *p, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static std::string cachePath(const std::string &dir, uint64_t hash) {
+    char file[32];
+    snprintf(file, sizeof file, "/%016llx.scmc", (unsigned long long)hash);
+    return dir + file;
+}
+
+// Node layouts: every node starts with its ExprType, except that unary,
+// binary and variadic primitives (which share types, e.g. Plus and PlusVar)
+// start with a shape byte
+enum CacheShape { SHAPE_NODE, SHAPE_UNARY, SHAPE_BINARY, SHAPE_VARIADIC };
+
+// Raised for anything the format cannot hold or a damaged file
+struct CacheError {};
+
+// ============================================================================
+// Writing
+// ============================================================================
+
+template <class T>
+static void put(std::string &out, T x) {
+    out.append(reinterpret_cast<const char *>(&x), sizeof x);
+}
+
+static void putString(std::string &out, const std::string &s) {
+    put<uint32_t>(out, (uint32_t)s.size());
+    out.append(s);
+}
+
+CacheWriter::CacheWriter() : ok(true), count(0) {}
+
+void CacheWriter::putName(const Name &name) {
+    auto it = index.find(name.operator->());
+    if (it == index.end()) {
+        it = index.emplace(name.operator->(), (uint32_t)names.size()).first;
+        names.push_back(name);
+    }
+    put<uint32_t>(body, it->second);
+}
+
+void CacheWriter::putValue(const Value &v) {
+    put<uint8_t>(body, (uint8_t)v.v_type);
+    switch (v.v_type) {
+    case V_INT:
+        put<int32_t>(body, v.n);
+        break;
+    case V_BOOL:
+        put<uint8_t>(body, v.b);
+        break;
+    case V_NULL:
+    case V_VOID:
+        break;
+    case V_RATIONAL: {
+        Rational *r = static_cast<Rational *>(v.get());
+        putValue(r->numerator);
+        putValue(r->denominator);
+        break;
+    }
+    case V_FLONUM:
+        put<double>(body, v.d);
+        break;
+    case V_BIGNUM: {
+        Bignum *big = static_cast<Bignum *>(v.get());
+        put<uint8_t>(body, big->negative);
+        put<uint32_t>(body, (uint32_t)big->magnitude.size());
+        for (uint32_t limb : big->magnitude)
+            put<uint32_t>(body, limb);
+        break;
+    }
+    case V_SYM:
+        putName(static_cast<Symbol *>(v.get())->s);
+        break;
+    case V_STRING:
+        putString(body, static_cast<String *>(v.get())->s);
+        break;
+    case V_PAIR: {
+        // Quoted lists nest to the right; write the spine iteratively
+        uint32_t length = 0;
+        Value tail = v;
+        for (; tail.v_type == V_PAIR; tail = static_cast<Pair *>(tail.get())->cdr)
+            ++length;
+        put<uint32_t>(body, length);
+        for (Value p = v; p.v_type == V_PAIR; p = static_cast<Pair *>(p.get())->cdr)
+            putValue(static_cast<Pair *>(p.get())->car);
+        putValue(tail);
+        break;
+    }
+    default:
+        throw CacheError();
+    }
+}
+
+void CacheWriter::putExpr(const Expr &expr) {
+    ExprBase *e = expr.get();
+    if (Unary *u = dynamic_cast<Unary *>(e)) {
+        put<uint8_t>(body, SHAPE_UNARY);
+        put<uint8_t>(body, (uint8_t)e->e_type);
+        putExpr(u->rand);
+        return;
+    }
+    if (Binary *b = dynamic_cast<Binary *>(e)) {
+        put<uint8_t>(body, SHAPE_BINARY);
+        put<uint8_t>(body, (uint8_t)e->e_type);
+        putExpr(b->rand1);
+        putExpr(b->rand2);
+        return;
+    }
+    if (Variadic *v = dynamic_cast<Variadic *>(e)) {
+        put<uint8_t>(body, SHAPE_VARIADIC);
+        put<uint8_t>(body, (uint8_t)e->e_type);
+        put<uint32_t>(body, (uint32_t)v->rands.size());
+        for (const Expr &rand : v->rands)
+            putExpr(rand);
+        return;
+    }
+
+    put<uint8_t>(body, SHAPE_NODE);
+    put<uint8_t>(body, (uint8_t)e->e_type);
+    auto putList = [this](const std::vector<Expr> &es) {
+        put<uint32_t>(body, (uint32_t)es.size());
+        for (const Expr &x : es)
+            putExpr(x);
+    };
+    auto putBindings = [this](const std::vector<std::pair<Name, Expr>> &bind) {
+        put<uint32_t>(body, (uint32_t)bind.size());
+        for (const auto &b : bind) {
+            putName(b.first);
+            putExpr(b.second);
+        }
+    };
+    switch (e->e_type) {
+    case E_FIXNUM:
+        put<int32_t>(body, static_cast<Fixnum *>(e)->n);
+        break;
+    case E_RATIONAL:
+        put<int32_t>(body, static_cast<RationalNum *>(e)->numerator);
+        put<int32_t>(body, static_cast<RationalNum *>(e)->denominator);
+        break;
+    case E_STRING:
+        putString(body, static_cast<StringExpr *>(e)->s);
+        break;
+    case E_TRUE:
+    case E_FALSE:
+    case E_VOID:
+    case E_EXIT:
+        break;
+    case E_AND:
+        putList(static_cast<AndVar *>(e)->rands);
+        break;
+    case E_OR:
+        putList(static_cast<OrVar *>(e)->rands);
+        break;
+    case E_BEGIN:
+        putList(static_cast<Begin *>(e)->es);
+        break;
+    case E_QUOTE: {
+        Quote *quote = static_cast<Quote *>(e);
+        put<uint8_t>(body, quote->value != nullptr);
+        if (quote->value)
+            putValue(*quote->value);
+        else
+            putString(body, quote->error);
+        break;
+    }
+    case E_IF: {
+        If *node = static_cast<If *>(e);
+        putExpr(node->cond);
+        putExpr(node->conseq);
+        putExpr(node->alter);
+        break;
+    }
+    case E_COND: {
+        Cond *node = static_cast<Cond *>(e);
+        put<uint32_t>(body, (uint32_t)node->clauses.size());
+        for (const auto &clause : node->clauses)
+            putList(clause);
+        break;
+    }
+    case E_VAR:
+        putName(static_cast<Var *>(e)->x);
+        break;
+    case E_APPLY: {
+        Apply *node = static_cast<Apply *>(e);
+        putExpr(node->rator);
+        putList(node->rand);
+        break;
+    }
+    case E_LAMBDA: {
+        Lambda *node = static_cast<Lambda *>(e);
+        put<uint32_t>(body, (uint32_t)node->x.size());
+        for (const Name &param : node->x)
+            putName(param);
+        putExpr(node->e);
+        break;
+    }
+    case E_DEFINE:
+        putName(static_cast<Define *>(e)->var);
+        putExpr(static_cast<Define *>(e)->e);
+        break;
+    case E_LET:
+        putBindings(static_cast<Let *>(e)->bind);
+        putExpr(static_cast<Let *>(e)->body);
+        break;
+    case E_LETREC:
+        putBindings(static_cast<Letrec *>(e)->bind);
+        putExpr(static_cast<Letrec *>(e)->body);
+        break;
+    case E_SET:
+        putName(static_cast<Set *>(e)->var);
+        putExpr(static_cast<Set *>(e)->e);
+        break;
+    default:
+        throw CacheError();
+    }
+}
+
+bool CacheWriter::add(size_t begin, size_t end, const std::vector<ParseDependency> &deps, const Expr &expr) {
+    if (!ok)
+        return false;
+    size_t mark = body.size();
+    try {
+        put<uint64_t>(body, begin);
+        put<uint64_t>(body, end);
+        put<uint32_t>(body, (uint32_t)deps.size());
+        for (const ParseDependency &dep : deps) {
+            putName(dep.name);
+            put<uint8_t>(body, dep.bound);
+        }
+        putExpr(expr);
+    } catch (const CacheError &) {
+        // Keep the forms before this one; a cache may cover a prefix
+        body.resize(mark);
+        ok = false;
+        return false;
+    }
+    ++count;
+    return true;
+}
+
+bool CacheWriter::save(const std::string &dir, const char *source, size_t len) {
+    if (count == 0)
+        return false;
+    uint64_t hash = hashSource(source, len);
+    std::string out(kCacheMagic, sizeof kCacheMagic);
+    put<uint32_t>(out, kCacheVersion);
+    put<uint64_t>(out, hash);
+    put<uint64_t>(out, len);
+    put<uint32_t>(out, (uint32_t)names.size());
+    put<uint32_t>(out, (uint32_t)count);
+    for (const Name &name : names)
+        putString(out, name.str());
+    out += body;
+
+    // Write a private file and rename it so readers never see a partial cache
+    std::string path = cachePath(dir, hash);
+    std::string tmp = path + "." + std::to_string(getpid());
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == nullptr)
+        return false;
+    bool written = fwrite(out.data(), 1, out.size(), f) == out.size();
+    written = (fclose(f) == 0) && written;
+    if (!written || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// Reading
+// ============================================================================
+
+struct CacheReader {
+    const char *p;
+    const char *end;
+    std::vector<Name> names;
+
+    template <class T>
+    T get() {
+        if ((size_t)(end - p) < sizeof(T))
+            throw CacheError();
+        T x;
+        memcpy(&x, p, sizeof x);
+        p += sizeof x;
+        return x;
+    }
+
+    std::string getString() {
+        uint32_t len = get<uint32_t>();
+        if ((size_t)(end - p) < len)
+            throw CacheError();
+        std::string s(p, len);
+        p += len;
+        return s;
+    }
+
+    const Name &getName() {
+        uint32_t i = get<uint32_t>();
+        if (i >= names.size())
+            throw CacheError();
+        return names[i];
+    }
+
+    Value getValue();
+    Expr getExpr();
+    std::vector<Expr> getList();
+};
+
+Value CacheReader::getValue() {
+    switch (get<uint8_t>()) {
+    case V_INT:
+        return IntegerV(get<int32_t>());
+    case V_BOOL:
+        return BooleanV(get<uint8_t>() != 0);
+    case V_NULL:
+        return NullV();
+    case V_VOID:
+        return VoidV();
+    case V_RATIONAL: {
+        Value num = getValue();
+        Value den = getValue();
+        if (!isExactInteger(num) || !isExactInteger(den) || intSign(den) <= 0)
+            throw CacheError();
+        return RationalV(num, den);
+    }
+    case V_FLONUM:
+        return FlonumV(get<double>());
+    case V_BIGNUM: {
+        bool negative = get<uint8_t>() != 0;
+        uint32_t size = get<uint32_t>();
+        if (size == 0 || size > (size_t)(end - p) / sizeof(uint32_t))
+            throw CacheError();
+        Limbs magnitude(size);
+        for (uint32_t i = 0; i < size; ++i)
+            magnitude[i] = get<uint32_t>();
+        if (magnitude.back() == 0)
+            throw CacheError();
+        return BignumV(negative, std::move(magnitude));
+    }
+    case V_SYM:
+        return SymbolV(getName());
+    case V_STRING:
+        return StringV(getString());
+    case V_PAIR: {
+        uint32_t length = get<uint32_t>();
+        if (length == 0 || length > (size_t)(end - p))
+            throw CacheError();
+        std::vector<Value> items;
+        items.reserve(length);
+        for (uint32_t i = 0; i < length; ++i)
+            items.push_back(getValue());
+        Value list = getValue();
+        for (uint32_t i = length; i-- > 0;) {
+            list = PairV(items[i], list);
+            static_cast<Pair *>(list.get())->literal = true;
+        }
+        return list;
+    }
+    default:
+        throw CacheError();
+    }
+}
+
+std::vector<Expr> CacheReader::getList() {
+    uint32_t n = get<uint32_t>();
+    if (n > (size_t)(end - p))
+        throw CacheError();
+    std::vector<Expr> es;
+    es.reserve(n);
+    for (uint32_t i = 0; i < n; ++i)
+        es.push_back(getExpr());
+    return es;
+}
+
+Expr CacheReader::getExpr() {
+    uint8_t shape = get<uint8_t>();
+    ExprType type = (ExprType)get<uint8_t>();
+    if (shape == SHAPE_UNARY) {
+        Expr node = makeUnary(type, getExpr());
+        if (node.get() == nullptr)
+            throw CacheError();
+        return node;
+    }
+    if (shape == SHAPE_BINARY) {
+        Expr rand1 = getExpr();
+        Expr node = makeBinary(type, rand1, getExpr());
+        if (node.get() == nullptr)
+            throw CacheError();
+        return node;
+    }
+    if (shape == SHAPE_VARIADIC) {
+        Expr node = makeVariadic(type, getList());
+        if (node.get() == nullptr)
+            throw CacheError();
+        return node;
+    }
+    if (shape != SHAPE_NODE)
+        throw CacheError();
+
+    auto getBindings = [this]() {
+        uint32_t n = get<uint32_t>();
+        if (n > (size_t)(end - p))
+            throw CacheError();
+        std::vector<std::pair<Name, Expr>> bind;
+        for (uint32_t i = 0; i < n; ++i) {
+            Name name = getName();
+            bind.emplace_back(name, getExpr());
+        }
+        return bind;
+    };
+    switch (type) {
+    case E_FIXNUM:
+        return Expr(new Fixnum(get<int32_t>()));
+    case E_RATIONAL: {
+        int num = get<int32_t>();
+        int den = get<int32_t>();
+        if (den <= 0)
+            throw CacheError();
+        return Expr(new RationalNum(num, den));
+    }
+    case E_STRING:
+        return Expr(new StringExpr(getString()));
+    case E_TRUE:
+        return Expr(new True());
+    case E_FALSE:
+        return Expr(new False());
+    case E_VOID:
+        return Expr(new MakeVoid());
+    case E_EXIT:
+        return Expr(new Exit());
+    case E_AND:
+        return Expr(new AndVar(getList()));
+    case E_OR:
+        return Expr(new OrVar(getList()));
+    case E_BEGIN:
+        return Expr(new Begin(getList()));
+    case E_QUOTE: {
+        Quote *quote = new Quote();
+        Expr node(quote);
+        if (get<uint8_t>())
+            quote->value.reset(new Value(getValue()));
+        else
+            quote->error = getString();
+        return node;
+    }
+    case E_IF: {
+        Expr cond = getExpr();
+        Expr conseq = getExpr();
+        Expr alter = getExpr();
+        return Expr(new If(cond, conseq, alter));
+    }
+    case E_COND: {
+        uint32_t n = get<uint32_t>();
+        if (n > (size_t)(end - p))
+            throw CacheError();
+        std::vector<std::vector<Expr>> clauses;
+        for (uint32_t i = 0; i < n; ++i)
+            clauses.push_back(getList());
+        return Expr(new Cond(clauses));
+    }
+    case E_VAR:
+        return Expr(new Var(getName()));
+    case E_APPLY: {
+        Expr rator = getExpr();
+        return Expr(new Apply(rator, getList()));
+    }
+    case E_LAMBDA: {
+        uint32_t n = get<uint32_t>();
+        if (n > (size_t)(end - p))
+            throw CacheError();
+        std::vector<Name> params;
+        for (uint32_t i = 0; i < n; ++i)
+            params.push_back(getName());
+        return Expr(new Lambda(params, getExpr()));
+    }
+    case E_DEFINE: {
+        Name var = getName();
+        return Expr(new Define(var, getExpr()));
+    }
+    case E_LET: {
+        auto bind = getBindings();
+        return Expr(new Let(bind, getExpr()));
+    }
+    case E_LETREC: {
+        auto bind = getBindings();
+        return Expr(new Letrec(bind, getExpr()));
+    }
+    case E_SET: {
+        Name var = getName();
+        return Expr(new Set(var, getExpr()));
+    }
+    default:
+        throw CacheError();
+    }
+}
+
+bool loadProgramCache(const std::string &dir, const char *source, size_t len, std::vector<CachedForm> &forms) {
+    uint64_t hash = hashSource(source, len);
+    int fd = open(cachePath(dir, hash).c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    CacheReader in{static_cast<const char *>(map), static_cast<const char *>(map) + st.st_size, {}};
+    bool loaded = false;
+    try {
+        char magic[sizeof kCacheMagic];
+        for (char &c : magic)
+            c = in.get<char>();
+        if (memcmp(magic, kCacheMagic, sizeof magic) != 0 || in.get<uint32_t>() != kCacheVersion ||
+            in.get<uint64_t>() != hash || in.get<uint64_t>() != len)
+            throw CacheError();
+        uint32_t name_count = in.get<uint32_t>();
+        uint32_t form_count = in.get<uint32_t>();
+        for (uint32_t i = 0; i < name_count; ++i)
+            in.names.push_back(Name(in.getString()));
+
+        std::vector<CachedForm> result;
+        size_t last_end = 0;
+        for (uint32_t i = 0; i < form_count; ++i) {
+            CachedForm form{0, 0, {}, Expr(nullptr)};
+            form.begin = in.get<uint64_t>();
+            form.end = in.get<uint64_t>();
+            if (form.begin < last_end || form.end < form.begin || form.end > len)
+                throw CacheError();
+            last_end = form.end;
+            uint32_t ndeps = in.get<uint32_t>();
+            for (uint32_t j = 0; j < ndeps; ++j) {
+                Name name = in.getName();
+                form.deps.push_back(ParseDependency{name, in.get<uint8_t>() != 0});
+            }
+            form.expr = in.getExpr();
+            result.push_back(std::move(form));
+        }
+        if (in.p != in.end)
+            throw CacheError();
+        forms.swap(result);
+        loaded = true;
+    } catch (const CacheError &) {
+    } catch (const RuntimeError &) {
+        // A node constructor rejected its fields
+    }
+    munmap(map, st.st_size);
+    return loaded;
+}
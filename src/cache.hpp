@@ -0,0 +1,81 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+/**
+ * @file cache.hpp
+ * @brief On-disk cache of parsed programs
+ *
+ * A script run with --cache-dir stores the parse of each top-level form in
+ * DIR/<hash of the source>.scmc. The next run of the same text maps that
+ * file and rebuilds the Expr trees instead of reading and parsing. Trees
+ * are saved straight after parse, before resolve, so lexical addressing
+ * (and anything later passes do) is redone on load.
+ *
+ * Parsing is not a pure function of the text: an operator that is bound as
+ * a global is parsed as an application, not as the primitive or special
+ * form of that name. Each form therefore records the global bindings its
+ * parse looked at, and a cached form is only used while they still hold;
+ * otherwise that form is parsed again from its span of the source.
+ *
+ * The file is in host byte order and is only meant for the machine and
+ * build that wrote it. kCacheVersion must change whenever the format or the
+ * parser's output does.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief A global binding the parser looked up, and what it found
+ */
+struct ParseDependency {
+    Name name;
+    bool bound;
+};
+
+// Set while a form is parsed for the cache; the parser appends to it
+extern std::vector<ParseDependency> *parse_dependencies;
+
+bool dependenciesHold(const std::vector<ParseDependency> &);
+
+/**
+ * @brief One top-level form of a cached program
+ */
+struct CachedForm {
+    size_t begin; ///< Span of the form in the source
+    size_t end;
+    std::vector<ParseDependency> deps;
+    Expr expr; ///< Parsed, not yet resolved
+};
+
+/**
+ * @brief Serializes forms as they are parsed, then writes the cache file
+ */
+class CacheWriter {
+public:
+    CacheWriter();
+    // Must be called before the expression is resolved; returns false (and
+    // disables the writer) if the tree holds something the format lacks
+    bool add(size_t begin, size_t end, const std::vector<ParseDependency> &, const Expr &);
+    bool save(const std::string &dir, const char *source, size_t len);
+
+private:
+    bool ok;
+    size_t count;                                          ///< Forms added
+    std::string body;                                      ///< Serialized forms
+    std::vector<Name> names;                               ///< Name table, referenced by index
+    std::unordered_map<const NameEntry *, uint32_t> index; ///< Position of each name in names
+
+    void putName(const Name &);
+    void putExpr(const Expr &);
+    void putValue(const Value &);
+};
+
+// Load the cache for source from dir; false if missing, stale or damaged
+bool loadProgramCache(const std::string &dir, const char *source, size_t len, std::vector<CachedForm> &);
+
+#endif // CACHE_HPP
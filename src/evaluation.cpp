@@ -9,642 +9,789 @@
  */
 
 #include "RE.hpp"
+#include "bignum.hpp"
 #include "expr.hpp"
+#include "profile.hpp"
 #include "syntax.hpp"
 #include "value.hpp"
 #include <climits>
+#include <cmath>
 #include <cstring>
-#include <map>
 #include <vector>
 
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+// Names the evaluator tests for, interned once
+static const Name else_name("else");
+static const Name dot_name(".");
 
-Value Fixnum::eval(Assoc &e) { // evaluation of a fixnum
+Value Fixnum::eval(Env &e) { // evaluation of a fixnum
     return IntegerV(n);
 }
 
-Value RationalNum::eval(Assoc &e) { // evaluation of a rational number
-    return RationalV(numerator, denominator);
+Value RationalNum::eval(Env &e) { // evaluation of a rational number
+    return *value;
 }
 
-Value StringExpr::eval(Assoc &e) { // evaluation of a string
-    return StringV(s);
+Value StringExpr::eval(Env &e) { // evaluation of a string
+    return *value;
 }
 
-Value True::eval(Assoc &e) { // evaluation of #t
+Value True::eval(Env &e) { // evaluation of #t
     return BooleanV(true);
 }
 
-Value False::eval(Assoc &e) { // evaluation of #f
+Value False::eval(Env &e) { // evaluation of #f
     return BooleanV(false);
 }
 
-Value MakeVoid::eval(Assoc &e) { // (void)
+Value MakeVoid::eval(Env &e) { // (void)
     return VoidV();
 }
 
-Value Exit::eval(Assoc &e) { // (exit)
+Value Exit::eval(Env &e) { // (exit)
     return TerminateV();
 }
 
-Value Unary::eval(Assoc &e) { // evaluation of single-operator primitive
-    return evalRator(rand->eval(e));
+static Value applyProcedure(TailCall &tail);
+
+// Run calls left pending by evalTail until a plain value comes back
+static Value trampoline(Value result, TailCall &tail) {
+    while (tail.pending) {
+        result = applyProcedure(tail);
+    }
+    return result;
 }
 
-Value Binary::eval(Assoc &e) { // evaluation of two-operators primitive
-    return evalRator(rand1->eval(e), rand2->eval(e));
+Value ExprBase::evalTail(Env &e, TailCall &) { // not a tail form: evaluate directly
+    return eval(e);
 }
 
-Value Variadic::eval(Assoc &e) { // evaluation of multi-operator primitive
-    // TODO: TO COMPLETE THE VARIADIC CLASS
-    std::vector<Value> args;
-    for (const auto &var : rands)
-        args.push_back(var->eval(e));
-    return evalRator(args);
+Value Unary::eval(Env &e) { // evaluation of single-operator primitive
+    return evalRator(rand->eval(e));
 }
 
-Value Var::eval(Assoc &e) { // evaluation of variable
-    // TODO: TO identify the invalid variable
-    // We request all valid variable just need to be a symbol,you should promise:
-    // The first character of a variable name cannot be a digit or any character from the set: {.@}
-    // If a string can be recognized as a number, it will be prioritized as a number. For example: 1, -1, +123, .123, +124., 1e-3
-    // Variable names can overlap with primitives and reserve_words
-    // Variable names can contain any non-whitespace characters except #, ', ", `, but the first character cannot be a digit
-    // When a variable is not defined in the current scope, your interpreter should output RuntimeError
+Value Binary::eval(Env &e) { // evaluation of two-operators primitive
+    Value first = rand1->eval(e); // operands left to right, as the VM does
+    return evalRator(first, rand2->eval(e));
+}
 
-    if (x.empty() || (isdigit(x[0]) || x[0] == '.' || x[0] == '@')) {
-        throw RuntimeError("Invalid variable name: starts with invalid character");
-    }
+// Operand counts up to this are collected on the C++ stack
+static const size_t kInlineArgs = 4;
+
+// Evaluate rands left to right and pass their values to f
+template <class F>
+static Value withOperands(const std::vector<Expr> &rands, Env &e, F f) {
+    size_t n = rands.size();
+    if (n > kInlineArgs) {
+        std::vector<Value> args;
+        args.reserve(n);
+        for (const auto &var : rands)
+            args.push_back(var->eval(e));
+        return f(ValueSpan(args));
+    }
+    Value args[kInlineArgs] = {Value(nullptr), Value(nullptr), Value(nullptr), Value(nullptr)};
+    for (size_t i = 0; i < n; ++i)
+        args[i] = rands[i]->eval(e);
+    return f(ValueSpan(args, n));
+}
 
-    // Rule 2: No forbidden characters (#, ', ", `)
-    const std::string forbidden_chars = "#'\"`";
-    for (char c : x) {
-        if (forbidden_chars.find(c) != std::string::npos) {
-            throw RuntimeError("Invalid variable name: contains forbidden character '" + std::string(1, c) + "'");
-        }
-    }
+Value Variadic::eval(Env &e) { // evaluation of multi-operator primitive
+    return withOperands(rands, e, [this](const ValueSpan &args) { return evalRator(args); });
+}
 
-    // Rule 3: Reject names that can be recognized as numbers (prioritized as literals)
-    auto isNumeric = [](const std::string &s) -> bool {
-        // Handle integers (+123, -456, 789)
-        if (s.empty())
-            return false;
-        size_t i = 0;
-        if (s[i] == '+' || s[i] == '-')
-            i++; // Sign
-        // Check for digits or valid decimal format
-        bool has_digit = false;
-        bool has_dot = false;
-        bool has_exponent = false;
-        while (i < s.size()) {
-            if (isdigit(s[i])) {
-                has_digit = true;
-            } else if (s[i] == '.') {
-                if (has_dot || has_exponent)
-                    return false;
-                has_dot = true;
-            } else if (s[i] == 'e' || s[i] == 'E') {
-                if (has_exponent || !has_digit)
-                    return false;
-                has_exponent = true;
-                // Exponent must be followed by sign or digit
-                if (++i >= s.size() || (!isdigit(s[i]) && s[i] != '+' && s[i] != '-')) {
-                    return false;
-                }
-                if (s[i] == '+' || s[i] == '-')
-                    i++; // Exponent sign
-                if (i >= s.size() || !isdigit(s[i]))
-                    return false;
-            } else {
-                return false; // Invalid character for number
-            }
-            i++;
-        }
-        // Must have at least one digit (reject "." or "+.")
-        return has_digit;
-    };
-
-    if (isNumeric(x)) {
-        throw RuntimeError("Invalid variable name: numeric format is prioritized as literal");
-    }
-
-    Value matched_value = find(x, e);
-    if (matched_value.get() == nullptr) {
-        if (primitives.count(x)) {
-            static std::map<ExprType, std::pair<Expr, std::vector<std::string>>> primitive_map = {
-                {E_VOID, {new MakeVoid(), {}}},
-                {E_EXIT, {new Exit(), {}}},
-                {E_BOOLQ, {new IsBoolean(new Var("parm")), {"parm"}}},
-                {E_INTQ, {new IsFixnum(new Var("parm")), {"parm"}}},
-                {E_NULLQ, {new IsNull(new Var("parm")), {"parm"}}},
-                {E_PAIRQ, {new IsPair(new Var("parm")), {"parm"}}},
-                {E_PROCQ, {new IsProcedure(new Var("parm")), {"parm"}}},
-                {E_SYMBOLQ, {new IsSymbol(new Var("parm")), {"parm"}}},
-                {E_STRINGQ, {new IsString(new Var("parm")), {"parm"}}},
-                {E_DISPLAY, {new Display(new Var("parm")), {"parm"}}},
-                {E_PLUS, {new PlusVar({}), {"numbers..."}}},
-                {E_MINUS, {new MinusVar({}), {"numbers..."}}},
-                {E_MUL, {new MultVar({}), {"numbers..."}}},
-                {E_DIV, {new DivVar({}), {"numbers..."}}},
-                {E_MODULO, {new Modulo(new Var("parm1"), new Var("parm2")), {"parm1", "parm2"}}},
-                {E_EXPT, {new Expt(new Var("parm1"), new Var("parm2")), {"parm1", "parm2"}}},
-                {E_EQQ, {new EqualVar({}), {}}},
-                {E_LT, {new LessVar({}), {"numbers..."}}},
-                {E_GT, {new GreaterVar({}), {"numbers..."}}},
-                {E_LE, {new LessEqVar({}), {"numbers..."}}},
-                {E_GE, {new GreaterEqVar({}), {"numbers..."}}},
-                {E_EQ, {new GreaterVar({}), {"numbers..."}}},
-                {E_NOT, {new Not(new Var("parm")), {"parm"}}},
-                {E_AND, {new AndVar({}), {"booleans..."}}},
-                {E_OR, {new OrVar({}), {"booleans..."}}},
-                {E_CONS, {new Cons(new Var("parm1"), new Var("parm2")), {"parm1", "parm2"}}},
-                {E_CAR, {new Car(new Var("parm")), {"parm"}}},
-                {E_CDR, {new Cdr(new Var("parm")), {"parm"}}},
-            };
-
-            auto it = primitive_map.find(primitives[x]);
-            // TOD0:to PASS THE parameters correctly;
-            // COMPLETE THE CODE WITH THE HINT IN IF SENTENCE WITH CORRECT RETURN VALUE
-            if (it != primitive_map.end()) {
-                // TODO
-                return ProcedureV(
-                    it->second.second, // Formal parameter names (e.g., {"parm"} for boolean?)
-                    it->second.first,  // Implementation expression (e.g., IsBoolean)
-                    e                  // Capture current environment as closure env
-                );
+Value Var::eval(Env &e) { // evaluation of variable
+    // Name validity and the binding site were settled by the resolve pass
+    Value matched_value(nullptr);
+    switch (kind) {
+    case VK_LOCAL:
+        matched_value = unbox(frameSlot(e, depth, index));
+        break;
+    case VK_FREE:
+        matched_value = unbox(capturedSlot(e, index));
+        break;
+    case VK_GLOBAL:
+        matched_value = globalValue(index);
+        break;
+    case VK_INVALID:
+        throw RuntimeError("Invalid variable name: '" + x.str() + "'");
+    default:
+        throw RuntimeError("Unresolved variable: '" + x.str() + "'");
+    }
+
+    if (matched_value.v_type == V_UNBOUND) {
+        if (x->primitive >= 0) {
+            // An unshadowed primitive name evaluates to its native procedure
+            Value prim = primitiveProcedure(x);
+            if (prim.v_type != V_UNBOUND) {
+                return prim;
             }
         }
-        // Step 3: Variable not found in environment or primitives
-        throw RuntimeError("Undefined variable: '" + x + "'");
+        // Variable not found in environment or primitives
+        throw RuntimeError("Undefined variable: '" + x.str() + "'");
     }
-    if (matched_value->v_type == V_VOID) {
-        throw RuntimeError("Variable '" + x + "' referenced before definition (invalid recursion)");
+    if (matched_value.v_type == V_VOID) {
+        throw RuntimeError("Variable '" + x.str() + "' referenced before definition (invalid recursion)");
     }
     return matched_value;
 }
 
-Value Plus::evalRator(const Value &rand1, const Value &rand2) { // +
-    // TODO: To complete the addition logic
-    // Case 1: Integer + Integer
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int x = dynamic_cast<Integer *>(rand1.get())->n;
-        int y = dynamic_cast<Integer *>(rand2.get())->n;
-        return IntegerV(x + y);
-    }
+// Numeric tower core: each numeric primitive dispatches once on the combined
+// tag of its two operands and then reads the payload through a static
+// downcast. The binary nodes and the variadic folds below share these kernels.
+// Two fixnums take an inline path that detects overflow with the checked
+// arithmetic builtins and only then promotes to a bignum.
 
-    // Case 2: Integer + Rational
-    if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        int int_val = dynamic_cast<Integer *>(rand1.get())->n;
-        int num = dynamic_cast<Rational *>(rand2.get())->numerator;
-        int den = dynamic_cast<Rational *>(rand2.get())->denominator;
-        int new_num = int_val * den + num;
-        return RationalV(new_num, den);
-    }
+static_assert(V_UNBOUND < 16, "operand tags must fit in four bits");
 
-    // Case 3: Rational + Integer
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        int num = dynamic_cast<Rational *>(rand1.get())->numerator;
-        int den = dynamic_cast<Rational *>(rand1.get())->denominator;
-        int int_val = dynamic_cast<Integer *>(rand2.get())->n;
-        int new_num = num + int_val * den;
-        return RationalV(new_num, den);
-    }
+static constexpr int typePair(ValueType t1, ValueType t2) {
+    return ((int)t1 << 4) | (int)t2;
+}
 
-    // Case 4: Rational + Rational
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        int num1 = dynamic_cast<Rational *>(rand1.get())->numerator;
-        int den1 = dynamic_cast<Rational *>(rand1.get())->denominator;
-        int num2 = dynamic_cast<Rational *>(rand2.get())->numerator;
-        int den2 = dynamic_cast<Rational *>(rand2.get())->denominator;
-        int new_num = num1 * den2 + num2 * den1;
-        int new_den = den1 * den2;
-        return RationalV(new_num, new_den);
-    }
+#define INT_INT typePair(V_INT, V_INT)
+#define INT_BIG typePair(V_INT, V_BIGNUM)
+#define INT_RAT typePair(V_INT, V_RATIONAL)
+#define BIG_INT typePair(V_BIGNUM, V_INT)
+#define BIG_BIG typePair(V_BIGNUM, V_BIGNUM)
+#define BIG_RAT typePair(V_BIGNUM, V_RATIONAL)
+#define RAT_INT typePair(V_RATIONAL, V_INT)
+#define RAT_BIG typePair(V_RATIONAL, V_BIGNUM)
+#define RAT_RAT typePair(V_RATIONAL, V_RATIONAL)
+#define FLO_FLO typePair(V_FLONUM, V_FLONUM)
+#define INT_FLO typePair(V_INT, V_FLONUM)
+#define FLO_INT typePair(V_FLONUM, V_INT)
+#define BIG_FLO typePair(V_BIGNUM, V_FLONUM)
+#define FLO_BIG typePair(V_FLONUM, V_BIGNUM)
+#define RAT_FLO typePair(V_RATIONAL, V_FLONUM)
+#define FLO_RAT typePair(V_FLONUM, V_RATIONAL)
+
+static inline bool isNumber(const Value &v) {
+    return v.v_type == V_INT || v.v_type == V_BIGNUM || v.v_type == V_RATIONAL || v.v_type == V_FLONUM;
+}
 
-    throw RuntimeError("Wrong typename: + requires numeric arguments (int/rational)");
+// An exact integer, or a flonum with an integer value
+static inline bool isIntegerValued(const Value &v) {
+    return isExactInteger(v) || (v.v_type == V_FLONUM && std::isfinite(v.d) && v.d == std::trunc(v.d));
 }
 
-Value Minus::evalRator(const Value &rand1, const Value &rand2) { // -
-    // TODO: To complete the substraction logic
-    // Case 1: Integer - Integer
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int x = dynamic_cast<Integer *>(rand1.get())->n;
-        int y = dynamic_cast<Integer *>(rand2.get())->n;
-        return IntegerV(x - y);
+// A number as a double; an exact operand mixed with a flonum is converted
+// to the nearest double first
+static inline double toDouble(const Value &v) {
+    switch (v.v_type) {
+    case V_FLONUM:
+        return v.d;
+    case V_INT:
+        return (double)v.n;
+    case V_BIGNUM:
+        return intToDouble(v);
+    default: {
+        Rational *r = static_cast<Rational *>(v.get());
+        return ratioToDouble(r->numerator, r->denominator);
     }
+    }
+}
 
-    // Case 2: Integer - Rational
-    if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        int int_val = dynamic_cast<Integer *>(rand1.get())->n;
-        int num = dynamic_cast<Rational *>(rand2.get())->numerator;
-        int den = dynamic_cast<Rational *>(rand2.get())->denominator;
-        int new_num = int_val * den - num;
-        return RationalV(new_num, den);
+// An exact number viewed as numerator/denominator (integers have denominator 1)
+struct Fraction {
+    Value num;
+    Value den;
+};
+
+static inline Fraction fractionOf(const Value &v) {
+    if (v.v_type != V_RATIONAL) {
+        return {v, IntegerV(1)};
     }
+    Rational *r = static_cast<Rational *>(v.get());
+    return {r->numerator, r->denominator};
+}
 
-    // Case 3: Rational - Integer
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        int num = dynamic_cast<Rational *>(rand1.get())->numerator;
-        int den = dynamic_cast<Rational *>(rand1.get())->denominator;
-        int int_val = dynamic_cast<Integer *>(rand2.get())->n;
-        int new_num = num - int_val * den;
-        return RationalV(new_num, den);
+// Both parts are fixnums, so any product of two parts fits in 64 bits
+static inline bool isSmall(const Fraction &x) {
+    return x.num.v_type == V_INT && x.den.v_type == V_INT;
+}
+
+static inline bool isOne(const Value &v) {
+    return v.v_type == V_INT && v.n == 1;
+}
+
+static inline uint64_t magnitude64(long long x) {
+    return x < 0 ? 0ull - (uint64_t)x : (uint64_t)x;
+}
+
+static Value quotientOf(const Value &dividend, const Value &divisor) {
+    Value q = IntegerV(0);
+    intDivide(dividend, divisor, &q, nullptr);
+    return q;
+}
+
+// num/den, already in lowest terms with den > 0
+static Value reducedRatio(const Value &num, const Value &den) {
+    if (isOne(den) || intSign(num) == 0) {
+        return num;
     }
+    return Value(new Rational(num, den));
+}
 
-    // Case 4: Rational - Rational
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        int num1 = dynamic_cast<Rational *>(rand1.get())->numerator;
-        int den1 = dynamic_cast<Rational *>(rand1.get())->denominator;
-        int num2 = dynamic_cast<Rational *>(rand2.get())->numerator;
-        int den2 = dynamic_cast<Rational *>(rand2.get())->denominator;
-        int new_num = num1 * den2 - num2 * den1;
-        int new_den = den1 * den2;
-        return RationalV(new_num, new_den);
+static Value reducedRatio64(long long num, long long den) {
+    if (den == 1 || num == 0) {
+        return Integer64V(num);
     }
+    return Value(new Rational(Integer64V(num), Integer64V(den)));
+}
 
-    throw RuntimeError("Wrong typename: - requires numeric arguments (int/rational)");
+// Ratio arithmetic after Knuth, TAOCP vol. 2, 4.5.1. The operands are in
+// lowest terms, so cancelling the small gcds below leaves the result in
+// lowest terms too; the full numerator and denominator are never reduced.
+// When every part is a fixnum the work is done in 64-bit words.
+
+// x + y, or x - y when negate is set
+static Value addFractions(const Fraction &x, const Fraction &y, bool negate) {
+    if (isSmall(x) && isSmall(y)) {
+        long long a = x.num.n, b = x.den.n, d = y.den.n;
+        long long c = negate ? -(long long)y.num.n : y.num.n;
+        long long g = (long long)gcdWord(b, d);
+        if (g == 1) {
+            return reducedRatio64(a * d + c * b, b * d);
+        }
+        long long t = a * (d / g) + c * (b / g);
+        long long g2 = (long long)gcdWord(magnitude64(t), g);
+        return reducedRatio64(t / g2, (b / g) * (d / g2));
+    }
+    Value c = negate ? intNegate(y.num) : y.num;
+    Value g = intGcd(x.den, y.den);
+    if (isOne(g)) {
+        return reducedRatio(intAdd(intMul(x.num, y.den), intMul(c, x.den)), intMul(x.den, y.den));
+    }
+    Value bg = quotientOf(x.den, g);
+    Value t = intAdd(intMul(x.num, quotientOf(y.den, g)), intMul(c, bg));
+    Value g2 = intGcd(t, g);
+    return reducedRatio(quotientOf(t, g2), intMul(bg, quotientOf(y.den, g2)));
 }
 
-Value Mult::evalRator(const Value &rand1, const Value &rand2) { // *
-    // TODO: To complete the Multiplication logic
-    // Case 1: Integer * Integer
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int x = dynamic_cast<Integer *>(rand1.get())->n;
-        int y = dynamic_cast<Integer *>(rand2.get())->n;
-        return IntegerV(x * y);
+static Value mulFractions(const Fraction &x, const Fraction &y) {
+    // Cancel each numerator against the other denominator first
+    if (isSmall(x) && isSmall(y)) {
+        long long a = x.num.n, b = x.den.n, c = y.num.n, d = y.den.n;
+        if (a == 0 || c == 0) {
+            return IntegerV(0);
+        }
+        long long g1 = (long long)gcdWord(magnitude64(a), d);
+        long long g2 = (long long)gcdWord(magnitude64(c), b);
+        return reducedRatio64((a / g1) * (c / g2), (b / g2) * (d / g1));
     }
-
-    // Case 2: Integer * Rational
-    if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        int int_val = dynamic_cast<Integer *>(rand1.get())->n;
-        int num = dynamic_cast<Rational *>(rand2.get())->numerator;
-        int den = dynamic_cast<Rational *>(rand2.get())->denominator;
-        int new_num = int_val * num;
-        return RationalV(new_num, den);
+    if (intSign(x.num) == 0 || intSign(y.num) == 0) {
+        return IntegerV(0);
     }
+    Value g1 = intGcd(x.num, y.den);
+    Value g2 = intGcd(y.num, x.den);
+    return reducedRatio(intMul(quotientOf(x.num, g1), quotientOf(y.num, g2)),
+                        intMul(quotientOf(x.den, g2), quotientOf(y.den, g1)));
+}
 
-    // Case 3: Rational * Integer
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        int num = dynamic_cast<Rational *>(rand1.get())->numerator;
-        int den = dynamic_cast<Rational *>(rand1.get())->denominator;
-        int int_val = dynamic_cast<Integer *>(rand2.get())->n;
-        int new_num = num * int_val;
-        return RationalV(new_num, den);
+static Value divFractions(const Fraction &x, const Fraction &y) {
+    // Multiply by the reciprocal, keeping its denominator positive
+    int sign = intSign(y.num);
+    if (sign == 0) {
+        throw RuntimeError("Division by zero");
+    }
+    if (sign > 0) {
+        return mulFractions(x, Fraction{y.den, y.num});
     }
+    return mulFractions(x, Fraction{intNegate(y.den), intNegate(y.num)});
+}
 
-    // Case 4: Rational * Rational
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        int num1 = dynamic_cast<Rational *>(rand1.get())->numerator;
-        int den1 = dynamic_cast<Rational *>(rand1.get())->denominator;
-        int num2 = dynamic_cast<Rational *>(rand2.get())->numerator;
-        int den2 = dynamic_cast<Rational *>(rand2.get())->denominator;
-        int new_num = num1 * num2;
-        int new_den = den1 * den2;
-        return RationalV(new_num, new_den);
+static int compareFractions(const Fraction &x, const Fraction &y) {
+    // Denominators are positive, so cross-multiplying keeps the order
+    if (isSmall(x) && isSmall(y)) {
+        long long left = (long long)x.num.n * y.den.n;
+        long long right = (long long)y.num.n * x.den.n;
+        return (left < right) ? -1 : (left > right) ? 1
+                                                    : 0;
     }
+    int sx = intSign(x.num), sy = intSign(y.num);
+    if (sx != sy) {
+        return sx < sy ? -1 : 1;
+    }
+    return intCompare(intMul(x.num, y.den), intMul(y.num, x.den));
+}
 
-    throw RuntimeError("Wrong typename: * requires numeric arguments (int/rational)");
+Value numAdd(const Value &rand1, const Value &rand2) {
+    switch (typePair(rand1.v_type, rand2.v_type)) {
+    case INT_INT: {
+        int sum;
+        if (!__builtin_add_overflow(rand1.n, rand2.n, &sum)) {
+            return IntegerV(sum);
+        }
+        return Integer64V((long long)rand1.n + rand2.n);
+    }
+    case INT_BIG:
+    case BIG_INT:
+    case BIG_BIG:
+        return intAdd(rand1, rand2);
+    case INT_RAT:
+    case BIG_RAT:
+    case RAT_INT:
+    case RAT_BIG:
+    case RAT_RAT:
+        return addFractions(fractionOf(rand1), fractionOf(rand2), false);
+    case FLO_FLO:
+        return FlonumV(rand1.d + rand2.d);
+    case INT_FLO:
+    case FLO_INT:
+    case BIG_FLO:
+    case FLO_BIG:
+    case RAT_FLO:
+    case FLO_RAT:
+        return FlonumV(toDouble(rand1) + toDouble(rand2));
+    default:
+        throw RuntimeError("Wrong typename: + requires numeric arguments");
+    }
 }
 
-Value Div::evalRator(const Value &rand1, const Value &rand2) { // /
-    // TODO: To complete the dicision logic
-    // Check for division by zero
-    if (rand2->v_type == V_INT && dynamic_cast<Integer *>(rand2.get())->n == 0) {
-        throw RuntimeError("Division by zero");
+Value numSub(const Value &rand1, const Value &rand2) {
+    switch (typePair(rand1.v_type, rand2.v_type)) {
+    case INT_INT: {
+        int difference;
+        if (!__builtin_sub_overflow(rand1.n, rand2.n, &difference)) {
+            return IntegerV(difference);
+        }
+        return Integer64V((long long)rand1.n - rand2.n);
+    }
+    case INT_BIG:
+    case BIG_INT:
+    case BIG_BIG:
+        return intSub(rand1, rand2);
+    case INT_RAT:
+    case BIG_RAT:
+    case RAT_INT:
+    case RAT_BIG:
+    case RAT_RAT:
+        return addFractions(fractionOf(rand1), fractionOf(rand2), true);
+    case FLO_FLO:
+        return FlonumV(rand1.d - rand2.d);
+    case INT_FLO:
+    case FLO_INT:
+    case BIG_FLO:
+    case FLO_BIG:
+    case RAT_FLO:
+    case FLO_RAT:
+        return FlonumV(toDouble(rand1) - toDouble(rand2));
+    default:
+        throw RuntimeError("Wrong typename: - requires numeric arguments");
     }
-    if (rand2->v_type == V_RATIONAL) {
-        int num2 = dynamic_cast<Rational *>(rand2.get())->numerator;
-        int den2 = dynamic_cast<Rational *>(rand2.get())->denominator;
-        if (num2 == 0)
-            throw RuntimeError("Division by zero");
+}
+
+// -x; unlike 0 - x this keeps the sign of a flonum zero: (- 0.0) is -0.0
+Value numNegate(const Value &rand) {
+    switch (rand.v_type) {
+    case V_INT:
+    case V_BIGNUM:
+        return intNegate(rand);
+    case V_RATIONAL: {
+        Rational *r = static_cast<Rational *>(rand.get());
+        return Value(new Rational(intNegate(r->numerator), r->denominator));
+    }
+    case V_FLONUM:
+        return FlonumV(-rand.d);
+    default:
+        throw RuntimeError("Wrong typename: - requires numeric arguments");
     }
+}
 
-    // Case 1: Integer / Integer (result as rational if not divisible)
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int dividend = dynamic_cast<Integer *>(rand1.get())->n;
-        int divisor = dynamic_cast<Integer *>(rand2.get())->n;
-        if (dividend % divisor == 0) {
-            return IntegerV(dividend / divisor);
-        } else {
-            int num = dividend;
-            int den = divisor;
-            return RationalV(num, den);
+Value numMul(const Value &rand1, const Value &rand2) {
+    switch (typePair(rand1.v_type, rand2.v_type)) {
+    case INT_INT: {
+        int product;
+        if (!__builtin_mul_overflow(rand1.n, rand2.n, &product)) {
+            return IntegerV(product);
         }
+        return Integer64V((long long)rand1.n * rand2.n);
+    }
+    case INT_BIG:
+    case BIG_INT:
+    case BIG_BIG:
+        return intMul(rand1, rand2);
+    case INT_RAT:
+    case BIG_RAT:
+    case RAT_INT:
+    case RAT_BIG:
+    case RAT_RAT:
+        return mulFractions(fractionOf(rand1), fractionOf(rand2));
+    case FLO_FLO:
+        return FlonumV(rand1.d * rand2.d);
+    case INT_FLO:
+    case FLO_INT:
+    case BIG_FLO:
+    case FLO_BIG:
+    case RAT_FLO:
+    case FLO_RAT:
+        return FlonumV(toDouble(rand1) * toDouble(rand2));
+    default:
+        throw RuntimeError("Wrong typename: * requires numeric arguments");
     }
+}
 
-    // Case 2: Integer / Rational (multiply by reciprocal)
-    if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        int int_val = dynamic_cast<Integer *>(rand1.get())->n;
-        int num2 = dynamic_cast<Rational *>(rand2.get())->numerator;
-        int den2 = dynamic_cast<Rational *>(rand2.get())->denominator;
-        int new_num = int_val * den2;
-        int new_den = num2;
-        return RationalV(new_num, new_den);
+Value numDiv(const Value &rand1, const Value &rand2) {
+    switch (typePair(rand1.v_type, rand2.v_type)) {
+    case INT_INT:
+        if (rand2.n == 0) {
+            throw RuntimeError("Division by zero");
+        }
+        // INT_MIN / -1 overflows, so -1 takes the general path
+        if (rand2.n != -1 && rand1.n % rand2.n == 0) {
+            return IntegerV(rand1.n / rand2.n);
+        }
+        return RationalV(rand1, rand2);
+    case INT_BIG:
+    case BIG_INT:
+    case BIG_BIG:
+        return RationalV(rand1, rand2);
+    case INT_RAT:
+    case BIG_RAT:
+    case RAT_INT:
+    case RAT_BIG:
+    case RAT_RAT:
+        return divFractions(fractionOf(rand1), fractionOf(rand2));
+    case FLO_FLO:
+        return FlonumV(rand1.d / rand2.d);
+    case INT_FLO:
+    case FLO_INT:
+    case BIG_FLO:
+    case FLO_BIG:
+    case RAT_FLO:
+    case FLO_RAT:
+        return FlonumV(toDouble(rand1) / toDouble(rand2));
+    default:
+        throw RuntimeError("Wrong typename: / requires numeric arguments");
     }
+}
 
-    // Case 3: Rational / Integer (multiply by reciprocal)
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        int num1 = dynamic_cast<Rational *>(rand1.get())->numerator;
-        int den1 = dynamic_cast<Rational *>(rand1.get())->denominator;
-        int divisor = dynamic_cast<Integer *>(rand2.get())->n;
-        int new_num = num1;
-        int new_den = den1 * divisor;
-        return RationalV(new_num, new_den);
-    }
+static inline int compareDoubles(double x, double y) {
+    return (x < y) ? -1 : (x > y) ? 1
+                   : (x == y) ? 0
+                              : kUnordered;
+}
 
-    // Case 4: Rational / Rational (multiply by reciprocal)
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        int num1 = dynamic_cast<Rational *>(rand1.get())->numerator;
-        int den1 = dynamic_cast<Rational *>(rand1.get())->denominator;
-        int num2 = dynamic_cast<Rational *>(rand2.get())->numerator;
-        int den2 = dynamic_cast<Rational *>(rand2.get())->denominator;
-        int new_num = num1 * den2;
-        int new_den = den1 * num2;
-        return RationalV(new_num, new_den);
+// Three-way comparison of two numbers: -1, 0 or 1, or kUnordered when
+// either is a NaN
+int compareNumericValues(const Value &v1, const Value &v2) {
+    switch (typePair(v1.v_type, v2.v_type)) {
+    case INT_INT:
+        return (v1.n < v2.n) ? -1 : (v1.n > v2.n) ? 1
+                                                  : 0;
+    case INT_BIG:
+    case BIG_INT:
+    case BIG_BIG:
+        return intCompare(v1, v2);
+    case INT_RAT:
+    case BIG_RAT:
+    case RAT_INT:
+    case RAT_BIG:
+    case RAT_RAT:
+        return compareFractions(fractionOf(v1), fractionOf(v2));
+    case FLO_FLO:
+        return compareDoubles(v1.d, v2.d);
+    case INT_FLO:
+    case FLO_INT:
+    case BIG_FLO:
+    case FLO_BIG:
+    case RAT_FLO:
+    case FLO_RAT:
+        return compareDoubles(toDouble(v1), toDouble(v2));
+    default:
+        throw RuntimeError("Wrong typename in numeric comparison");
     }
+}
 
-    throw RuntimeError("Wrong typename: / requires numeric arguments (int/rational)");
+Value Plus::evalRator(const Value &rand1, const Value &rand2) { // +
+    return numAdd(rand1, rand2);
+}
+
+Value Minus::evalRator(const Value &rand1, const Value &rand2) { // -
+    return numSub(rand1, rand2);
+}
+
+Value Negate::evalRator(const Value &rand) { // - with one arg
+    return numNegate(rand);
+}
+
+Value Mult::evalRator(const Value &rand1, const Value &rand2) { // *
+    return numMul(rand1, rand2);
+}
+
+Value Div::evalRator(const Value &rand1, const Value &rand2) { // /
+    return numDiv(rand1, rand2);
 }
 
 Value Modulo::evalRator(const Value &rand1, const Value &rand2) { // modulo
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int dividend = dynamic_cast<Integer *>(rand1.get())->n;
-        int divisor = dynamic_cast<Integer *>(rand2.get())->n;
+    if (rand1.v_type == V_INT && rand2.v_type == V_INT) {
+        int dividend = rand1.n;
+        int divisor = rand2.n;
+        if (divisor == 0) {
+            throw(RuntimeError("Division by zero"));
+        }
+        // INT_MIN % -1 traps, and anything modulo -1 is 0
+        return IntegerV(divisor == -1 ? 0 : dividend % divisor);
+    }
+    if (isExactInteger(rand1) && isExactInteger(rand2)) {
+        Value remainder = IntegerV(0);
+        intDivide(rand1, rand2, nullptr, &remainder);
+        return remainder;
+    }
+    if (isIntegerValued(rand1) && isIntegerValued(rand2)) {
+        // An integral flonum operand makes the result a flonum
+        double divisor = toDouble(rand2);
         if (divisor == 0) {
             throw(RuntimeError("Division by zero"));
         }
-        return IntegerV(dividend % divisor);
+        return FlonumV(std::fmod(toDouble(rand1), divisor));
     }
     throw(RuntimeError("modulo is only defined for integers"));
 }
 
-Value PlusVar::evalRator(const std::vector<Value> &args) { // + with multiple args
-    // TODO: To complete the addition logic
+Value PlusVar::evalRator(const ValueSpan &args) { // + with multiple args
     if (args.empty()) {
         return IntegerV(0); // Scheme standard: (+) => 0
     }
     // Accumulate result by sequentially applying binary +
     Value result = args[0];
     for (size_t i = 1; i < args.size(); ++i) {
-        result = Plus(Expr(nullptr), Expr(nullptr)).evalRator(result, args[i]);
+        result = numAdd(result, args[i]);
     }
     return result;
 }
 
-Value MinusVar::evalRator(const std::vector<Value> &args) { // - with multiple args
-    // TODO: To complete the substraction
+Value MinusVar::evalRator(const ValueSpan &args) { // - with multiple args
     if (args.empty()) {
         throw RuntimeError("minus requires at least 1 argument");
     }
     if (args.size() == 1) {
-        // Single argument: return its negation (0 - arg)
-        return Minus(Expr(nullptr), Expr(nullptr)).evalRator(IntegerV(0), args[0]);
+        return numNegate(args[0]);
     }
     // Accumulate result by sequentially applying binary -
     Value result = args[0];
     for (size_t i = 1; i < args.size(); ++i) {
-        result = Minus(Expr(nullptr), Expr(nullptr)).evalRator(result, args[i]);
+        result = numSub(result, args[i]);
     }
     return result;
 }
 
-Value MultVar::evalRator(const std::vector<Value> &args) { // * with multiple args
-    // TODO: To complete the multiplication logic
+Value MultVar::evalRator(const ValueSpan &args) { // * with multiple args
     if (args.empty()) {
         return IntegerV(1); // Scheme standard: (*) => 1
     }
     // Accumulate result by sequentially applying binary *
     Value result = args[0];
     for (size_t i = 1; i < args.size(); ++i) {
-        result = Mult(Expr(nullptr), Expr(nullptr)).evalRator(result, args[i]); // Reuse Binary::Mult
+        result = numMul(result, args[i]);
     }
     return result;
 }
 
-Value DivVar::evalRator(const std::vector<Value> &args) { // / with multiple args
-    // TODO: To complete the divisor logic
+Value DivVar::evalRator(const ValueSpan &args) { // / with multiple args
     if (args.empty()) {
         throw RuntimeError("division requires at least 1 argument");
     }
     if (args.size() == 1) {
         // Single argument: return its reciprocal (1 / arg)
-        return Div(Expr(nullptr), Expr(nullptr)).evalRator(IntegerV(1), args[0]);
+        return numDiv(IntegerV(1), args[0]);
     }
     // Accumulate result by sequentially applying binary /
     Value result = args[0];
     for (size_t i = 1; i < args.size(); ++i) {
-        result = Div(Expr(nullptr), Expr(nullptr)).evalRator(result, args[i]); // Reuse Binary::Div
+        result = numDiv(result, args[i]);
     }
     return result;
 }
 
 Value Expt::evalRator(const Value &rand1, const Value &rand2) { // expt
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int base = dynamic_cast<Integer *>(rand1.get())->n;
-        int exponent = dynamic_cast<Integer *>(rand2.get())->n;
+    if (isExactInteger(rand1) && rand2.v_type == V_INT) {
+        int exponent = rand2.n;
 
         if (exponent < 0) {
             throw(RuntimeError("Negative exponent not supported for integers"));
         }
-        if (base == 0 && exponent == 0) {
+        if (intSign(rand1) == 0 && exponent == 0) {
             throw(RuntimeError("0^0 is undefined"));
         }
 
-        long long result = 1;
-        long long b = base;
-        int exp = exponent;
-
-        while (exp > 0) {
-            if (exp % 2 == 1) {
-                result *= b;
-                if (result > INT_MAX || result < INT_MIN) {
-                    throw(RuntimeError("Integer overflow in expt"));
-                }
+        // Square and multiply; the result promotes to a bignum as it grows
+        Value result = IntegerV(1);
+        Value b = rand1;
+        while (exponent > 0) {
+            if (exponent % 2 == 1) {
+                result = numMul(result, b);
             }
-            b *= b;
-            if (b > INT_MAX || b < INT_MIN) {
-                if (exp > 1) {
-                    throw(RuntimeError("Integer overflow in expt"));
-                }
+            exponent /= 2;
+            if (exponent > 0) {
+                b = numMul(b, b);
             }
-            exp /= 2;
         }
-        // std::cout << "DEBUG: expt result = " << (int)result << std::endl;
-        return IntegerV((int)result);
+        return result;
+    }
+    if (isExactInteger(rand1) && rand2.v_type == V_BIGNUM) {
+        throw(RuntimeError("Exponent too large in expt"));
+    }
+    if ((rand1.v_type == V_FLONUM || rand2.v_type == V_FLONUM) && isNumber(rand1) && isNumber(rand2)) {
+        return FlonumV(std::pow(toDouble(rand1), toDouble(rand2)));
     }
     throw(RuntimeError("Wrong typename"));
 }
 
-// A FUNCTION TO SIMPLIFY THE COMPARISON WITH INTEGER AND RATIONAL NUMBER
-int compareNumericValues(const Value &v1, const Value &v2) {
-    if (v1->v_type == V_INT && v2->v_type == V_INT) {
-        int n1 = dynamic_cast<Integer *>(v1.get())->n;
-        int n2 = dynamic_cast<Integer *>(v2.get())->n;
-        return (n1 < n2) ? -1 : (n1 > n2) ? 1
-                                          : 0;
-    } else if (v1->v_type == V_RATIONAL && v2->v_type == V_INT) {
-        Rational *r1 = dynamic_cast<Rational *>(v1.get());
-        int n2 = dynamic_cast<Integer *>(v2.get())->n;
-        int left = r1->numerator;
-        int right = n2 * r1->denominator;
-        return (left < right) ? -1 : (left > right) ? 1
-                                                    : 0;
-    } else if (v1->v_type == V_INT && v2->v_type == V_RATIONAL) {
-        int n1 = dynamic_cast<Integer *>(v1.get())->n;
-        Rational *r2 = dynamic_cast<Rational *>(v2.get());
-        int left = n1 * r2->denominator;
-        int right = r2->numerator;
-        return (left < right) ? -1 : (left > right) ? 1
-                                                    : 0;
-    } else if (v1->v_type == V_RATIONAL && v2->v_type == V_RATIONAL) {
-        Rational *r1 = dynamic_cast<Rational *>(v1.get());
-        Rational *r2 = dynamic_cast<Rational *>(v2.get());
-        int left = r1->numerator * r2->denominator;
-        int right = r2->numerator * r1->denominator;
-        return (left < right) ? -1 : (left > right) ? 1
-                                                    : 0;
+Value ExactToInexact::evalRator(const Value &rand) { // exact->inexact
+    if (!isNumber(rand)) {
+        throw RuntimeError("Wrong typename: exact->inexact requires a number");
     }
-    throw RuntimeError("Wrong typename in numeric comparison");
+    return FlonumV(toDouble(rand));
 }
 
-Value Less::evalRator(const Value &rand1, const Value &rand2) { // <
-    // TODO: To complete the less logic
-    if (((rand1->v_type == V_INT) || (rand1->v_type == V_RATIONAL)) &&
-        ((rand2->v_type == V_INT) || (rand2->v_type == V_RATIONAL))) {
-        if (compareNumericValues(rand1, rand2) == -1)
-            return BooleanV(1);
-        else
-            return BooleanV(0);
+Value InexactToExact::evalRator(const Value &rand) { // inexact->exact
+    if (rand.v_type == V_FLONUM) {
+        return exactFromDouble(rand.d);
     }
-    throw(RuntimeError("Wrong typename"));
+    if (!isNumber(rand)) {
+        throw RuntimeError("Wrong typename: inexact->exact requires a number");
+    }
+    return rand;
 }
 
-Value LessEq::evalRator(const Value &rand1, const Value &rand2) { // <=
-    // TODO: To complete the lesseq logic
-    if (((rand1->v_type == V_INT) || (rand1->v_type == V_RATIONAL)) &&
-        ((rand2->v_type == V_INT) || (rand2->v_type == V_RATIONAL))) {
-        if (compareNumericValues(rand1, rand2) != 1)
-            return BooleanV(1);
-        else
-            return BooleanV(0);
+// Operand of an elementary function, which always returns a flonum
+static double realOperand(const Value &rand, const char *name) {
+    if (!isNumber(rand)) {
+        throw RuntimeError(std::string("Wrong typename: ") + name + " requires a number");
     }
-    throw(RuntimeError("Wrong typename"));
+    return toDouble(rand);
 }
 
-Value Equal::evalRator(const Value &rand1, const Value &rand2) { // =
-    // TODO: To complete the equal logic
-    if (((rand1->v_type == V_INT) || (rand1->v_type == V_RATIONAL)) &&
-        ((rand2->v_type == V_INT) || (rand2->v_type == V_RATIONAL))) {
-        if (compareNumericValues(rand1, rand2) == 0)
-            return BooleanV(1);
-        else
-            return BooleanV(0);
+Value Sqrt::evalRator(const Value &rand) { // sqrt
+    // The root of an exact square stays exact
+    if (rand.v_type == V_INT && rand.n >= 0) {
+        long long root = (long long)std::sqrt((double)rand.n);
+        while (root * root > rand.n) {
+            --root;
+        }
+        while ((root + 1) * (root + 1) <= rand.n) {
+            ++root;
+        }
+        if (root * root == rand.n) {
+            return IntegerV((int)root);
+        }
     }
-    throw(RuntimeError("Wrong typename"));
+    return FlonumV(std::sqrt(realOperand(rand, "sqrt")));
+}
+
+Value Exp::evalRator(const Value &rand) { // exp
+    return FlonumV(std::exp(realOperand(rand, "exp")));
+}
+
+Value Log::evalRator(const Value &rand) { // log
+    return FlonumV(std::log(realOperand(rand, "log")));
+}
+
+Value Sin::evalRator(const Value &rand) { // sin
+    return FlonumV(std::sin(realOperand(rand, "sin")));
+}
+
+Value Cos::evalRator(const Value &rand) { // cos
+    return FlonumV(std::cos(realOperand(rand, "cos")));
+}
+
+Value Tan::evalRator(const Value &rand) { // tan
+    return FlonumV(std::tan(realOperand(rand, "tan")));
+}
+
+Value Asin::evalRator(const Value &rand) { // asin
+    return FlonumV(std::asin(realOperand(rand, "asin")));
+}
+
+Value Acos::evalRator(const Value &rand) { // acos
+    return FlonumV(std::acos(realOperand(rand, "acos")));
+}
+
+Value Atan::evalRator(const Value &rand) { // atan
+    return FlonumV(std::atan(realOperand(rand, "atan")));
+}
+
+Value Atan2::evalRator(const Value &rand1, const Value &rand2) { // atan with two args
+    return FlonumV(std::atan2(realOperand(rand1, "atan"), realOperand(rand2, "atan")));
+}
+
+Value Less::evalRator(const Value &rand1, const Value &rand2) { // <
+    return BooleanV(compareNumericValues(rand1, rand2) < 0);
+}
+
+Value LessEq::evalRator(const Value &rand1, const Value &rand2) { // <=
+    return BooleanV(compareNumericValues(rand1, rand2) <= 0);
+}
+
+Value Equal::evalRator(const Value &rand1, const Value &rand2) { // =
+    return BooleanV(compareNumericValues(rand1, rand2) == 0);
 }
 
 Value GreaterEq::evalRator(const Value &rand1, const Value &rand2) { // >=
-    // TODO: To complete the greatereq logic
-    if (((rand1->v_type == V_INT) || (rand1->v_type == V_RATIONAL)) &&
-        ((rand2->v_type == V_INT) || (rand2->v_type == V_RATIONAL))) {
-        if (compareNumericValues(rand1, rand2) != -1)
-            return BooleanV(1);
-        else
-            return BooleanV(0);
-    }
-    throw(RuntimeError("Wrong typename"));
+    return BooleanV(isGreaterEq(compareNumericValues(rand1, rand2)));
 }
 
 Value Greater::evalRator(const Value &rand1, const Value &rand2) { // >
-    // TODO: To complete the greater logic
-    if (((rand1->v_type == V_INT) || (rand1->v_type == V_RATIONAL)) &&
-        ((rand2->v_type == V_INT) || (rand2->v_type == V_RATIONAL))) {
-        if (compareNumericValues(rand1, rand2) == 1)
-            return BooleanV(1);
-        else
-            return BooleanV(0);
-    }
-    throw(RuntimeError("Wrong typename"));
+    return BooleanV(compareNumericValues(rand1, rand2) == 1);
 }
 
-Value LessVar::evalRator(const std::vector<Value> &args) { // < with multiple args
-    // TODO: To complete the less logic
-    if (args.size() < 2) {
-        return BooleanV(true); // Scheme standard: (<) or (< a) => #t
-    }
-    for (size_t i = 0; i < args.size() - 1; ++i) {
-        // Reuse Binary::Less logic for pairwise comparison
-        Value res = Less(Expr(nullptr), Expr(nullptr)).evalRator(args[i], args[i + 1]);
-        if (!dynamic_cast<Boolean *>(res.get())->b) {
-            return BooleanV(false); // Early exit on first failure
+// Chained comparison: every adjacent pair must satisfy test, stopping at
+// the first pair that does not
+template <typename Test>
+static Value compareChain(const ValueSpan &args, Test test) {
+    bool holds = true;
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        if (!test(compareNumericValues(args[i], args[i + 1]))) {
+            holds = false;
+            break;
         }
     }
-    return BooleanV(true);
+    return BooleanV(holds);
 }
 
-Value LessEqVar::evalRator(const std::vector<Value> &args) { // <= with multiple args
-    // TODO: To complete the lesseq logic
-    if (args.size() < 2) {
-        return BooleanV(true);
-    }
-    for (size_t i = 0; i < args.size() - 1; ++i) {
-        Value res = LessEq(Expr(nullptr), Expr(nullptr)).evalRator(args[i], args[i + 1]);
-        if (!dynamic_cast<Boolean *>(res.get())->b) {
-            return BooleanV(false);
-        }
-    }
-    return BooleanV(true);
+Value LessVar::evalRator(const ValueSpan &args) { // < with multiple args
+    // Scheme standard: (<) or (< a) => #t
+    return compareChain(args, [](int c) { return c < 0; });
 }
 
-Value EqualVar::evalRator(const std::vector<Value> &args) { // = with multiple args
-    // TODO: To complete the equal logic
-    if (args.size() < 2) {
-        return BooleanV(true);
-    }
-    for (size_t i = 0; i < args.size() - 1; ++i) {
-        Value res = Equal(Expr(nullptr), Expr(nullptr)).evalRator(args[i], args[i + 1]);
-        if (!dynamic_cast<Boolean *>(res.get())->b) {
-            return BooleanV(false);
-        }
-    }
-    return BooleanV(true);
+Value LessEqVar::evalRator(const ValueSpan &args) { // <= with multiple args
+    return compareChain(args, [](int c) { return c <= 0; });
 }
 
-Value GreaterEqVar::evalRator(const std::vector<Value> &args) { // >= with multiple args
-    // TODO: To complete the greatereq logic
-    if (args.size() < 2) {
-        return BooleanV(true);
-    }
-    for (size_t i = 0; i < args.size() - 1; ++i) {
-        Value res = GreaterEq(Expr(nullptr), Expr(nullptr)).evalRator(args[i], args[i + 1]);
-        if (!dynamic_cast<Boolean *>(res.get())->b) {
-            return BooleanV(false);
-        }
-    }
-    return BooleanV(true);
+Value EqualVar::evalRator(const ValueSpan &args) { // = with multiple args
+    return compareChain(args, [](int c) { return c == 0; });
 }
 
-Value GreaterVar::evalRator(const std::vector<Value> &args) { // > with multiple args
-    // TODO: To complete the greater logic
-    if (args.size() < 2) {
-        return BooleanV(true);
-    }
-    for (size_t i = 0; i < args.size() - 1; ++i) {
-        Value res = Greater(Expr(nullptr), Expr(nullptr)).evalRator(args[i], args[i + 1]);
-        if (!dynamic_cast<Boolean *>(res.get())->b) {
-            return BooleanV(false);
-        }
-    }
-    return BooleanV(true);
+Value GreaterEqVar::evalRator(const ValueSpan &args) { // >= with multiple args
+    return compareChain(args, [](int c) { return isGreaterEq(c); });
 }
 
+Value GreaterVar::evalRator(const ValueSpan &args) { // > with multiple args
+    return compareChain(args, [](int c) { return c == 1; });
+}
+
+#undef INT_INT
+#undef INT_BIG
+#undef INT_RAT
+#undef BIG_INT
+#undef BIG_BIG
+#undef BIG_RAT
+#undef RAT_INT
+#undef RAT_BIG
+#undef RAT_RAT
+#undef FLO_FLO
+#undef INT_FLO
+#undef FLO_INT
+#undef BIG_FLO
+#undef FLO_BIG
+#undef RAT_FLO
+#undef FLO_RAT
+
 Value Cons::evalRator(const Value &rand1, const Value &rand2) { // cons
     // TODO: To complete the cons logic
     return PairV(rand1, rand2);
 }
 
-Value ListFunc::evalRator(const std::vector<Value> &args) { // list function
+Value ListFunc::evalRator(const ValueSpan &args) { // list function
     // TODO: To complete the list logic
     Value now = NullV();
     for (auto it = args.rbegin(); it != args.rend(); ++it) {
@@ -658,47 +805,47 @@ Value IsList::evalRator(const Value &rand) { // list?
     Value current = rand;
 
     // Rule 1: The empty list is a valid list
-    if (current->v_type == V_NULL) {
+    if (current.v_type == V_NULL) {
         return BooleanV(true);
     }
 
     // Rule 2: Non-pair values cannot be lists
-    if (current->v_type != V_PAIR) {
+    if (current.v_type != V_PAIR) {
         return BooleanV(false);
     }
 
     // Initialize slow and fast pointers to detect cycles (tortoise-hare algorithm)
     Value slow = current;                                  // Slow pointer: moves 1 step at a time
-    Value fast = dynamic_cast<Pair *>(current.get())->cdr; // Fast pointer: initial 1st step
+    Value fast = static_cast<Pair *>(current.get())->cdr; // Fast pointer: initial 1st step
 
     // Traverse the cdr chain while fast pointer points to a pair
-    while (fast->v_type == V_PAIR) {
+    while (fast.v_type == V_PAIR) {
         // Cycle detected (slow and fast pointers meet) → not a list
         if (slow.get() == fast.get()) {
             return BooleanV(false);
         }
 
         // Move slow pointer 1 step (follow current pair's cdr)
-        slow = dynamic_cast<Pair *>(slow.get())->cdr;
+        slow = static_cast<Pair *>(slow.get())->cdr;
 
         // Move fast pointer 1st step (follow current pair's cdr)
-        fast = dynamic_cast<Pair *>(fast.get())->cdr;
+        fast = static_cast<Pair *>(fast.get())->cdr;
 
         // Check if fast pointer can move a 2nd step (avoid invalid cdr access)
-        if (fast->v_type != V_PAIR) {
+        if (fast.v_type != V_PAIR) {
             break;
         }
-        fast = dynamic_cast<Pair *>(fast.get())->cdr; // Fast pointer 2nd step
+        fast = static_cast<Pair *>(fast.get())->cdr; // Fast pointer 2nd step
     }
 
     // After loop: valid lists must end with the empty list (V_NULL)
-    return BooleanV(fast->v_type == V_NULL);
+    return BooleanV(fast.v_type == V_NULL);
 }
 
 Value Car::evalRator(const Value &rand) { // car
     // TODO: To complete the car logic
-    if (rand->v_type == V_PAIR) {
-        Value current = dynamic_cast<Pair *>(rand.get())->car;
+    if (rand.v_type == V_PAIR) {
+        Value current = static_cast<Pair *>(rand.get())->car;
         return current;
     }
     throw(RuntimeError("Wrong typename"));
@@ -706,8 +853,8 @@ Value Car::evalRator(const Value &rand) { // car
 
 Value Cdr::evalRator(const Value &rand) { // cdr
     // TODO: To complete the cdr logic
-    if (rand->v_type == V_PAIR) {
-        Value current = dynamic_cast<Pair *>(rand.get())->cdr;
+    if (rand.v_type == V_PAIR) {
+        Value current = static_cast<Pair *>(rand.get())->cdr;
         return current;
     }
     throw(RuntimeError("Wrong typename"));
@@ -716,256 +863,313 @@ Value Cdr::evalRator(const Value &rand) { // cdr
 Value SetCar::evalRator(const Value &rand1, const Value &rand2) { // set-car!
     // TODO: To complete the set-car! logic
     // Validate first argument is a pair
-    if (rand1->v_type != V_PAIR) {
+    if (rand1.v_type != V_PAIR) {
         throw RuntimeError("set-car!: first argument must be a pair");
     }
+    Pair *pair = static_cast<Pair *>(rand1.get());
+    if (pair->literal) {
+        throw RuntimeError("set-car!: cannot modify a quoted constant");
+    }
     // Mutate the car field of the pair (direct memory update)
-    dynamic_cast<Pair *>(rand1.get())->car = rand2;
+    pair->car = rand2;
     return VoidV();
 }
 
 Value SetCdr::evalRator(const Value &rand1, const Value &rand2) { // set-cdr!
     // TODO: To complete the set-cdr! logic
     // Validate first argument is a pair
-    if (rand1->v_type != V_PAIR) {
+    if (rand1.v_type != V_PAIR) {
         throw RuntimeError("set-cdr!: first argument must be a pair");
     }
+    Pair *pair = static_cast<Pair *>(rand1.get());
+    if (pair->literal) {
+        throw RuntimeError("set-cdr!: cannot modify a quoted constant");
+    }
     // Mutate the cdr field of the pair (direct memory update)
-    dynamic_cast<Pair *>(rand1.get())->cdr = rand2;
+    pair->cdr = rand2;
     return VoidV();
 }
 
+Value SameTemplate::evalRator(const Value &rand) { // guard of an inlined call
+    return BooleanV(rand.v_type == V_PROC && static_cast<Procedure *>(rand.get())->tmpl->serial == serial);
+}
+
 Value IsEq::evalRator(const Value &rand1, const Value &rand2) { // eq?
-    // 检查类型是否为 Integer
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        return BooleanV((dynamic_cast<Integer *>(rand1.get())->n) == (dynamic_cast<Integer *>(rand2.get())->n));
-    }
-    // 检查类型是否为 Boolean
-    else if (rand1->v_type == V_BOOL && rand2->v_type == V_BOOL) {
-        return BooleanV((dynamic_cast<Boolean *>(rand1.get())->b) == (dynamic_cast<Boolean *>(rand2.get())->b));
-    }
-    // 检查类型是否为 Symbol
-    else if (rand1->v_type == V_SYM && rand2->v_type == V_SYM) {
-        return BooleanV((dynamic_cast<Symbol *>(rand1.get())->s) == (dynamic_cast<Symbol *>(rand2.get())->s));
+    if (rand1.v_type != rand2.v_type) {
+        return BooleanV(false);
     }
-    // 检查类型是否为 Null 或 Void
-    else if ((rand1->v_type == V_NULL && rand2->v_type == V_NULL) ||
-             (rand1->v_type == V_VOID && rand2->v_type == V_VOID)) {
+    switch (rand1.v_type) {
+    case V_INT:
+        return BooleanV(rand1.n == rand2.n);
+    case V_BIGNUM:
+        // Like fixnums, equal bignums are the same number
+        return BooleanV(intCompare(rand1, rand2) == 0);
+    case V_FLONUM:
+        return BooleanV(rand1.d == rand2.d);
+    case V_BOOL:
+        return BooleanV(rand1.b == rand2.b);
+    case V_SYM:
+        return BooleanV(static_cast<Symbol *>(rand1.get())->s == static_cast<Symbol *>(rand2.get())->s);
+    case V_NULL:
+    case V_VOID:
         return BooleanV(true);
-    } else {
+    default:
+        // Heap values compare by identity
         return BooleanV(rand1.get() == rand2.get());
     }
 }
 
 Value IsBoolean::evalRator(const Value &rand) { // boolean?
-    return BooleanV(rand->v_type == V_BOOL);
+    return BooleanV(rand.v_type == V_BOOL);
 }
 
 Value IsFixnum::evalRator(const Value &rand) { // number?
-    return BooleanV(rand->v_type == V_INT);
+    return BooleanV(isNumber(rand));
 }
 
 Value IsNull::evalRator(const Value &rand) { // null?
-    return BooleanV(rand->v_type == V_NULL);
+    return BooleanV(rand.v_type == V_NULL);
 }
 
 Value IsPair::evalRator(const Value &rand) { // pair?
-    return BooleanV(rand->v_type == V_PAIR);
+    return BooleanV(rand.v_type == V_PAIR);
 }
 
 Value IsProcedure::evalRator(const Value &rand) { // procedure?
-    return BooleanV(rand->v_type == V_PROC);
+    return BooleanV(isProcedure(rand));
 }
 
 Value IsSymbol::evalRator(const Value &rand) { // symbol?
-    return BooleanV(rand->v_type == V_SYM);
+    return BooleanV(rand.v_type == V_SYM);
 }
 
 Value IsString::evalRator(const Value &rand) { // string?
-    return BooleanV(rand->v_type == V_STRING);
+    return BooleanV(rand.v_type == V_STRING);
+}
+
+Value Begin::eval(Env &e) {
+    TailCall tail;
+    return trampoline(evalTail(e, tail), tail);
 }
 
-Value Begin::eval(Assoc &e) {
+Value Begin::evalTail(Env &e, TailCall &tail) {
     // TODO: To complete the begin logic
-    Value last_val = VoidV(); // Default to Void if no expressions
+    if (es.empty()) {
+        return VoidV(); // Default to Void if no expressions
+    }
 
-    // Evaluate all expressions in sequence (left to right)
-    for (const auto &expr : es) {       // exprs: list of Expr stored in Begin
-        last_val = expr.get()->eval(e); // Overwrite with result of current expression
+    // Evaluate all but the last expression in sequence (left to right)
+    for (size_t i = 0; i + 1 < es.size(); ++i) {
+        es[i]->eval(e);
     }
 
-    // Return the result of the last expression
-    return last_val;
+    // The last expression is in tail position
+    return es.back()->evalTail(e, tail);
 }
 
-Value Quote::eval(Assoc &e) {
-    // TODO: To complete the quote logic
-    // Helper function: Recursively convert SyntaxBase to Value WITHOUT evaluation
-    // Ensures the original structure of quoted syntax is preserved (core of 'quote' semantics)
-    auto syntaxToValue = [](SyntaxBase *sb, auto &self) -> Value {
-        if (!sb) {
-            throw RuntimeError("quote: invalid syntax structure (null pointer)");
-        }
+// Pairs built from quoted data belong to a shared constant
+static Value literalPair(const Value &car, const Value &cdr) {
+    Value pair = PairV(car, cdr);
+    static_cast<Pair *>(pair.get())->literal = true;
+    return pair;
+}
 
-        // 1. Handle Symbol syntax (e.g., 'scheme → SymbolV("scheme"))
-        if (auto sym_syntax = dynamic_cast<SymbolSyntax *>(sb)) {
-            return SymbolV(sym_syntax->s);
-        }
+// Recursively convert SyntaxBase to Value WITHOUT evaluation
+// Ensures the original structure of quoted syntax is preserved (core of 'quote' semantics)
+Value syntaxToValue(SyntaxBase *sb) {
+    if (!sb) {
+        throw RuntimeError("quote: invalid syntax structure (null pointer)");
+    }
 
-        // 2. Handle Integer syntax (e.g., '5 → IntegerV(5))
-        if (auto num_syntax = dynamic_cast<Number *>(sb)) {
-            return IntegerV(num_syntax->n);
-        }
+    // 1. Handle Symbol syntax (e.g., 'scheme → SymbolV("scheme"))
+    if (auto sym_syntax = dynamic_cast<SymbolSyntax *>(sb)) {
+        return SymbolV(sym_syntax->s);
+    }
 
-        // 3. Handle Rational number syntax (e.g., '3/4 → RationalV(3,4))
-        if (auto rat_syntax = dynamic_cast<RationalSyntax *>(sb)) {
-            return RationalV(rat_syntax->numerator, rat_syntax->denominator);
-        }
+    // 2. Handle Integer syntax (e.g., '5 → IntegerV(5))
+    if (auto num_syntax = dynamic_cast<Number *>(sb)) {
+        return IntegerV(num_syntax->n);
+    }
 
-        // 4. Handle Boolean #t syntax (e.g., '#t → BooleanV(true))
-        if (dynamic_cast<TrueSyntax *>(sb)) {
-            return BooleanV(true);
-        }
+    // 3. Handle Rational number syntax (e.g., '3/4 → RationalV(3,4))
+    if (auto rat_syntax = dynamic_cast<RationalSyntax *>(sb)) {
+        return RationalV(rat_syntax->numerator, rat_syntax->denominator);
+    }
 
-        // 5. Handle Boolean #f syntax (e.g., '#f → BooleanV(false))
-        if (dynamic_cast<FalseSyntax *>(sb)) {
-            return BooleanV(false);
+    // 3b. Integers and ratios beyond the int range keep their text
+    if (auto big_syntax = dynamic_cast<BignumSyntax *>(sb)) {
+        const char *slash = static_cast<const char *>(memchr(big_syntax->s, '/', big_syntax->len));
+        if (slash == nullptr) {
+            return parseInteger(big_syntax->s, big_syntax->len);
         }
+        size_t num_len = slash - big_syntax->s;
+        return numDiv(parseInteger(big_syntax->s, num_len),
+                      parseInteger(slash + 1, big_syntax->len - num_len - 1));
+    }
 
-        // 6. Handle String syntax (e.g., '"hello" → StringV("hello"))
-        if (auto str_syntax = dynamic_cast<StringSyntax *>(sb)) {
-            return StringV(str_syntax->s);
-        }
+    // 3c. Decimal and exponent literals
+    if (auto flo_syntax = dynamic_cast<FlonumSyntax *>(sb)) {
+        return FlonumV(flo_syntax->d);
+    }
 
-        // 7. Handle List/Pair syntax (core logic for nested structures)
-        if (auto list_syntax = dynamic_cast<List *>(sb)) {
-            const auto &stxs = list_syntax->stxs;
-            size_t dot_pos = stxs.size(); // Track position of '.' (init: no dot)
-
-            // 7.1 Check for presence of '.' (dot) and validate dot rules
-            for (size_t i = 0; i < stxs.size(); ++i) {
-                auto elem_sb = stxs[i].get();
-                if (auto sym = dynamic_cast<SymbolSyntax *>(elem_sb)) {
-                    if (sym->s == ".") {
-                        if (dot_pos != stxs.size()) { // Multiple dots found (illegal in Scheme)
-                            throw RuntimeError("quote: invalid list (multiple dots are not allowed)");
-                        }
-                        dot_pos = i; // Record position of the single valid dot
+    // 4. Handle Boolean #t syntax (e.g., '#t → BooleanV(true))
+    if (dynamic_cast<TrueSyntax *>(sb)) {
+        return BooleanV(true);
+    }
+
+    // 5. Handle Boolean #f syntax (e.g., '#f → BooleanV(false))
+    if (dynamic_cast<FalseSyntax *>(sb)) {
+        return BooleanV(false);
+    }
+
+    // 6. Handle String syntax (e.g., '"hello" → StringV("hello"))
+    if (auto str_syntax = dynamic_cast<StringSyntax *>(sb)) {
+        return StringV(std::string(str_syntax->s, str_syntax->len));
+    }
+
+    // 7. Handle List/Pair syntax (core logic for nested structures)
+    if (auto list_syntax = dynamic_cast<List *>(sb)) {
+        const auto &stxs = list_syntax->stxs;
+        size_t dot_pos = stxs.size(); // Track position of '.' (init: no dot)
+
+        // 7.1 Check for presence of '.' (dot) and validate dot rules
+        for (size_t i = 0; i < stxs.size(); ++i) {
+            auto elem_sb = stxs[i].get();
+            if (auto sym = dynamic_cast<SymbolSyntax *>(elem_sb)) {
+                if (sym->s == dot_name) {
+                    if (dot_pos != stxs.size()) { // Multiple dots found (illegal in Scheme)
+                        throw RuntimeError("quote: invalid list (multiple dots are not allowed)");
                     }
+                    dot_pos = i; // Record position of the single valid dot
                 }
             }
+        }
 
-            size_t dot_count = 0;
-            for (auto &elem : stxs) {
-                if (auto sym = dynamic_cast<SymbolSyntax *>(elem.get())) {
-                    if (sym->s == ".")
-                        dot_count++;
-                }
+        size_t dot_count = 0;
+        for (auto &elem : stxs) {
+            if (auto sym = dynamic_cast<SymbolSyntax *>(elem.get())) {
+                if (sym->s == dot_name)
+                    dot_count++;
             }
-            // Reject (a . b . c) or (a .)
-            if (dot_count > 1 || (dot_count == 1 && stxs.size() > 0)) {
-                SymbolSyntax *last_sym = dynamic_cast<SymbolSyntax *>(stxs.back().get());
-                if (last_sym && last_sym->s == ".") {
-                    throw RuntimeError("quote: invalid dotted pair (multiple dots or trailing dot)");
-                }
+        }
+        // Reject (a . b . c) or (a .)
+        if (dot_count > 1 || (dot_count == 1 && stxs.size() > 0)) {
+            SymbolSyntax *last_sym = dynamic_cast<SymbolSyntax *>(stxs.back().get());
+            if (last_sym && last_sym->s == dot_name) {
+                throw RuntimeError("quote: invalid dotted pair (multiple dots or trailing dot)");
             }
+        }
 
-            // 7.2 Handle DOTTED case (improper list, e.g., (1 2 . 3))
-            if (dot_pos != stxs.size()) {
-                // Validate dot position: cannot be at start/end, or followed by >1 element
-                if (dot_pos == 0) {
-                    throw RuntimeError("quote: invalid list (dot cannot be at the start)");
-                }
-                if (dot_pos == stxs.size() - 1) {
-                    throw RuntimeError("quote: invalid list (dot cannot be at the end)");
-                }
-                if (stxs.size() - dot_pos - 1 > 1) {
-                    throw RuntimeError("quote: invalid list (only one element allowed after dot)");
-                }
-
-                // 7.2.1 Build prefix (elements before dot) into a nested Pair chain
-                // For dotted pair (a b . c), we need to create: (Pair a (Pair b c))
-                // Start from the last element before dot and build backwards
-                Value suffix_val = self(stxs[dot_pos + 1].get(), self);
+        // 7.2 Handle DOTTED case (improper list, e.g., (1 2 . 3))
+        if (dot_pos != stxs.size()) {
+            // Validate dot position: cannot be at start/end, or followed by >1 element
+            if (dot_pos == 0) {
+                throw RuntimeError("quote: invalid list (dot cannot be at the start)");
+            }
+            if (dot_pos == stxs.size() - 1) {
+                throw RuntimeError("quote: invalid list (dot cannot be at the end)");
+            }
+            if (stxs.size() - dot_pos - 1 > 1) {
+                throw RuntimeError("quote: invalid list (only one element allowed after dot)");
+            }
 
-                // Build the chain from right to left
-                Value current = suffix_val;
-                for (int i = dot_pos - 1; i >= 0; --i) {
-                    Value car_val = self(stxs[i].get(), self);
-                    current = PairV(car_val, current);
-                }
+            // 7.2.1 Build prefix (elements before dot) into a nested Pair chain
+            // For dotted pair (a b . c), we need to create: (Pair a (Pair b c))
+            // Start from the last element before dot and build backwards
+            Value suffix_val = syntaxToValue(stxs[dot_pos + 1].get());
 
-                return current;
+            // Build the chain from right to left
+            Value current = suffix_val;
+            for (int i = dot_pos - 1; i >= 0; --i) {
+                Value car_val = syntaxToValue(stxs[i].get());
+                current = literalPair(car_val, current);
             }
 
-            // 7.3 Handle NON-DOTTED case (proper list, e.g., (1 2 3) or ())
-            if (stxs.empty()) { // Empty list → NullV (Scheme's '()')
-                return NullV();
-            }
+            return current;
+        }
 
-            // Build list from RIGHT to LEFT (more efficient for nested PairV)
-            // Ends with NullV to form a proper Scheme list
-            Value list_val = NullV();
-            for (auto it = stxs.rbegin(); it != stxs.rend(); ++it) {
-                list_val = PairV(self(it->get(), self), list_val);
-            }
+        // 7.3 Handle NON-DOTTED case (proper list, e.g., (1 2 3) or ())
+        if (stxs.empty()) { // Empty list → NullV (Scheme's '()')
+            return NullV();
+        }
 
-            return list_val;
+        // Build list from RIGHT to LEFT (more efficient for nested PairV)
+        // Ends with NullV to form a proper Scheme list
+        Value list_val = NullV();
+        for (auto it = stxs.rbegin(); it != stxs.rend(); ++it) {
+            list_val = literalPair(syntaxToValue(it->get()), list_val);
         }
 
-        // Unsupported syntax type (should not reach here with valid parser)
-        throw RuntimeError("quote: unsupported syntax type (check parser output)");
-    };
+        return list_val;
+    }
 
-    // Convert the quoted Syntax (this->s) to Value and return
-    return syntaxToValue(s.get(), syntaxToValue);
+    // Unsupported syntax type (should not reach here with valid parser)
+    throw RuntimeError("quote: unsupported syntax type (check parser output)");
 }
 
-Value AndVar::eval(Assoc &e) { // and with short-circuit evaluation
+Value Quote::eval(Env &) {
+    // TODO: To complete the quote logic
+    // The constant was built when the node was created; only a malformed
+    // datum gets here without one
+    if (value) {
+        return *value;
+    }
+    throw RuntimeError(error);
+}
+
+Value AndVar::eval(Env &e) { // and with short-circuit evaluation
+    TailCall tail;
+    return trampoline(evalTail(e, tail), tail);
+}
+
+Value AndVar::evalTail(Env &e, TailCall &tail) {
     // TODO: To complete the and logic
     if (rands.empty()) {
         return BooleanV(true);
     }
 
-    // Evaluate AND with short-circuit: returns #f on first #f, else last value
-    Value last_result = NullV();
-    for (const auto &expr : rands) {
-        Value res = expr.get()->eval(e); // Evaluate current expression (Expr -> ExprBase* -> eval)
+    // Evaluate AND with short-circuit: returns #f on first #f
+    for (size_t i = 0; i + 1 < rands.size(); ++i) {
+        Value res = rands[i]->eval(e);
         // Short-circuit: return #f if current value is #f
-        if (res->v_type == V_BOOL && !dynamic_cast<Boolean *>(res.get())->b) {
+        if (res.v_type == V_BOOL && !res.b) {
             return BooleanV(false);
         }
-        last_result = res; // Store the last evaluated value
     }
 
-    // All arguments are not #f; return the last one's value
-    return last_result;
+    // All earlier arguments are not #f; the last one's value is the result
+    return rands.back()->evalTail(e, tail);
+}
+
+Value OrVar::eval(Env &e) { // or with short-circuit evaluation
+    TailCall tail;
+    return trampoline(evalTail(e, tail), tail);
 }
 
-Value OrVar::eval(Assoc &e) { // or with short-circuit evaluation
+Value OrVar::evalTail(Env &e, TailCall &tail) {
     // TODO: To complete the or logic
     if (rands.empty()) {
         return BooleanV(false);
     }
 
-    // Evaluate OR with short-circuit: returns first non-#f, else #f
-    for (const auto &expr : rands) {
-        Value res = expr.get()->eval(e); // Evaluate current expression (Expr -> ExprBase* -> eval)
+    // Evaluate OR with short-circuit: returns first non-#f
+    for (size_t i = 0; i + 1 < rands.size(); ++i) {
+        Value res = rands[i]->eval(e);
         // Short-circuit: return current value if it's not #f
-        if (!(res->v_type == V_BOOL && !dynamic_cast<Boolean *>(res.get())->b)) {
+        if (!(res.v_type == V_BOOL && !res.b)) {
             return res; // Return the actual value, not converted to boolean
         }
     }
 
-    // All arguments are #f; return #f
-    return BooleanV(false);
+    // All earlier arguments are #f; the last one's value is the result
+    return rands.back()->evalTail(e, tail);
 }
 
 Value Not::evalRator(const Value &rand) { // not
     // TODO: To complete the not logic
-    if (rand->v_type == V_BOOL) {
+    if (rand.v_type == V_BOOL) {
         // If input is Boolean, return its negation
-        bool is_false = !dynamic_cast<Boolean *>(rand.get())->b;
+        bool is_false = !rand.b;
         return BooleanV(is_false);
     } else {
         // If input is non-Boolean (e.g., int, symbol), it's "true" → NOT returns #f
@@ -973,29 +1177,39 @@ Value Not::evalRator(const Value &rand) { // not
     }
 }
 
-Value If::eval(Assoc &e) {
+Value If::eval(Env &e) {
+    TailCall tail;
+    return trampoline(evalTail(e, tail), tail);
+}
+
+Value If::evalTail(Env &e, TailCall &tail) {
     // TODO: To complete the if logic
     // Evaluate the condition expression first
     Value cond_val = cond.get()->eval(e); // Convert condition Expr to Value
 
     // In Scheme, "true" means any value except #f
-    bool is_true = !(cond_val->v_type == V_BOOL && !dynamic_cast<Boolean *>(cond_val.get())->b);
+    bool is_true = !(cond_val.v_type == V_BOOL && !cond_val.b);
 
     // Short-circuit evaluation: only execute the selected branch
     if (is_true) {
-        // Condition is true → evaluate consequence branch
-        return conseq.get()->eval(e);
+        // Condition is true → evaluate consequence branch (tail position)
+        return conseq->evalTail(e, tail);
     } else {
         // Condition is false → evaluate alternative branch (or return #f if none)
         if (alter.get() != nullptr) {
-            return alter.get()->eval(e);
+            return alter->evalTail(e, tail);
         } else {
             return BooleanV(false);
         }
     }
 }
 
-Value Cond::eval(Assoc &env) {
+Value Cond::eval(Env &env) {
+    TailCall tail;
+    return trampoline(evalTail(env, tail), tail);
+}
+
+Value Cond::evalTail(Env &env, TailCall &tail) {
     // TODO: To complete the cond logic
     for (const auto &clause : clauses) { // Iterate over `clauses` member (expr.hpp)
         if (clause.empty()) {
@@ -1007,193 +1221,392 @@ Value Cond::eval(Assoc &env) {
 
         // Check if it's a Var (already parsed symbol) with name "else"
         Var *else_var = dynamic_cast<Var *>(clause[0].get());
-        if (else_var && else_var->x == "else") {
+        if (else_var && else_var->x == else_name) {
             is_else_clause = true;
         }
 
         // For else clause, skip condition evaluation and always execute
         if (is_else_clause) {
-            // Evaluate remaining expressions in the clause; return the last one
-            Value last_val = VoidV();
-            for (size_t i = 1; i < clause.size(); ++i) {
-                last_val = clause[i]->eval(env);
-            }
             // If clause has only 'else' (no body), return #t (Scheme standard)
-            return (clause.size() == 1) ? BooleanV(true) : last_val;
+            if (clause.size() == 1) {
+                return BooleanV(true);
+            }
+            // Evaluate remaining expressions in the clause; the last one is in tail position
+            for (size_t i = 1; i + 1 < clause.size(); ++i) {
+                clause[i]->eval(env);
+            }
+            return clause.back()->evalTail(env, tail);
         }
 
         // For normal clauses, evaluate the condition
         Value cond_val = clause[0]->eval(env);
         // Scheme rule: non-#f values are true
-        bool is_true = !(cond_val->v_type == V_BOOL && !dynamic_cast<Boolean *>(cond_val.get())->b);
+        bool is_true = !(cond_val.v_type == V_BOOL && !cond_val.b);
 
         if (is_true) {
-            // Evaluate remaining expressions in the clause; return the last one
-            Value last_val = VoidV();
-            for (size_t i = 1; i < clause.size(); ++i) {
-                last_val = clause[i]->eval(env);
-            }
             // If clause has only a condition (no body), return the condition's value
-            return (clause.size() == 1) ? cond_val : last_val;
+            if (clause.size() == 1) {
+                return cond_val;
+            }
+            // Evaluate remaining expressions in the clause; the last one is in tail position
+            for (size_t i = 1; i + 1 < clause.size(); ++i) {
+                clause[i]->eval(env);
+            }
+            return clause.back()->evalTail(env, tail);
         }
     }
     // No true clauses: return #f (Scheme standard)
     return BooleanV(false);
 }
 
-Value Lambda::eval(Assoc &env) {
+Value Lambda::eval(Env &env) {
     // TODO: To complete the lambda logic
-    // Return ProcedureV (closure) with parameters, body, and current lexical environment
-    return ProcedureV(x, e, env);
+    // Return ProcedureV (closure) over the shared template, with the values of its free variables
+    Value closure = ProcedureV(tmpl);
+    Value *captured = static_cast<Procedure *>(closure.get())->captured;
+    for (size_t i = 0; i < free.size(); ++i) {
+        const FreeVar &v = free[i];
+        if (v.kind == VK_FREE) {
+            captured[i] = capturedSlot(env, v.index); // already boxed if it needs to be
+            continue;
+        }
+        Value &slot = frameSlot(env, v.depth, v.index);
+        if (v.boxed && slot.v_type != V_BOX)
+            slot = BoxV(slot);
+        captured[i] = slot;
+    }
+    return closure;
+}
+
+Value Apply::eval(Env &e) {
+    TailCall tail;
+    return trampoline(evalTail(e, tail), tail);
 }
 
-Value Apply::eval(Assoc &e) {
-    // Step 1: Evaluate rator to get procedure (closure)
-    Value proc_val = rator->eval(e);
-    if (proc_val->v_type != V_PROC) {
+Value Apply::evalTail(Env &e, TailCall &tail) {
+    // Step 1: Evaluate rator to get procedure (closure); a procedure in a
+    // linked global cell is taken as is, anything else goes through Var::eval
+    Value proc_val = (cell != nullptr && isProcedure(*cell)) ? *cell : rator->eval(e);
+    if (proc_val.v_type == V_PRIMITIVE) {
+        // Built-ins run on the spot and never leave a call for the trampoline
+        Primitive *prim = static_cast<Primitive *>(proc_val.get());
+        ProfileScope profile(prim->name);
+        return withOperands(rand, e, [prim](const ValueSpan &args) { return callPrimitive(prim, args); });
+    }
+    if (proc_val.v_type != V_PROC) {
         throw RuntimeError("Attempt to apply a non-procedure");
     }
-
-    // TODO: TO COMPLETE THE CLOSURE LOGIC
-    Procedure *clos_ptr = dynamic_cast<Procedure *>(proc_val.get());
+    bool fits = false;
+    if (cell != nullptr) {
+        fits = linked && linked->ptr == proc_val.heap();
+        Procedure *proc = static_cast<Procedure *>(proc_val.get());
+        if (!fits && proc->tmpl->arity == (int)rand.size()) {
+            linked.reset(new Value(proc_val)); // relink after a redefinition
+            fits = true;
+        }
+    }
 
     // TODO: TO COMPLETE THE ARGUMENT PARSER LOGIC
     // Step 2: Evaluate all arguments (expr.hpp uses "rand" as member name, not "rands")
     std::vector<Value> args;
+    args.reserve(rand.size());
     for (const auto &arg_expr : rand) { // Traverse "rand" (vector<Expr>), not "rands"
         args.push_back(arg_expr.get()->eval(e));
     }
 
-    // Step 3: Check argument count match (closure's parameters vs evaluated args)
-    // For variadic functions like + and *, we need special handling
-    if (args.size() != clos_ptr->parameters.size()) {
-        // Check if this is a variadic function (single parameter name ending with "...")
-        if (clos_ptr->parameters.size() == 1 &&
-            clos_ptr->parameters[0].size() >= 3 &&
-            clos_ptr->parameters[0].substr(clos_ptr->parameters[0].size() - 3) == "...") {
-            // Variadic function - accept any number of arguments
-        } else {
-            throw RuntimeError("Wrong number of arguments: expected " +
-                               std::to_string(clos_ptr->parameters.size()) + ", got " +
-                               std::to_string(args.size()));
-        }
+    // Step 3: Hand the call back to the enclosing trampoline instead of recursing
+    tail.proc = proc_val;
+    tail.args = std::move(args);
+    tail.pending = true;
+    tail.fits = fits;
+    return Value(nullptr);
+}
+
+// Open the frame for a call to clos_ptr with args bound to its parameters
+Env bindArguments(Procedure *clos_ptr, std::vector<Value> &args) {
+    // Check argument count match (closure's parameters vs evaluated args)
+    int arity = clos_ptr->tmpl->arity;
+    bool is_variadic = arity < 0;
+    if (!is_variadic && (int)args.size() != arity) {
+        throw RuntimeError("Wrong number of arguments: expected " +
+                           std::to_string(arity) + ", got " +
+                           std::to_string(args.size()));
     }
 
     // TODO: TO COMPLETE THE PARAMETERS' ENVIRONMENT LOGIC
-    // Step 4: Extend closure's environment with parameter bindings
-    Assoc param_env = clos_ptr->env;
-
-    // Check if this is a variadic function
-    bool is_variadic = (clos_ptr->parameters.size() == 1 &&
-                        clos_ptr->parameters[0].size() >= 3 &&
-                        clos_ptr->parameters[0].substr(clos_ptr->parameters[0].size() - 3) == "...");
+    // Open a frame for the call; parameters occupy the first slots
+    Env param_env = callFrame(clos_ptr);
 
     if (is_variadic) {
-        // For variadic functions, we need to handle them specially
-        // Check if this is a built-in variadic function like +, -, *, /
-        Procedure *proc = dynamic_cast<Procedure *>(proc_val.get());
-        if (proc && proc->e->e_type == E_PLUS) {
-            // For + function, directly call PlusVar with the arguments
-            return PlusVar(std::vector<Expr>()).evalRator(args);
-        } else if (proc && proc->e->e_type == E_MUL) {
-            // For * function, directly call MultVar with the arguments
-            return MultVar(std::vector<Expr>()).evalRator(args);
-        } else if (proc && proc->e->e_type == E_MINUS) {
-            // For - function, directly call MinusVar with the arguments
-            return MinusVar(std::vector<Expr>()).evalRator(args);
-        } else if (proc && proc->e->e_type == E_DIV) {
-            // For / function, directly call DivVar with the arguments
-            return DivVar(std::vector<Expr>()).evalRator(args);
-        } else {
-            // For other variadic functions, use the original list approach
-            std::string param_name = clos_ptr->parameters[0].substr(0, clos_ptr->parameters[0].size() - 3);
-            Value arg_list = NullV();
-            for (auto it = args.rbegin(); it != args.rend(); ++it) {
-                arg_list = PairV(*it, arg_list);
-            }
-            param_env = extend(param_name, arg_list, param_env);
+        // Bind the argument list to the single parameter
+        Value arg_list = NullV();
+        for (auto it = args.rbegin(); it != args.rend(); ++it) {
+            arg_list = PairV(*it, arg_list);
         }
+        param_env->slots[0] = arg_list;
     } else {
-        // For normal functions, bind each argument to its corresponding parameter
+        // For normal functions, bind each argument to its corresponding slot
+        for (size_t i = 0; i < args.size(); ++i) {
+            param_env->slots[i] = args[i];
+        }
+    }
+    return param_env;
+}
+
+// Bind the pending call's arguments in a fresh frame and run the body; a call
+// in the body's tail position is left in `tail` for the trampoline to pick up
+static Value applyProcedure(TailCall &tail) {
+    Value proc_val = std::move(tail.proc);
+    std::vector<Value> args = std::move(tail.args);
+    tail.proc = Value(nullptr);
+    tail.args.clear();
+    tail.pending = false;
+    bool fits = tail.fits;
+    tail.fits = false;
+    gcSafepoint(); // everything live is held by a counted handle here
+
+    // TODO: TO COMPLETE THE CLOSURE LOGIC
+    Procedure *clos_ptr = static_cast<Procedure *>(proc_val.get());
+    ProfileScope profile(clos_ptr->tmpl->name);
+    Env param_env(nullptr);
+    if (fits) {
+        // Arity was checked when the call site linked to this procedure
+        param_env = callFrame(clos_ptr);
         for (size_t i = 0; i < args.size(); ++i) {
-            const std::string &param = clos_ptr->parameters[i];
-            param_env = extend(param, args[i], param_env);
+            param_env->slots[i] = std::move(args[i]);
         }
+    } else {
+        param_env = bindArguments(clos_ptr, args);
     }
 
-    // Step 5: Evaluate procedure body (support multiple expressions via Begin)
-    return clos_ptr->e.get()->eval(param_env);
+    // Evaluate procedure body (support multiple expressions via Begin)
+    return clos_ptr->tmpl->e->evalTail(param_env, tail);
 }
 
-Value Define::eval(Assoc &env) {
+Value Define::eval(Env &env) {
     // TODO: To complete the define logic
-    Assoc rec_env = env;
-    insert(var, Value(nullptr), rec_env);
-    modify(var, e->eval(rec_env), rec_env);
-    env = rec_env;
+    // The slot was allocated by resolve, so a recursive body already refers to it
+    Value val = e->eval(env);
+    if (kind == VK_GLOBAL) {
+        globalValue(index) = val;
+    } else {
+        unbox(env->slots[index]) = val;
+    }
     return VoidV();
 }
 
-Value Let::eval(Assoc &env) {
+Value Let::eval(Env &env) {
+    TailCall tail;
+    return trampoline(evalTail(env, tail), tail);
+}
+
+Value Let::evalTail(Env &env, TailCall &tail) {
     // TODO: To complete the let logic
     // 1. Evaluate all bindings in the original environment (non-recursive)
-    std::vector<std::pair<std::string, Value>> evaluated_bindings;
-    for (const auto &bind_pair : bind) {          // Iterate over `bind` member (expr.hpp)
-        const std::string &var = bind_pair.first; // Variable name
-        const Expr &expr = bind_pair.second;      // Bound expression (Expr type per expr.hpp)
-        Value val = expr->eval(env);              // Evaluate in outer environment
-        evaluated_bindings.emplace_back(var, val);
-    }
-    // 2. Extend the environment with evaluated bindings
-    Assoc let_env = env;
-    for (const auto &[var, val] : evaluated_bindings) {
-        let_env = extend(var, val, let_env);
+    Env let_env = extendFrame(frame_size, env);
+    for (size_t i = 0; i < bind.size(); ++i) {
+        let_env->slots[i] = bind[i].second->eval(env); // Evaluate in outer environment
     }
-    // 3. Evaluate `body` member (single Expr) in the extended environment
-    return body->eval(let_env); // Use `body` member (expr.hpp)
+    // 2. Evaluate `body` member (single Expr) in the extended environment, in tail position
+    return body->evalTail(let_env, tail);
 }
 
-Value Letrec::eval(Assoc &env) {
+Value Letrec::eval(Env &env) {
+    TailCall tail;
+    return trampoline(evalTail(env, tail), tail);
+}
+
+Value Letrec::evalTail(Env &env, TailCall &tail) {
     // TODO: To complete the letrec logic
-    // 1. Create placeholder bindings (VoidV) in a new environment
-    Assoc letrec_env = env;
-    for (const auto &bind_pair : bind) { // Iterate over `bind` member (expr.hpp)
-        const std::string &var = bind_pair.first;
-        letrec_env = extend(var, VoidV(), letrec_env); // Placeholder for recursion
+    // 1. Create placeholder bindings (VoidV) in a new frame
+    Env letrec_env = extendFrame(frame_size, env);
+    for (size_t i = 0; i < bind.size(); ++i) {
+        letrec_env->slots[i] = VoidV(); // Placeholder for recursion
     }
     // 2. Evaluate expressions in the new environment (allow recursive references)
-    for (const auto &bind_pair : bind) {
-        const std::string &var = bind_pair.first;
-        const Expr &expr = bind_pair.second; // Bound expression (Expr type per expr.hpp)
-        Value val = expr->eval(letrec_env);  // Can reference other letrec variables
-        modify(var, val, letrec_env);        // Replace placeholder with real value
+    for (size_t i = 0; i < bind.size(); ++i) {
+        Value val = bind[i].second->eval(letrec_env);
+        unbox(letrec_env->slots[i]) = val; // Replace placeholder (a closure may have boxed it)
     }
-    // 3. Evaluate `body` member in the updated environment
-    return body->eval(letrec_env); // Use `body` member (expr.hpp)
+    // 3. Evaluate `body` member in the updated environment, in tail position
+    return body->evalTail(letrec_env, tail);
 }
 
-Value Set::eval(Assoc &env) {
+// Storage of the variable a set! assigns
+static Value &setTarget(Set *set, Env &env) {
+    switch (set->kind) {
+    case VK_GLOBAL:
+        return globalValue(set->index);
+    case VK_FREE:
+        return unbox(capturedSlot(env, set->index));
+    default:
+        return unbox(frameSlot(env, set->depth, set->index));
+    }
+}
+
+Value Set::eval(Env &env) {
     // TODO: To complete the set logic
-    // 1. Check if `var` (member) exists in the environment
-    Value existing = find(var, env); // Use `var` member (expr.hpp)
-    if (existing.get() == nullptr) {
-        throw RuntimeError("set!: undefined variable '" + var + "'");
-    }
-    // 2. Evaluate `e` member (new value)
-    Value new_val = e->eval(env); // Use `e` member (expr.hpp: Expr type)
-    // 3. Modify the existing binding in the environment
-    modify(var, new_val, env);
+    // 1. Check if `var` (member) is bound
+    if (setTarget(this, env).v_type == V_UNBOUND) {
+        throw RuntimeError("set!: undefined variable '" + var.str() + "'");
+    }
+    // 2. Evaluate `e` member (new value) and store it in place
+    Value new_val = e->eval(env);
+    setTarget(this, env) = new_val;
     // Scheme standard: set! returns void
     return VoidV();
 }
 
 Value Display::evalRator(const Value &rand) { // display function
-    if (rand->v_type == V_STRING) {
-        String *str_ptr = dynamic_cast<String *>(rand.get());
+    if (rand.v_type == V_STRING) {
+        String *str_ptr = static_cast<String *>(rand.get());
         std::cout << str_ptr->s;
     } else {
-        rand->show(std::cout);
+        rand.show(std::cout);
+    }
+
+    return VoidV();
+}
+
+// ============================================================================
+// Primitives as procedures
+// ============================================================================
+
+// The node classes double as the implementation of the native procedures:
+// their evalRator does not look at the operand expressions, so one instance
+// built without any serves every call.
+
+template <class Node>
+static Value nativeUnary(const ValueSpan &args) {
+    static Node node{Expr(nullptr)};
+    return node.evalRator(args[0]);
+}
+
+template <class Node>
+static Value nativeBinary(const ValueSpan &args) {
+    static Node node{Expr(nullptr), Expr(nullptr)};
+    return node.evalRator(args[0], args[1]);
+}
+
+template <class Node>
+static Value nativeVariadic(const ValueSpan &args) {
+    static Node node{std::vector<Expr>()};
+    return node.evalRator(args);
+}
+
+// and/or as procedures see values, not expressions: nothing to short-circuit
+static Value nativeAnd(const ValueSpan &args) {
+    Value result = BooleanV(true);
+    for (const Value &v : args) {
+        if (v.v_type == V_BOOL && !v.b) {
+            return BooleanV(false);
+        }
+        result = v;
+    }
+    return result;
+}
+
+static Value nativeOr(const ValueSpan &args) {
+    for (const Value &v : args) {
+        if (!(v.v_type == V_BOOL && !v.b)) {
+            return v;
+        }
     }
+    return BooleanV(false);
+}
 
+static Value nativeAtan(const ValueSpan &args) {
+    return args.size() == 1 ? nativeUnary<Atan>(args) : nativeBinary<Atan2>(args);
+}
+
+static Value nativeVoid(const ValueSpan &) {
     return VoidV();
 }
+
+static Value nativeExit(const ValueSpan &) {
+    return TerminateV();
+}
+
+/**
+ * @brief Native implementation and accepted argument counts of a primitive
+ */
+struct NativeDef {
+    ExprType type;
+    int min_args;
+    int max_args; ///< -1 for no upper bound
+    NativeFn fn;
+};
+
+static const NativeDef native_defs[] = {
+    {E_PLUS, 0, -1, nativeVariadic<PlusVar>},
+    {E_MINUS, 1, -1, nativeVariadic<MinusVar>},
+    {E_MUL, 0, -1, nativeVariadic<MultVar>},
+    {E_DIV, 1, -1, nativeVariadic<DivVar>},
+    {E_MODULO, 2, 2, nativeBinary<Modulo>},
+    {E_EXPT, 2, 2, nativeBinary<Expt>},
+    {E_EXACT_TO_INEXACT, 1, 1, nativeUnary<ExactToInexact>},
+    {E_INEXACT_TO_EXACT, 1, 1, nativeUnary<InexactToExact>},
+    {E_SQRT, 1, 1, nativeUnary<Sqrt>},
+    {E_EXP, 1, 1, nativeUnary<Exp>},
+    {E_LOG, 1, 1, nativeUnary<Log>},
+    {E_SIN, 1, 1, nativeUnary<Sin>},
+    {E_COS, 1, 1, nativeUnary<Cos>},
+    {E_TAN, 1, 1, nativeUnary<Tan>},
+    {E_ASIN, 1, 1, nativeUnary<Asin>},
+    {E_ACOS, 1, 1, nativeUnary<Acos>},
+    {E_ATAN, 1, 2, nativeAtan},
+    {E_LT, 0, -1, nativeVariadic<LessVar>},
+    {E_LE, 0, -1, nativeVariadic<LessEqVar>},
+    {E_EQ, 0, -1, nativeVariadic<EqualVar>},
+    {E_GE, 0, -1, nativeVariadic<GreaterEqVar>},
+    {E_GT, 0, -1, nativeVariadic<GreaterVar>},
+    {E_CONS, 2, 2, nativeBinary<Cons>},
+    {E_CAR, 1, 1, nativeUnary<Car>},
+    {E_CDR, 1, 1, nativeUnary<Cdr>},
+    {E_LIST, 0, -1, nativeVariadic<ListFunc>},
+    {E_SETCAR, 2, 2, nativeBinary<SetCar>},
+    {E_SETCDR, 2, 2, nativeBinary<SetCdr>},
+    {E_NOT, 1, 1, nativeUnary<Not>},
+    {E_AND, 0, -1, nativeAnd},
+    {E_OR, 0, -1, nativeOr},
+    {E_EQQ, 2, 2, nativeBinary<IsEq>},
+    {E_BOOLQ, 1, 1, nativeUnary<IsBoolean>},
+    {E_INTQ, 1, 1, nativeUnary<IsFixnum>},
+    {E_NULLQ, 1, 1, nativeUnary<IsNull>},
+    {E_PAIRQ, 1, 1, nativeUnary<IsPair>},
+    {E_PROCQ, 1, 1, nativeUnary<IsProcedure>},
+    {E_SYMBOLQ, 1, 1, nativeUnary<IsSymbol>},
+    {E_LISTQ, 1, 1, nativeUnary<IsList>},
+    {E_STRINGQ, 1, 1, nativeUnary<IsString>},
+    {E_DISPLAY, 1, 1, nativeUnary<Display>},
+    {E_VOID, 0, 0, nativeVoid},
+    {E_EXIT, 0, 0, nativeExit},
+};
+
+Value primitiveProcedure(const Name &x) {
+    // Built on first use and kept for the whole run, so eq? holds between
+    // two references to the same primitive
+    static std::vector<Value> &by_type = *[] {
+        std::vector<Value> *v = new std::vector<Value>(E_DISPLAY + 1, Value(nullptr));
+        for (const NativeDef &def : native_defs) {
+            const char *name = "";
+            for (size_t i = 0; i < primitive_count; ++i) {
+                if (primitive_names[i].type == def.type)
+                    name = primitive_names[i].name;
+            }
+            (*v)[def.type] = Value(new Primitive(def.fn, def.min_args, def.max_args, Name(name)));
+        }
+        return v;
+    }();
+    return by_type[x->primitive];
+}
+
+Value callPrimitive(Primitive *prim, const ValueSpan &args) {
+    int argc = (int)args.size();
+    if (argc < prim->min_args || (prim->max_args >= 0 && argc > prim->max_args)) {
+        throw RuntimeError("Wrong number of arguments: expected " +
+                           std::string(prim->min_args == prim->max_args ? "" : "at least ") +
+                           std::to_string(prim->min_args) + ", got " + std::to_string(argc));
+    }
+    return prim->fn(args);
+}
@@ -1,5 +1,7 @@
 #include "Def.hpp"
+#include "RE.hpp"
 #include "expr.hpp"
+#include "value.hpp"
 #include <cstring>
 #include <cstdlib>
 #include <vector>
@@ -17,6 +19,10 @@ int gcd(int a, int b) {
     return a;
 }
 
+SlotUse::SlotUse() : assigned(false), captured(false) {}
+
+Scope::Scope(Scope *parent, Lambda *lambda) : parent(parent), lambda(lambda) {}
+
 ExprBase::ExprBase(ExprType et) : e_type(et) {}
 
 Expr::Expr(ExprBase * eb) : ptr(eb) {}
@@ -39,9 +45,14 @@ RationalNum::RationalNum(int num, int den) : ExprBase(E_RATIONAL), numerator(num
         numerator = -numerator;
         denominator = -denominator;
     }
+    value.reset(new Value(RationalV(numerator, denominator)));
 }
 
-StringExpr::StringExpr(const std::string &str) : ExprBase(E_STRING), s(str) {}
+RationalNum::~RationalNum() {}
+
+StringExpr::StringExpr(const std::string &str) : ExprBase(E_STRING), s(str), value(new Value(StringV(str))) {}
+
+StringExpr::~StringExpr() {}
 
 True::True() : ExprBase(E_TRUE) {}
 
@@ -65,6 +76,8 @@ Plus::Plus(const Expr &r1, const Expr &r2) : Binary(E_PLUS, r1, r2) {}
 
 Minus::Minus(const Expr &r1, const Expr &r2) : Binary(E_MINUS, r1, r2) {}
 
+Negate::Negate(const Expr &r) : Unary(E_MINUS, r) {}
+
 Mult::Mult(const Expr &r1, const Expr &r2) : Binary(E_MUL, r1, r2) {}
 
 Div::Div(const Expr &r1, const Expr &r2) : Binary(E_DIV, r1, r2) {}
@@ -73,6 +86,30 @@ Modulo::Modulo(const Expr &r1, const Expr &r2) : Binary(E_MODULO, r1, r2) {}
 
 Expt::Expt(const Expr &r1, const Expr &r2) : Binary(E_EXPT, r1, r2) {}
 
+ExactToInexact::ExactToInexact(const Expr &r) : Unary(E_EXACT_TO_INEXACT, r) {}
+
+InexactToExact::InexactToExact(const Expr &r) : Unary(E_INEXACT_TO_EXACT, r) {}
+
+Sqrt::Sqrt(const Expr &r) : Unary(E_SQRT, r) {}
+
+Exp::Exp(const Expr &r) : Unary(E_EXP, r) {}
+
+Log::Log(const Expr &r) : Unary(E_LOG, r) {}
+
+Sin::Sin(const Expr &r) : Unary(E_SIN, r) {}
+
+Cos::Cos(const Expr &r) : Unary(E_COS, r) {}
+
+Tan::Tan(const Expr &r) : Unary(E_TAN, r) {}
+
+Asin::Asin(const Expr &r) : Unary(E_ASIN, r) {}
+
+Acos::Acos(const Expr &r) : Unary(E_ACOS, r) {}
+
+Atan::Atan(const Expr &r) : Unary(E_ATAN, r) {}
+
+Atan2::Atan2(const Expr &r1, const Expr &r2) : Binary(E_ATAN, r1, r2) {}
+
 PlusVar::PlusVar(const std::vector<Expr> &rands) : Variadic(E_PLUS, rands) {}
 
 MinusVar::MinusVar(const std::vector<Expr> &rands) : Variadic(E_MINUS, rands) {}
@@ -129,6 +166,8 @@ OrVar::OrVar(const std::vector<Expr> &rands) : ExprBase(E_OR), rands(rands) {}
 
 IsEq::IsEq(const Expr &r1, const Expr &r2) : Binary(E_EQQ, r1, r2) {}
 
+SameTemplate::SameTemplate(const Expr &r, uint64_t serial) : Unary(E_SAME_TEMPLATE, r), serial(serial) {}
+
 IsBoolean::IsBoolean(const Expr &r1) : Unary(E_BOOLQ, r1) {}
 
 IsFixnum::IsFixnum(const Expr &r1) : Unary(E_INTQ, r1) {}
@@ -149,7 +188,19 @@ IsString::IsString(const Expr &r1) : Unary(E_STRINGQ, r1) {}
 
 Begin::Begin(const vector<Expr> &vec) : ExprBase(E_BEGIN), es(vec) {}
 
-Quote::Quote(const Syntax &t) : ExprBase(E_QUOTE), s(t) {}
+Quote::Quote(const Syntax &t) : ExprBase(E_QUOTE) {
+    // A malformed datum is only an error if the quote is evaluated; the
+    // syntax itself is not kept, as it is freed once parsing is done
+    try {
+        value.reset(new Value(syntaxToValue(t.get())));
+    } catch (const RuntimeError &RE) {
+        error = RE.message();
+    }
+}
+
+Quote::Quote() : ExprBase(E_QUOTE) {}
+
+Quote::~Quote() {}
 
 //CONDITIONAL
 
@@ -159,24 +210,153 @@ Cond::Cond(const std::vector<std::vector<Expr>> &cls) : ExprBase(E_COND), clause
 
 //VARIABLE AND FUNCITON DEFINITION
 
-Var::Var(const string &s) : ExprBase(E_VAR), x(s) {}
+Var::Var(const Name &s) : ExprBase(E_VAR), x(s), kind(VK_UNRESOLVED), depth(0), index(0) {}
+
+Apply::Apply(const Expr &expr, const vector<Expr> &vec) : ExprBase(E_APPLY), rator(expr), rand(vec), cell(nullptr) {}
 
-Apply::Apply(const Expr &expr, const vector<Expr> &vec) : ExprBase(E_APPLY), rator(expr), rand(vec) {}
+Apply::~Apply() {}
 
-Lambda::Lambda(const vector<string> &vec, const Expr &expr) : ExprBase(E_LAMBDA), x(vec), e(expr) {}
+Lambda::Lambda(const vector<Name> &vec, const Expr &expr) : ExprBase(E_LAMBDA), x(vec), e(expr), frame_size((int)vec.size()), name("lambda"), tmpl(nullptr) {}
+
+Lambda::~Lambda() {
+    gcRelease(tmpl);
+}
 
-Define::Define(const string &variable, const Expr &expr) : ExprBase(E_DEFINE), var(variable), e(expr) {}
+Define::Define(const Name &variable, const Expr &expr) : ExprBase(E_DEFINE), var(variable), e(expr), kind(VK_UNRESOLVED), index(0) {}
 
 //BINDING CONSTRUCTS
 
-Let::Let(const vector<pair<string, Expr>> &vec, const Expr &e) : ExprBase(E_LET), bind(vec), body(e) {}
+Let::Let(const vector<pair<Name, Expr>> &vec, const Expr &e) : ExprBase(E_LET), bind(vec), body(e), frame_size((int)vec.size()) {}
 
-Letrec::Letrec(const vector<pair<string, Expr>> &vec, const Expr &expr) : ExprBase(E_LETREC), bind(vec), body(expr) {}
+Letrec::Letrec(const vector<pair<Name, Expr>> &vec, const Expr &expr) : ExprBase(E_LETREC), bind(vec), body(expr), frame_size((int)vec.size()) {}
 
 //ASSIGNMENT
 
-Set::Set(const std::string &var, const Expr &e) : ExprBase(E_SET), var(var), e(e) {}
+Set::Set(const Name &var, const Expr &e) : ExprBase(E_SET), var(var), e(e), kind(VK_UNRESOLVED), depth(0), index(0) {}
 
 //I/O OPERATIONS
 
-Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
\ No newline at end of file
+Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
+
+//PRIMITIVE NODES BY TYPE
+
+Expr makeUnary(ExprType type, const Expr &rand) {
+    switch (type) {
+    case E_MINUS:
+        return Expr(new Negate(rand));
+    case E_CAR:
+        return Expr(new Car(rand));
+    case E_CDR:
+        return Expr(new Cdr(rand));
+    case E_NOT:
+        return Expr(new Not(rand));
+    case E_BOOLQ:
+        return Expr(new IsBoolean(rand));
+    case E_INTQ:
+        return Expr(new IsFixnum(rand));
+    case E_NULLQ:
+        return Expr(new IsNull(rand));
+    case E_PAIRQ:
+        return Expr(new IsPair(rand));
+    case E_PROCQ:
+        return Expr(new IsProcedure(rand));
+    case E_SYMBOLQ:
+        return Expr(new IsSymbol(rand));
+    case E_LISTQ:
+        return Expr(new IsList(rand));
+    case E_STRINGQ:
+        return Expr(new IsString(rand));
+    case E_EXACT_TO_INEXACT:
+        return Expr(new ExactToInexact(rand));
+    case E_INEXACT_TO_EXACT:
+        return Expr(new InexactToExact(rand));
+    case E_SQRT:
+        return Expr(new Sqrt(rand));
+    case E_EXP:
+        return Expr(new Exp(rand));
+    case E_LOG:
+        return Expr(new Log(rand));
+    case E_SIN:
+        return Expr(new Sin(rand));
+    case E_COS:
+        return Expr(new Cos(rand));
+    case E_TAN:
+        return Expr(new Tan(rand));
+    case E_ASIN:
+        return Expr(new Asin(rand));
+    case E_ACOS:
+        return Expr(new Acos(rand));
+    case E_ATAN:
+        return Expr(new Atan(rand));
+    case E_DISPLAY:
+        return Expr(new Display(rand));
+    default:
+        return Expr(nullptr);
+    }
+}
+
+Expr makeBinary(ExprType type, const Expr &rand1, const Expr &rand2) {
+    switch (type) {
+    case E_PLUS:
+        return Expr(new Plus(rand1, rand2));
+    case E_MINUS:
+        return Expr(new Minus(rand1, rand2));
+    case E_MUL:
+        return Expr(new Mult(rand1, rand2));
+    case E_DIV:
+        return Expr(new Div(rand1, rand2));
+    case E_MODULO:
+        return Expr(new Modulo(rand1, rand2));
+    case E_EXPT:
+        return Expr(new Expt(rand1, rand2));
+    case E_ATAN:
+        return Expr(new Atan2(rand1, rand2));
+    case E_LT:
+        return Expr(new Less(rand1, rand2));
+    case E_LE:
+        return Expr(new LessEq(rand1, rand2));
+    case E_EQ:
+        return Expr(new Equal(rand1, rand2));
+    case E_GE:
+        return Expr(new GreaterEq(rand1, rand2));
+    case E_GT:
+        return Expr(new Greater(rand1, rand2));
+    case E_CONS:
+        return Expr(new Cons(rand1, rand2));
+    case E_SETCAR:
+        return Expr(new SetCar(rand1, rand2));
+    case E_SETCDR:
+        return Expr(new SetCdr(rand1, rand2));
+    case E_EQQ:
+        return Expr(new IsEq(rand1, rand2));
+    default:
+        return Expr(nullptr);
+    }
+}
+
+Expr makeVariadic(ExprType type, const vector<Expr> &rands) {
+    switch (type) {
+    case E_PLUS:
+        return Expr(new PlusVar(rands));
+    case E_MINUS:
+        return Expr(new MinusVar(rands));
+    case E_MUL:
+        return Expr(new MultVar(rands));
+    case E_DIV:
+        return Expr(new DivVar(rands));
+    case E_LT:
+        return Expr(new LessVar(rands));
+    case E_LE:
+        return Expr(new LessEqVar(rands));
+    case E_EQ:
+        return Expr(new EqualVar(rands));
+    case E_GE:
+        return Expr(new GreaterEqVar(rands));
+    case E_GT:
+        return Expr(new GreaterVar(rands));
+    case E_LIST:
+        return Expr(new ListFunc(rands));
+    default:
+        return Expr(nullptr);
+    }
+}
@@ -7,7 +7,7 @@ public:
     int numerator;
     int denominator;
     RationalNum(int num, int den);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };p
  * @brief Expression structures for the Scheme interpreter
  * @author luke36
@@ -23,10 +23,68 @@ public:
 #include <memory>
 #include <vector>
 
+struct Lambda;
+struct LambdaTemplate;
+
+/**
+ * @brief How the resolve pass has seen one frame slot used
+ */
+struct SlotUse {
+    bool assigned; ///< Target of set!, define or letrec: may change after a closure copies it
+    bool captured; ///< Free in some lambda nested in the slot's scope
+    std::vector<std::pair<Lambda *, int>> captures; ///< Lambda::free entries copying the slot
+    SlotUse();
+};
+
+/**
+ * @brief Compile-time lexical scope used by the resolve pass
+ *
+ * Each Scope mirrors one runtime Frame: names[i] is stored in slot i.
+ * A null Scope pointer stands for the global environment. The scope of a
+ * lambda body has lambda set: a call frame does not link to the frame the
+ * closure was made in, so a lookup that leaves it becomes a capture.
+ */
+struct Scope {
+    std::vector<Name> names;
+    std::vector<SlotUse> uses; ///< Parallel to names, grown on demand
+    Scope *parent;
+    Lambda *lambda;
+    Scope(Scope *, Lambda * = nullptr);
+};
+
+/**
+ * @brief Where a resolved variable reference lives at runtime
+ */
+enum VarKind {
+    VK_UNRESOLVED,
+    VK_LOCAL,   ///< frame slot at (depth, index)
+    VK_FREE,    ///< captured value at index in the running closure
+    VK_GLOBAL,  ///< global slot at index
+    VK_INVALID  ///< name can never be a variable (e.g. starts with a digit)
+};
+
+/**
+ * @brief A free variable of a lambda and where closure creation copies it from
+ *
+ * The source is addressed in the frame that evaluates the lambda: a slot
+ * (VK_LOCAL, depth, index) or a capture of the enclosing closure (VK_FREE,
+ * index). A boxed variable is assigned somewhere, so the slot is turned
+ * into a Box on capture and the frame and every closure share it.
+ */
+struct FreeVar {
+    Name name;
+    VarKind kind;
+    int depth;
+    int index;
+    bool boxed;
+};
+
 struct ExprBase {
     ExprType e_type;
     ExprBase(ExprType);
-    virtual Value eval(Assoc &) = 0;
+    virtual Value eval(Env &) = 0;
+    virtual Value evalTail(Env &, TailCall &);
+    virtual void resolve(Scope *);
     virtual ~ExprBase() = default;
 };
 
@@ -51,7 +109,7 @@ public:
 struct Fixnum : ExprBase {
     int n;
     Fixnum(int);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 /**
@@ -61,8 +119,10 @@ struct Fixnum : ExprBase {
 struct RationalNum : ExprBase {
     int numerator;
     int denominator;
+    std::unique_ptr<Value> value; ///< Built once by the constructor
     RationalNum(int num, int den);
-    virtual Value eval(Assoc &) override;
+    ~RationalNum();
+    virtual Value eval(Env &) override;
 };
 
 /**
@@ -71,8 +131,10 @@ struct RationalNum : ExprBase {
  */
 struct StringExpr : ExprBase {
     std::string s;
+    std::unique_ptr<Value> value; ///< Built once by the constructor
     StringExpr(const std::string &);
-    virtual Value eval(Assoc &) override;
+    ~StringExpr();
+    virtual Value eval(Env &) override;
 };
 
 /**
@@ -80,7 +142,7 @@ struct StringExpr : ExprBase {
  */
 struct True : ExprBase {
     True();
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 /**
@@ -88,17 +150,17 @@ struct True : ExprBase {
  */
 struct False : ExprBase {
     False();
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct MakeVoid : ExprBase {
     MakeVoid();
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 struct Exit : ExprBase {
     Exit();
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
 };
 
 // ================================================================================
@@ -109,7 +171,8 @@ struct Unary : ExprBase {
     Expr rand;
     Unary(ExprType, const Expr &);
     virtual Value evalRator(const Value &) = 0;
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Binary : ExprBase {
@@ -117,16 +180,23 @@ struct Binary : ExprBase {
     Expr rand2;
     Binary(ExprType, const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) = 0;
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Variadic : ExprBase {
     std::vector<Expr> rands;
     Variadic(ExprType, const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) = 0;
-    virtual Value eval(Assoc &) override;
+    virtual Value evalRator(const ValueSpan &) = 0;
+    virtual Value eval(Env &) override;
+    virtual void resolve(Scope *) override;
 };
 
+// Primitive node of the given type and shape, or a null Expr if there is none
+Expr makeUnary(ExprType, const Expr &);
+Expr makeBinary(ExprType, const Expr &, const Expr &);
+Expr makeVariadic(ExprType, const std::vector<Expr> &);
+
 // ================================================================================
 //                             ARITHMETIC OPERATIONS
 // ================================================================================
@@ -141,6 +211,12 @@ struct Minus : Binary {
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
+// (- a): a unary node of type E_MINUS
+struct Negate : Unary {
+    Negate(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
 struct Mult : Binary {
     Mult(const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) override;
@@ -161,24 +237,85 @@ struct Expt : Binary {
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
+struct ExactToInexact : Unary {
+    ExactToInexact(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct InexactToExact : Unary {
+    InexactToExact(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Sqrt : Unary {
+    Sqrt(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Exp : Unary {
+    Exp(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Log : Unary {
+    Log(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Sin : Unary {
+    Sin(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Cos : Unary {
+    Cos(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Tan : Unary {
+    Tan(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Asin : Unary {
+    Asin(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Acos : Unary {
+    Acos(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Atan : Unary {
+    Atan(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+// (atan y x): a binary node of type E_ATAN
+struct Atan2 : Binary {
+    Atan2(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
 struct PlusVar : Variadic {
     PlusVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const ValueSpan &) override;
 };
 
 struct MinusVar : Variadic {
     MinusVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const ValueSpan &) override;
 };
 
 struct MultVar : Variadic {
     MultVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const ValueSpan &) override;
 };
 
 struct DivVar : Variadic {
     DivVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const ValueSpan &) override;
 };
 
 // ================================================================================
@@ -212,27 +349,27 @@ struct Greater : Binary {
 
 struct LessVar : Variadic {
     LessVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const ValueSpan &) override;
 };
 
 struct LessEqVar : Variadic {
     LessEqVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const ValueSpan &) override;
 };
 
 struct EqualVar : Variadic {
     EqualVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const ValueSpan &) override;
 };
 
 struct GreaterEqVar : Variadic {
     GreaterEqVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const ValueSpan &) override;
 };
 
 struct GreaterVar : Variadic {
     GreaterVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const ValueSpan &) override;
 };
 
 // ================================================================================
@@ -256,7 +393,7 @@ struct Cdr : Unary {
 
 struct ListFunc : Variadic {
     ListFunc(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const ValueSpan &) override;
 };
 
 struct SetCar : Binary {
@@ -281,13 +418,17 @@ struct Not : Unary {
 struct AndVar : ExprBase {
     std::vector<Expr> rands;
     AndVar(const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual Value evalTail(Env &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct OrVar : ExprBase {
     std::vector<Expr> rands;
     OrVar(const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual Value evalTail(Env &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 // ================================================================================
@@ -299,6 +440,14 @@ struct IsEq : Binary {
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
+// Whether the operand is a procedure made from the template with this
+// serial. Guards an inlined call without holding on to the procedure.
+struct SameTemplate : Unary {
+    uint64_t serial;
+    SameTemplate(const Expr &, uint64_t);
+    virtual Value evalRator(const Value &) override;
+};
+
 struct IsBoolean : Unary {
     IsBoolean(const Expr &);
     virtual Value evalRator(const Value &) override;
@@ -346,13 +495,23 @@ struct IsString : Unary {
 struct Begin : ExprBase {
     std::vector<Expr> es;
     Begin(const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual Value evalTail(Env &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
+/**
+ * @brief Quoted datum
+ * The datum is converted to an immutable constant once, when the node is
+ * built; every evaluation returns that same value.
+ */
 struct Quote : ExprBase {
-    Syntax s;
+    std::unique_ptr<Value> value; ///< The constant (null if the datum is malformed)
+    std::string error;            ///< Why a malformed datum has no constant
     Quote(const Syntax &);
-    virtual Value eval(Assoc &) override;
+    Quote(); ///< Neither value nor error set; the program cache fills one in
+    ~Quote();
+    virtual Value eval(Env &) override;
 };
 
 // ================================================================================
@@ -364,13 +523,17 @@ struct If : ExprBase {
     Expr conseq;
     Expr alter;
     If(const Expr &, const Expr &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual Value evalTail(Env &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Cond : ExprBase {
     std::vector<std::vector<Expr>> clauses;
     Cond(const std::vector<std::vector<Expr>> &);
-    virtual Value eval(Assoc &) override;
+    virtual Value eval(Env &) override;
+    virtual Value evalTail(Env &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 // ================================================================================
@@ -378,30 +541,56 @@ struct Cond : ExprBase {
 // ================================================================================
 
 struct Var : ExprBase {
-    std::string x;
-    Var(const std::string &);
-    virtual Value eval(Assoc &) override;
+    Name x;
+    VarKind kind; ///< Filled in by resolve
+    int depth;    ///< Frames to walk up (VK_LOCAL)
+    int index;    ///< Slot within the frame, capture or global table
+    Var(const Name &);
+    virtual Value eval(Env &) override;
+    virtual void resolve(Scope *) override;
 };
 
+/**
+ * @brief Procedure call
+ *
+ * When the operator is a global variable, resolve links the call to that
+ * global's cell, and the site remembers the last procedure found there that
+ * takes this many arguments. While the cell still holds it (it was not
+ * redefined or set!), the call skips the variable lookup and the arity check.
+ */
 struct Apply : ExprBase {
     Expr rator;
     std::vector<Expr> rand;
+    Value *cell;                   ///< Global cell of the operator, or nullptr; set by resolve
+    std::unique_ptr<Value> linked; ///< Procedure known to accept rand.size() arguments
     Apply(const Expr &, const std::vector<Expr> &);
-    virtual Value eval(Assoc &) override;
+    ~Apply();
+    virtual Value eval(Env &) override;
+    virtual Value evalTail(Env &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Lambda : ExprBase {
-    std::vector<std::string> x;
+    std::vector<Name> x;
     Expr e;
-    Lambda(const std::vector<std::string> &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    int frame_size; ///< Parameters plus internal defines, filled in by resolve
+    Name name;      ///< define/let name, or "<enclosing>/lambda"; set by resolve
+    std::vector<FreeVar> free; ///< Copied into each closure, filled in by resolve
+    LambdaTemplate *tmpl;      ///< Shared by the closures, built by resolve (counted)
+    Lambda(const std::vector<Name> &, const Expr &);
+    ~Lambda();
+    virtual Value eval(Env &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Define : ExprBase {
-    std::string var;
+    Name var;
     Expr e;
-    Define(const std::string &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    VarKind kind; ///< VK_LOCAL (slot in the current frame) or VK_GLOBAL
+    int index;
+    Define(const Name &, const Expr &);
+    virtual Value eval(Env &) override;
+    virtual void resolve(Scope *) override;
 };
 
 // ================================================================================
@@ -409,17 +598,23 @@ struct Define : ExprBase {
 // ================================================================================
 
 struct Let : ExprBase {
-    std::vector<std::pair<std::string, Expr>> bind;
+    std::vector<std::pair<Name, Expr>> bind;
     Expr body;
-    Let(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    int frame_size; ///< Bindings plus internal defines, filled in by resolve
+    Let(const std::vector<std::pair<Name, Expr>> &, const Expr &);
+    virtual Value eval(Env &) override;
+    virtual Value evalTail(Env &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Letrec : ExprBase {
-    std::vector<std::pair<std::string, Expr>> bind;
+    std::vector<std::pair<Name, Expr>> bind;
     Expr body;
-    Letrec(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    int frame_size; ///< Bindings plus internal defines, filled in by resolve
+    Letrec(const std::vector<std::pair<Name, Expr>> &, const Expr &);
+    virtual Value eval(Env &) override;
+    virtual Value evalTail(Env &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 // ================================================================================
@@ -427,10 +622,14 @@ struct Letrec : ExprBase {
 // ================================================================================
 
 struct Set : ExprBase {
-    std::string var;
+    Name var;
     Expr e;
-    Set(const std::string &, const Expr &);
-    virtual Value eval(Assoc &) override;
+    VarKind kind; ///< Same addressing as Var, filled in by resolve
+    int depth;
+    int index;
+    Set(const Name &, const Expr &);
+    virtual Value eval(Env &) override;
+    virtual void resolve(Scope *) override;
 };
 
 // ================================================================================
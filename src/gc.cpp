@@ -0,0 +1,179 @@
+/**
+ * @file gc.cpp
+ * @brief Reference counting support, cycle collector and object pools
+ */
+
+#include "gc.hpp"
+#include <algorithm>
+#include <new>
+#include <vector>
+
+static const size_t kMinThreshold = 10000; // containers allocated before the first collection
+
+GcStats gc_stats = {0, 0, 0, 0, kMinThreshold};
+
+static GcObject *tracked_head = nullptr;
+
+// ============================================================================
+// Object pools
+// ============================================================================
+
+// Blocks are grouped by size in 16-byte classes; a freed block goes on its
+// class's free list and is handed out again before new memory is carved.
+static const size_t kGranule = 16;
+static const size_t kMaxPooled = 256;
+static const size_t kArenaBytes = 64 * 1024;
+
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+static FreeBlock *free_lists[kMaxPooled / kGranule + 1];
+static char *arena_next = nullptr;
+static char *arena_end = nullptr;
+
+void *GcObject::operator new(size_t size) {
+    if (size > kMaxPooled)
+        return ::operator new(size);
+    size_t cls = (size + kGranule - 1) / kGranule;
+    if (FreeBlock *block = free_lists[cls]) {
+        free_lists[cls] = block->next;
+        return block;
+    }
+    size_t bytes = cls * kGranule;
+    if ((size_t)(arena_end - arena_next) < bytes) {
+        // The tail of the previous arena is abandoned; it is smaller than one block
+        arena_next = static_cast<char *>(::operator new(kArenaBytes));
+        arena_end = arena_next + kArenaBytes;
+    }
+    void *p = arena_next;
+    arena_next += bytes;
+    return p;
+}
+
+void GcObject::operator delete(void *p, size_t size) {
+    if (size > kMaxPooled) {
+        ::operator delete(p);
+        return;
+    }
+    size_t cls = (size + kGranule - 1) / kGranule;
+    FreeBlock *block = static_cast<FreeBlock *>(p);
+    block->next = free_lists[cls];
+    free_lists[cls] = block;
+}
+
+// ============================================================================
+// Object header
+// ============================================================================
+
+GcObject::GcObject(bool container)
+    : refcount(0), gc_refs(0), tracked(container), gc_prev(nullptr), gc_next(nullptr) {
+    ++gc_stats.allocated;
+    if (tracked) {
+        gc_next = tracked_head;
+        if (tracked_head)
+            tracked_head->gc_prev = this;
+        tracked_head = this;
+        ++gc_stats.tracked;
+    }
+}
+
+GcObject::~GcObject() {
+    ++gc_stats.freed;
+    if (tracked) {
+        if (gc_prev)
+            gc_prev->gc_next = gc_next;
+        else
+            tracked_head = gc_next;
+        if (gc_next)
+            gc_next->gc_prev = gc_prev;
+        --gc_stats.tracked;
+    }
+}
+
+void GcObject::traverse(GcVisitor, void *) {}
+
+void GcObject::clearRefs() {}
+
+// Freeing an object releases its children, which may free them in turn. The
+// deletions are queued and run from one loop so that dropping a long list
+// does not recurse once per element.
+static std::vector<GcObject *> pending_free;
+static bool draining = false;
+
+void gcFree(GcObject *obj) {
+    pending_free.push_back(obj);
+    if (draining)
+        return;
+    draining = true;
+    while (!pending_free.empty()) {
+        GcObject *next = pending_free.back();
+        pending_free.pop_back();
+        delete next;
+    }
+    draining = false;
+}
+
+// ============================================================================
+// Cycle collector
+// ============================================================================
+
+static const int kReachable = -1;
+
+// Step 2: a reference from one tracked object to another is internal
+static void subtractInternal(GcObject *child, void *) {
+    if (child && child->tracked)
+        --child->gc_refs;
+}
+
+// Step 3: anything referenced by a reachable object is reachable
+static void markReachable(GcObject *child, void *arg) {
+    if (child && child->tracked && child->gc_refs != kReachable) {
+        child->gc_refs = kReachable;
+        static_cast<std::vector<GcObject *> *>(arg)->push_back(child);
+    }
+}
+
+size_t gcCollect() {
+    ++gc_stats.collections;
+
+    // 1. Start from the full reference counts
+    for (GcObject *obj = tracked_head; obj; obj = obj->gc_next)
+        obj->gc_refs = obj->refcount;
+
+    // 2. What remains after removing internal references comes from outside
+    for (GcObject *obj = tracked_head; obj; obj = obj->gc_next)
+        obj->traverse(subtractInternal, nullptr);
+
+    // 3. Externally referenced objects are roots; propagate from them
+    std::vector<GcObject *> work;
+    for (GcObject *obj = tracked_head; obj; obj = obj->gc_next) {
+        if (obj->gc_refs > 0) {
+            obj->gc_refs = kReachable;
+            work.push_back(obj);
+        }
+    }
+    while (!work.empty()) {
+        GcObject *obj = work.back();
+        work.pop_back();
+        obj->traverse(markReachable, &work);
+    }
+
+    // 4. The rest is garbage held alive only by cycles. Pin it, break every
+    // reference, then unpin so the counts fall to zero.
+    std::vector<GcObject *> garbage;
+    for (GcObject *obj = tracked_head; obj; obj = obj->gc_next) {
+        if (obj->gc_refs != kReachable)
+            garbage.push_back(obj);
+    }
+    for (GcObject *obj : garbage)
+        gcRetain(obj);
+    for (GcObject *obj : garbage)
+        obj->clearRefs();
+    for (GcObject *obj : garbage)
+        gcRelease(obj);
+
+    // Amortize: the next run waits until the live set has doubled
+    gc_stats.threshold = std::max(kMinThreshold, 2 * gc_stats.tracked);
+    return garbage.size();
+}
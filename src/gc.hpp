@@ -0,0 +1,85 @@
+#ifndef GC_HPP
+#define GC_HPP
+
+/**
+ * @file gc.hpp
+ * @brief Memory management for runtime objects
+ *
+ * Heap values and frames carry a plain (non-atomic) reference count in the
+ * object itself; Value and Env adjust it on copy. Reference cycles (a
+ * closure stored in its own frame, a list closed by set-cdr!) are reclaimed
+ * by a cycle collector using trial deletion: the references that tracked
+ * objects hold on each other are subtracted from their counts, so anything
+ * still counted is referenced from outside the heap (a C++ local, the global
+ * table, the VM stacks). Those objects and everything reachable from them
+ * survive; the rest is garbage. The roots never have to be enumerated.
+ *
+ * Objects are carved from size-class pools rather than the general heap.
+ */
+
+#include <cstddef>
+
+struct GcObject;
+typedef void (*GcVisitor)(GcObject *, void *);
+
+/**
+ * @brief Header shared by every reference-counted runtime object
+ *
+ * Containers (objects that hold references) are linked into the list the
+ * cycle collector scans and must override traverse and clearRefs.
+ */
+struct GcObject {
+    int refcount;      ///< References held by Value/Env handles
+    int gc_refs;       ///< Scratch count used during collection
+    bool tracked;      ///< Container taking part in cycle collection
+    GcObject *gc_prev; ///< Neighbours in the tracked list
+    GcObject *gc_next;
+
+    explicit GcObject(bool container);
+    GcObject(const GcObject &) = delete;
+    GcObject &operator=(const GcObject &) = delete;
+    virtual ~GcObject();
+
+    virtual void traverse(GcVisitor, void *); ///< Visit each referenced object
+    virtual void clearRefs();                 ///< Drop every reference (breaks a garbage cycle)
+
+    static void *operator new(size_t);
+    static void operator delete(void *, size_t);
+};
+
+/**
+ * @brief Allocation counters, for profiling and benchmarks
+ */
+struct GcStats {
+    size_t allocated;   ///< Objects allocated
+    size_t freed;       ///< Objects freed
+    size_t collections; ///< Cycle collector runs
+    size_t tracked;     ///< Containers currently alive
+    size_t threshold;   ///< Tracked count that triggers the next collection
+};
+
+extern GcStats gc_stats;
+
+void gcFree(GcObject *); ///< Called when a count drops to zero
+
+inline void gcRetain(GcObject *obj) {
+    if (obj)
+        ++obj->refcount;
+}
+
+inline void gcRelease(GcObject *obj) {
+    if (obj && --obj->refcount == 0)
+        gcFree(obj);
+}
+
+// Run the cycle collector; returns the number of garbage containers found
+size_t gcCollect();
+
+// Collect if enough containers were allocated since the last run. Only call
+// where every live object is held by a counted handle (not mid-construction).
+inline void gcSafepoint() {
+    if (gc_stats.tracked > gc_stats.threshold)
+        gcCollect();
+}
+
+#endif // GC_HPP
@@ -1,16 +1,20 @@
 #include "Def.hpp"
 #include "RE.hpp"
+#include "cache.hpp"
 #include "expr.hpp"
+#include "optimize.hpp"
+#include "profile.hpp"
 #include "syntax.hpp"
 #include "value.hpp"
+#include "vm.hpp"
 #include <cassert>
+#include <fcntl.h>
 #include <iostream>
 #include <limits>
 #include <map>
 #include <sstream>
-
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+#include <sys/resource.h>
+#include <unistd.h>
 
 bool isExplicitVoidCall(Expr expr) {
     MakeVoid *make_void_expr = dynamic_cast<MakeVoid *>(expr.get());
@@ -47,28 +51,39 @@ bool isExplicitVoidCall(Expr expr) {
     return false;
 }
 
-void REPL() {
+void REPL(Source &source, bool use_vm) {
     // read - evaluation - print loop
-    Assoc global_env = empty();
+    Assoc parse_env = empty();
+    Env global_env(nullptr);
+    SyntaxArena arena; // holds one form's syntax at a time
     while (1) {
-        Syntax stx = readSyntax(std::cin); // read
-        // stx->show(std::cout); // syntax print
+        if (readSpace(source).peek() == EOF) {
+            break;
+        }
+        arena.reset();
         try {
-            Expr expr = stx->parse(global_env); // parse
-            Value val = expr->eval(global_env);
-            if (val->v_type == V_TERMINATE) {
+            Syntax stx = readSyntax(source, arena); // read
+            // stx->show(std::cout); // syntax print
+            Expr expr = stx->parse(parse_env); // parse
+            arena.reset();                      // nothing refers to the syntax now
+            // Whether to echo a void result is decided on the form as written
+            bool is_explicit_void = isExplicitVoidCall(expr);
+            expr = optimize(expr);  // constant folding
+            expr->resolve(nullptr); // lexical addressing
+            Value val = use_vm ? vmEval(expr, global_env) : expr->eval(global_env);
+            if (val.v_type == V_TERMINATE) {
 #ifndef ONLINE_JUDGE
                 std::cout << "Terminate" << std::endl;
 #endif
                 break;
             }
-            bool is_void_value = (val->v_type == V_VOID);
-            bool is_explicit_void = isExplicitVoidCall(expr);
+            bool is_void_value = (val.v_type == V_VOID);
             if (!is_void_value || is_explicit_void) {
-                val->show(std::cout);
+                val.show(std::cout);
                 std::cout << std::endl;
                 std::cout.flush();
             }
+            gcSafepoint();
         } catch (const RuntimeError &RE) {
             // std::cout << RE.message();
             std::cout << "RuntimeError";
@@ -78,7 +93,176 @@ void REPL() {
     }
 }
 
+enum RunStatus { RUN_OK, RUN_EXIT, RUN_ERROR };
+
+/**
+ * @brief Batch counterpart of REPL: run every form of a script
+ *
+ * Values are not echoed and nothing is flushed per form; only display
+ * writes to stdout. With print_last the value of the final form is shown
+ * the way the REPL would (used by -e). An error stops the script and is
+ * reported on stderr, prefixed with origin.
+ *
+ * With a cache directory and a mapped source, forms come from the program
+ * cache when it has them; a run without a cache records one.
+ */
+RunStatus runScript(Source &source, const std::string &origin, bool use_vm, bool print_last,
+                    const std::string &cache_dir) {
+    Assoc parse_env = empty();
+    Env global_env(nullptr);
+    Value val = VoidV();
+    Expr expr(nullptr);
+    bool explicit_void = false; // isExplicitVoidCall of the last form, before optimize
+    SyntaxArena arena;
+
+    bool use_cache = !cache_dir.empty() && source.mapped();
+    std::vector<CachedForm> cached;
+    bool recording = use_cache && !loadProgramCache(cache_dir, source.data, source.len, cached);
+    CacheWriter writer;
+    std::vector<ParseDependency> deps;
+    size_t next_cached = 0;
+
+    RunStatus status = RUN_OK;
+    while (true) {
+        bool from_cache = false;
+        if (next_cached < cached.size()) {
+            CachedForm &form = cached[next_cached++];
+            if (dependenciesHold(form.deps)) {
+                expr = form.expr;
+                source.pos = form.end;
+                from_cache = true;
+            } else {
+                source.pos = form.begin; // parse this form again
+            }
+        }
+        if (!from_cache && readSpace(source).peek() == EOF) {
+            break;
+        }
+        try {
+            if (!from_cache) {
+                arena.reset();
+                size_t begin = source.pos;
+                Syntax stx = readSyntax(source, arena);
+                deps.clear();
+                parse_dependencies = recording ? &deps : nullptr;
+                expr = stx->parse(parse_env);
+                parse_dependencies = nullptr;
+                arena.reset();
+                if (recording) {
+                    writer.add(begin, source.pos, deps, expr);
+                }
+            }
+            explicit_void = isExplicitVoidCall(expr);
+            expr = optimize(expr);
+            expr->resolve(nullptr);
+            val = use_vm ? vmEval(expr, global_env) : expr->eval(global_env);
+            if (val.v_type == V_TERMINATE) {
+                status = RUN_EXIT;
+                break;
+            }
+            gcSafepoint();
+        } catch (const RuntimeError &RE) {
+            parse_dependencies = nullptr;
+            std::cout.flush();
+            std::cerr << origin << ": RuntimeError: " << RE.message() << std::endl;
+            status = RUN_ERROR;
+            break;
+        }
+    }
+    if (recording) {
+        // Whatever was parsed before an (exit) or error is still worth keeping
+        writer.save(cache_dir, source.data, source.len);
+    }
+    if (status == RUN_OK && print_last && expr.get() != nullptr &&
+        (val.v_type != V_VOID || explicit_void)) {
+        val.show(std::cout);
+        std::cout << '\n';
+    }
+    return status;
+}
+
+// One key=value line for bench/run.sh
+void printStats(std::ostream &os) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    os << "stats: allocated=" << gc_stats.allocated << " freed=" << gc_stats.freed
+       << " collections=" << gc_stats.collections << " peak_rss_kb=" << usage.ru_maxrss << std::endl;
+}
+
 int main(int argc, char *argv[]) {
-    REPL();
-    return 0;
+    bool use_vm = false;     // --vm: run on the bytecode backend instead of the tree walker
+    bool stats = false;      // --stats: print allocation counters and peak RSS at exit
+    std::string folded_path; // --profile-folded=FILE: also write flamegraph input
+    std::string cache_dir;   // --cache-dir=DIR: keep parsed script files in DIR
+    // Scripts run in command-line order: (true, text) for -e, (false, path) for a file
+    std::vector<std::pair<bool, std::string>> scripts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-e" && i + 1 < argc) {
+            scripts.emplace_back(true, argv[++i]);
+        } else if (arg.empty() || arg[0] != '-') {
+            scripts.emplace_back(false, arg);
+        } else if (arg == "--vm") {
+            use_vm = true;
+        } else if (arg.compare(0, 12, "--cache-dir=") == 0 && arg.size() > 12) {
+            cache_dir = arg.substr(12);
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "--profile") {
+            profiling = true;
+        } else if (arg.compare(0, 17, "--profile-folded=") == 0 && arg.size() > 17) {
+            profiling = true;
+            folded_path = arg.substr(17);
+        } else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--vm] [--stats] [--profile] [--profile-folded=FILE] [--cache-dir=DIR]"
+                      << " [-e EXPR | FILE]..." << std::endl;
+            return 2;
+        }
+    }
+
+    int exit_code = 0;
+    if (scripts.empty()) {
+        Source source(0); // stdin
+        REPL(source, use_vm);
+    } else {
+        // Output is only flushed when the buffer fills or at exit
+        std::ios::sync_with_stdio(false);
+        for (const auto &script : scripts) {
+            RunStatus status;
+            if (script.first) {
+                Source source(script.second);
+                status = runScript(source, "-e", use_vm, true, "");
+            } else {
+                int fd = open(script.second.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    std::cerr << "cannot open " << script.second << std::endl;
+                    exit_code = 1;
+                    break;
+                }
+                Source source(fd);
+                status = runScript(source, script.second, use_vm, false, cache_dir);
+                close(fd);
+            }
+            if (status == RUN_ERROR) {
+                exit_code = 1;
+            }
+            if (status != RUN_OK) {
+                break;
+            }
+        }
+        std::cout.flush();
+    }
+    if (stats) {
+        printStats(std::cerr);
+    }
+    if (profiling) {
+        // Report on stderr so program output stays unchanged
+        profileReport(std::cerr);
+        if (!folded_path.empty() && !profileWriteFolded(folded_path)) {
+            std::cerr << "cannot write " << folded_path << std::endl;
+            return 1;
+        }
+    }
+    return exit_code;
 }
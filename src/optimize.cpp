@@ -0,0 +1,634 @@
+/**
+ * @file optimize.cpp
+ * @brief Constant folding, branch pruning and begin flattening
+ *
+ * A call is folded by evaluating the node itself on its literal operands, so
+ * the result is exactly what the evaluator would produce at run time. If
+ * that evaluation raises an error the node is left alone and the error is
+ * raised when (and if) the program reaches it.
+ *
+ * Code is never dropped if it holds a define belonging to the enclosing
+ * frame: resolve allocates a slot for every such define, reachable or not,
+ * and removing one could make a reference resolve to an outer binding.
+ */
+
+#include "optimize.hpp"
+#include "RE.hpp"
+#include "bignum.hpp"
+#include "profile.hpp"
+#include "value.hpp"
+#include <vector>
+
+static Expr fold(const Expr &expr);
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+// Value of a literal node, or false if expr is not a literal
+static bool constantOf(const Expr &expr, Value &out) {
+    switch (expr->e_type) {
+    case E_FIXNUM:
+    case E_TRUE:
+    case E_FALSE:
+    case E_VOID: {
+        Env none(nullptr);
+        out = expr->eval(none);
+        return true;
+    }
+    case E_RATIONAL:
+        out = *static_cast<RationalNum *>(expr.get())->value;
+        return true;
+    case E_STRING:
+        out = *static_cast<StringExpr *>(expr.get())->value;
+        return true;
+    case E_QUOTE: {
+        Quote *quote = static_cast<Quote *>(expr.get());
+        if (!quote->value)
+            return false;
+        out = *quote->value;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+static bool isLiteral(const Expr &expr) {
+    Value unused(nullptr);
+    return constantOf(expr, unused);
+}
+
+// Scheme truth: everything but #f
+static bool isTrue(const Value &v) {
+    return !(v.v_type == V_BOOL && !v.b);
+}
+
+// Literal node that evaluates to v
+static Expr literal(const Value &v) {
+    switch (v.v_type) {
+    case V_INT:
+        return Expr(new Fixnum(v.n));
+    case V_BOOL:
+        return v.b ? Expr(new True()) : Expr(new False());
+    case V_VOID:
+        return Expr(new MakeVoid());
+    default: {
+        Quote *quote = new Quote();
+        quote->value.reset(new Value(v));
+        return Expr(quote);
+    }
+    }
+}
+
+// Primitives without side effects whose result depends only on the operands
+static bool isPure(ExprType type) {
+    switch (type) {
+    case E_PLUS:
+    case E_MINUS:
+    case E_MUL:
+    case E_DIV:
+    case E_MODULO:
+    case E_EXPT:
+    case E_EXACT_TO_INEXACT:
+    case E_INEXACT_TO_EXACT:
+    case E_SQRT:
+    case E_EXP:
+    case E_LOG:
+    case E_SIN:
+    case E_COS:
+    case E_TAN:
+    case E_ASIN:
+    case E_ACOS:
+    case E_ATAN:
+    case E_LT:
+    case E_LE:
+    case E_EQ:
+    case E_GE:
+    case E_GT:
+    case E_NOT:
+    case E_AND:
+    case E_OR:
+    case E_BOOLQ:
+    case E_INTQ:
+    case E_NULLQ:
+    case E_PAIRQ:
+    case E_PROCQ:
+    case E_SYMBOLQ:
+    case E_LISTQ:
+    case E_STRINGQ:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool allLiteral(const std::vector<Expr> &es) {
+    for (const auto &e : es)
+        if (!isLiteral(e))
+            return false;
+    return true;
+}
+
+// Folded numbers are kept to this many bits, so folding stays cheap and the
+// literal it leaves in the tree stays small; a larger result is computed
+// when the program runs
+static const size_t kFoldBits = 256;
+
+static bool smallEnoughToFold(const Value &v) {
+    switch (v.v_type) {
+    case V_BIGNUM:
+        return intBitLength(v) <= kFoldBits;
+    case V_RATIONAL: {
+        Rational *ratio = static_cast<Rational *>(v.get());
+        return intBitLength(ratio->numerator) <= kFoldBits && intBitLength(ratio->denominator) <= kFoldBits;
+    }
+    default:
+        return true;
+    }
+}
+
+// (expt b n) on exact integers has at least (bits(b) - 1) * n bits; one
+// that is sure to be too large to fold is not computed at all
+static bool exptTooLargeToFold(Binary *expt) {
+    Value base(nullptr), exponent(nullptr);
+    if (!constantOf(expt->rand1, base) || !constantOf(expt->rand2, exponent))
+        return false;
+    if (!isExactInteger(base) || exponent.v_type != V_INT || exponent.n <= 0)
+        return false;
+    return (intBitLength(base) - 1) * (unsigned long long)exponent.n > kFoldBits;
+}
+
+// The literal expr evaluates to, or expr itself if evaluating it fails or
+// gives a number too large to fold
+static Expr evaluateNow(const Expr &expr) {
+    try {
+        Env none(nullptr);
+        Value result = expr->eval(none);
+        return smallEnoughToFold(result) ? literal(result) : expr;
+    } catch (const RuntimeError &) {
+        return expr;
+    }
+}
+
+// Direct subexpressions of expr
+static std::vector<Expr *> children(ExprBase *expr) {
+    std::vector<Expr *> out;
+    auto add = [&out](std::vector<Expr> &es) {
+        for (auto &e : es)
+            out.push_back(&e);
+    };
+    if (auto unary = dynamic_cast<Unary *>(expr)) {
+        out.push_back(&unary->rand);
+    } else if (auto binary = dynamic_cast<Binary *>(expr)) {
+        out.push_back(&binary->rand1);
+        out.push_back(&binary->rand2);
+    } else if (auto variadic = dynamic_cast<Variadic *>(expr)) {
+        add(variadic->rands);
+    } else if (auto and_expr = dynamic_cast<AndVar *>(expr)) {
+        add(and_expr->rands);
+    } else if (auto or_expr = dynamic_cast<OrVar *>(expr)) {
+        add(or_expr->rands);
+    } else if (auto begin = dynamic_cast<Begin *>(expr)) {
+        add(begin->es);
+    } else if (auto if_expr = dynamic_cast<If *>(expr)) {
+        out.push_back(&if_expr->cond);
+        out.push_back(&if_expr->conseq);
+        if (if_expr->alter.get() != nullptr)
+            out.push_back(&if_expr->alter);
+    } else if (auto cond = dynamic_cast<Cond *>(expr)) {
+        for (auto &clause : cond->clauses)
+            add(clause);
+    } else if (auto apply = dynamic_cast<Apply *>(expr)) {
+        out.push_back(&apply->rator);
+        add(apply->rand);
+    } else if (auto lambda = dynamic_cast<Lambda *>(expr)) {
+        out.push_back(&lambda->e);
+    } else if (auto define = dynamic_cast<Define *>(expr)) {
+        out.push_back(&define->e);
+    } else if (auto let = dynamic_cast<Let *>(expr)) {
+        for (auto &b : let->bind)
+            out.push_back(&b.second);
+        out.push_back(&let->body);
+    } else if (auto letrec = dynamic_cast<Letrec *>(expr)) {
+        for (auto &b : letrec->bind)
+            out.push_back(&b.second);
+        out.push_back(&letrec->body);
+    } else if (auto set = dynamic_cast<Set *>(expr)) {
+        out.push_back(&set->e);
+    }
+    return out;
+}
+
+/**
+ * @brief Names defined in the frame expr is evaluated in
+ *
+ * Follows collectDefines in resolve.cpp: lambda, letrec and let bodies have
+ * frames of their own and are not searched.
+ */
+static void frameDefines(ExprBase *expr, std::vector<Name> &names) {
+    if (expr == nullptr || dynamic_cast<Lambda *>(expr) || dynamic_cast<Letrec *>(expr))
+        return;
+    if (auto def = dynamic_cast<Define *>(expr)) {
+        names.push_back(def->var);
+    } else if (auto let = dynamic_cast<Let *>(expr)) {
+        for (auto &b : let->bind)
+            frameDefines(b.second.get(), names);
+        return;
+    }
+    for (Expr *child : children(expr))
+        frameDefines(child->get(), names);
+}
+
+static bool definesInFrame(ExprBase *expr) {
+    std::vector<Name> names;
+    frameDefines(expr, names);
+    return !names.empty();
+}
+
+static bool definesInFrame(const std::vector<Expr> &es) {
+    for (const auto &e : es)
+        if (definesInFrame(e.get()))
+            return true;
+    return false;
+}
+
+// Body of a clause that is known to be taken, as one expression
+static Expr clauseBody(const std::vector<Expr> &clause, const Value &test) {
+    if (clause.size() == 1)
+        return literal(test);
+    if (clause.size() == 2)
+        return clause[1];
+    return Expr(new Begin(std::vector<Expr>(clause.begin() + 1, clause.end())));
+}
+
+// ============================================================================
+// Inlining
+// ============================================================================
+
+// Names bound by the lambdas and lets around the node being folded
+static std::vector<Name> locals;
+
+/**
+ * @brief Names of one frame, visible to the code folded while it is alive
+ */
+struct LocalScope {
+    size_t mark;
+    LocalScope(const std::vector<Name> &names, ExprBase *body) : mark(locals.size()) {
+        locals.insert(locals.end(), names.begin(), names.end());
+        frameDefines(body, locals);
+    }
+    ~LocalScope() { locals.erase(locals.begin() + mark, locals.end()); }
+};
+
+static bool isLocal(const Name &x) {
+    for (const Name &name : locals)
+        if (name == x)
+            return true;
+    return false;
+}
+
+static std::vector<Name> boundNames(const std::vector<std::pair<Name, Expr>> &bind) {
+    std::vector<Name> names;
+    for (const auto &b : bind)
+        names.push_back(b.first);
+    return names;
+}
+
+// Procedures are not inlined if their body has more nodes than this
+static const int kInlineBudget = 24;
+
+/**
+ * @brief Whether the resolved body of the global procedure self can be
+ * copied to the current call site
+ *
+ * The body must be small, must not call self (a copy would still contain
+ * the call), and none of the globals it refers to may be shadowed by a local
+ * of the call site, where the copy is resolved again.
+ */
+static bool inlinable(ExprBase *expr, const Name &self, int &budget) {
+    if (--budget < 0)
+        return false;
+    const Name *global = nullptr;
+    if (auto var = dynamic_cast<Var *>(expr)) {
+        if (var->kind == VK_GLOBAL)
+            global = &var->x;
+    } else if (auto set = dynamic_cast<Set *>(expr)) {
+        if (set->kind == VK_GLOBAL)
+            global = &set->var;
+    }
+    if (global != nullptr && (*global == self || isLocal(*global)))
+        return false;
+    for (Expr *child : children(expr))
+        if (!inlinable(child->get(), self, budget))
+            return false;
+    return true;
+}
+
+static Expr clone(const Expr &expr);
+
+static std::vector<Expr> cloneList(const std::vector<Expr> &es) {
+    std::vector<Expr> out;
+    for (const auto &e : es)
+        out.push_back(clone(e));
+    return out;
+}
+
+static std::vector<std::pair<Name, Expr>> cloneBindings(const std::vector<std::pair<Name, Expr>> &bind) {
+    std::vector<std::pair<Name, Expr>> out;
+    for (const auto &b : bind)
+        out.emplace_back(b.first, clone(b.second));
+    return out;
+}
+
+// Unresolved copy of expr; literals are immutable and are shared
+static Expr clone(const Expr &expr) {
+    ExprBase *node = expr.get();
+    if (auto guard = dynamic_cast<SameTemplate *>(node)) {
+        return Expr(new SameTemplate(clone(guard->rand), guard->serial));
+    } else if (auto unary = dynamic_cast<Unary *>(node)) {
+        return makeUnary(node->e_type, clone(unary->rand));
+    } else if (auto binary = dynamic_cast<Binary *>(node)) {
+        return makeBinary(node->e_type, clone(binary->rand1), clone(binary->rand2));
+    } else if (auto variadic = dynamic_cast<Variadic *>(node)) {
+        return makeVariadic(node->e_type, cloneList(variadic->rands));
+    } else if (auto and_expr = dynamic_cast<AndVar *>(node)) {
+        return Expr(new AndVar(cloneList(and_expr->rands)));
+    } else if (auto or_expr = dynamic_cast<OrVar *>(node)) {
+        return Expr(new OrVar(cloneList(or_expr->rands)));
+    } else if (auto begin = dynamic_cast<Begin *>(node)) {
+        return Expr(new Begin(cloneList(begin->es)));
+    } else if (auto if_expr = dynamic_cast<If *>(node)) {
+        Expr alter = if_expr->alter.get() != nullptr ? clone(if_expr->alter) : if_expr->alter;
+        return Expr(new If(clone(if_expr->cond), clone(if_expr->conseq), alter));
+    } else if (auto cond = dynamic_cast<Cond *>(node)) {
+        std::vector<std::vector<Expr>> clauses;
+        for (const auto &clause : cond->clauses)
+            clauses.push_back(cloneList(clause));
+        return Expr(new Cond(clauses));
+    } else if (auto var = dynamic_cast<Var *>(node)) {
+        return Expr(new Var(var->x));
+    } else if (auto apply = dynamic_cast<Apply *>(node)) {
+        return Expr(new Apply(clone(apply->rator), cloneList(apply->rand)));
+    } else if (auto lambda = dynamic_cast<Lambda *>(node)) {
+        Lambda *copy = new Lambda(lambda->x, clone(lambda->e));
+        copy->name = lambda->name;
+        return Expr(copy);
+    } else if (auto define = dynamic_cast<Define *>(node)) {
+        return Expr(new Define(define->var, clone(define->e)));
+    } else if (auto let = dynamic_cast<Let *>(node)) {
+        return Expr(new Let(cloneBindings(let->bind), clone(let->body)));
+    } else if (auto letrec = dynamic_cast<Letrec *>(node)) {
+        return Expr(new Letrec(cloneBindings(letrec->bind), clone(letrec->body)));
+    } else if (auto set = dynamic_cast<Set *>(node)) {
+        return Expr(new Set(set->var, clone(set->e)));
+    }
+    return expr;
+}
+
+// Body nodes one top-level form may gain from inlining
+static const int kFormInlineBudget = 2000;
+static int form_inline_budget;
+
+/**
+ * @brief Inline a call to a small procedure bound to a global
+ *
+ * The call is replaced by a let binding the arguments to the parameters
+ * around a copy of the body, guarded by a check that the global still holds
+ * a procedure made from the same lambda; if it was redefined or set! since,
+ * the original procedure is called on the bound arguments instead:
+ *
+ *     (f a b)  =>  (let ((x a) (y b)) (if <f made from T> body (f x y)))
+ *
+ * Each operand appears once, so nested inlined calls grow the code only
+ * by the bodies they copy. The guard compares template serials and holds
+ * no reference, so a redefined procedure is not kept alive by old call
+ * sites.
+ *
+ * Only procedures that captured nothing qualify, so the body's free
+ * variables are all globals, and any procedure made from the template
+ * behaves the same. The guard and the fallback call sit inside the let,
+ * so f must not be a parameter or an internal define.
+ */
+static Expr inlineCall(Apply *apply, const Expr &expr) {
+    Var *var = dynamic_cast<Var *>(apply->rator.get());
+    if (var == nullptr || isLocal(var->x) || var->x->global_slot < 0)
+        return expr;
+    Value proc_val = globalValue(var->x->global_slot);
+    if (proc_val.v_type != V_PROC)
+        return expr;
+    Procedure *proc = static_cast<Procedure *>(proc_val.get());
+    LambdaTemplate *tmpl = proc->tmpl;
+    if (tmpl->free_count > 0 || tmpl->arity != (int)apply->rand.size())
+        return expr;
+    int budget = kInlineBudget;
+    if (!inlinable(tmpl->e.get(), var->x, budget))
+        return expr;
+    int growth = kInlineBudget - budget;
+    if (growth > form_inline_budget)
+        return expr;
+    std::vector<Name> frame = tmpl->parameters;
+    frameDefines(tmpl->e.get(), frame);
+    for (const Name &name : frame)
+        if (name == var->x)
+            return expr;
+    form_inline_budget -= growth;
+
+    std::vector<std::pair<Name, Expr>> bind;
+    std::vector<Expr> args;
+    for (size_t i = 0; i < apply->rand.size(); ++i) {
+        bind.emplace_back(tmpl->parameters[i], apply->rand[i]);
+        args.push_back(Expr(new Var(tmpl->parameters[i])));
+    }
+    Expr guard(new SameTemplate(Expr(new Var(var->x)), tmpl->serial));
+    Expr call(new Apply(apply->rator, args));
+    return Expr(new Let(bind, Expr(new If(guard, clone(tmpl->e), call))));
+}
+
+static Expr foldApply(Apply *apply, const Expr &expr) {
+    apply->rator = fold(apply->rator);
+    for (auto &e : apply->rand)
+        e = fold(e);
+    if (profiling)
+        return expr; // keep every activation visible to the profiler
+
+    // ((lambda (x ...) body) a ...)  =>  (let ((x a) ...) body)
+    if (auto lambda = dynamic_cast<Lambda *>(apply->rator.get())) {
+        if (lambdaArity(lambda->x) != (int)apply->rand.size())
+            return expr;
+        std::vector<std::pair<Name, Expr>> bind;
+        for (size_t i = 0; i < apply->rand.size(); ++i)
+            bind.emplace_back(lambda->x[i], apply->rand[i]);
+        return Expr(new Let(bind, lambda->e));
+    }
+    return inlineCall(apply, expr);
+}
+
+// ============================================================================
+// Folding
+// ============================================================================
+
+static Expr foldBegin(Begin *begin, const Expr &expr) {
+    std::vector<Expr> es;
+    for (size_t i = 0; i < begin->es.size(); ++i) {
+        Expr e = fold(begin->es[i]);
+        bool last = i + 1 == begin->es.size();
+        if (auto inner = dynamic_cast<Begin *>(e.get())) {
+            if (!inner->es.empty()) {
+                es.insert(es.end(), inner->es.begin(), inner->es.end());
+                continue;
+            }
+        }
+        if (!last && isLiteral(e))
+            continue; // value is discarded
+        es.push_back(e);
+    }
+    if (es.size() == 1)
+        return es[0];
+    begin->es = es;
+    return expr;
+}
+
+// The branches and clause bodies below are folded only where they can be
+// reached, so dead code costs no folding work
+
+static Expr foldIf(If *if_expr, const Expr &expr) {
+    if_expr->cond = fold(if_expr->cond);
+    Value test(nullptr);
+    if (!constantOf(if_expr->cond, test)) {
+        if_expr->conseq = fold(if_expr->conseq);
+        if (if_expr->alter.get() != nullptr)
+            if_expr->alter = fold(if_expr->alter);
+        return expr;
+    }
+    Expr &taken = isTrue(test) ? if_expr->conseq : if_expr->alter;
+    if (taken.get() != nullptr)
+        taken = fold(taken);
+    Expr dropped = isTrue(test) ? if_expr->alter : if_expr->conseq;
+    if (definesInFrame(dropped.get()))
+        return expr;
+    return taken.get() != nullptr ? taken : Expr(new False());
+}
+
+static void foldClauseBody(std::vector<Expr> &clause) {
+    for (size_t i = 1; i < clause.size(); ++i)
+        clause[i] = fold(clause[i]);
+}
+
+static Expr foldCond(Cond *cond, const Expr &expr) {
+    static const Name else_name("else");
+    std::vector<std::vector<Expr>> kept;
+    bool pruned = false;
+    for (size_t i = 0; i < cond->clauses.size(); ++i) {
+        std::vector<Expr> &clause = cond->clauses[i];
+        if (clause.empty()) {
+            kept.push_back(clause);
+            continue;
+        }
+
+        Value test(nullptr);
+        Var *var = dynamic_cast<Var *>(clause[0].get());
+        bool is_else = var != nullptr && var->x == else_name;
+        if (!is_else)
+            clause[0] = fold(clause[0]);
+        if (is_else) {
+            test = BooleanV(true);
+        } else if (!constantOf(clause[0], test)) {
+            foldClauseBody(clause);
+            kept.push_back(clause);
+            continue;
+        }
+
+        if (!isTrue(test)) {
+            // Never taken
+            if (definesInFrame(clause))
+                kept.push_back(clause);
+            else
+                pruned = true;
+            continue;
+        }
+        foldClauseBody(clause);
+        // Later clauses are unreachable
+        bool later_defines = false;
+        for (size_t j = i + 1; j < cond->clauses.size(); ++j)
+            later_defines = later_defines || definesInFrame(cond->clauses[j]);
+        if (later_defines) {
+            for (size_t j = i; j < cond->clauses.size(); ++j)
+                kept.push_back(cond->clauses[j]);
+            break;
+        }
+        if (kept.empty())
+            return clauseBody(clause, test);
+        kept.push_back(clause);
+        pruned = true;
+        break;
+    }
+    if (kept.empty())
+        return Expr(new False()); // no clause can be taken
+    if (pruned)
+        cond->clauses = kept;
+    return expr;
+}
+
+static Expr fold(const Expr &expr) {
+    ExprBase *node = expr.get();
+    if (auto unary = dynamic_cast<Unary *>(node)) {
+        unary->rand = fold(unary->rand);
+        if (isPure(expr->e_type) && isLiteral(unary->rand))
+            return evaluateNow(expr);
+    } else if (auto binary = dynamic_cast<Binary *>(node)) {
+        binary->rand1 = fold(binary->rand1);
+        binary->rand2 = fold(binary->rand2);
+        if (isPure(expr->e_type) && isLiteral(binary->rand1) && isLiteral(binary->rand2) &&
+            !(expr->e_type == E_EXPT && exptTooLargeToFold(binary)))
+            return evaluateNow(expr);
+    } else if (auto variadic = dynamic_cast<Variadic *>(node)) {
+        for (auto &e : variadic->rands)
+            e = fold(e);
+        if (isPure(expr->e_type) && allLiteral(variadic->rands))
+            return evaluateNow(expr);
+    } else if (auto and_expr = dynamic_cast<AndVar *>(node)) {
+        for (auto &e : and_expr->rands)
+            e = fold(e);
+        if (allLiteral(and_expr->rands))
+            return evaluateNow(expr);
+    } else if (auto or_expr = dynamic_cast<OrVar *>(node)) {
+        for (auto &e : or_expr->rands)
+            e = fold(e);
+        if (allLiteral(or_expr->rands))
+            return evaluateNow(expr);
+    } else if (auto begin = dynamic_cast<Begin *>(node)) {
+        return foldBegin(begin, expr);
+    } else if (auto if_expr = dynamic_cast<If *>(node)) {
+        return foldIf(if_expr, expr);
+    } else if (auto cond = dynamic_cast<Cond *>(node)) {
+        return foldCond(cond, expr);
+    } else if (auto apply = dynamic_cast<Apply *>(node)) {
+        return foldApply(apply, expr);
+    } else if (auto lambda = dynamic_cast<Lambda *>(node)) {
+        LocalScope scope(lambda->x, lambda->e.get());
+        lambda->e = fold(lambda->e);
+    } else if (auto define = dynamic_cast<Define *>(node)) {
+        define->e = fold(define->e);
+    } else if (auto let = dynamic_cast<Let *>(node)) {
+        for (auto &b : let->bind)
+            b.second = fold(b.second);
+        LocalScope scope(boundNames(let->bind), let->body.get());
+        let->body = fold(let->body);
+    } else if (auto letrec = dynamic_cast<Letrec *>(node)) {
+        LocalScope scope(boundNames(letrec->bind), letrec->body.get());
+        for (auto &b : letrec->bind)
+            frameDefines(b.second.get(), locals);
+        for (auto &b : letrec->bind)
+            b.second = fold(b.second);
+        letrec->body = fold(letrec->body);
+    } else if (auto set = dynamic_cast<Set *>(node)) {
+        set->e = fold(set->e);
+    }
+    return expr;
+}
+
+Expr optimize(const Expr &expr) {
+    form_inline_budget = kFormInlineBudget;
+    return fold(expr);
+}
@@ -0,0 +1,21 @@
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+/**
+ * @file optimize.hpp
+ * @brief Tree simplification pass run between parsing and resolve
+ *
+ * Folds pure primitive calls whose operands are literals into the literal
+ * they evaluate to, keeps only the taken branch of an if or cond with a
+ * literal test, and splices nested begins into their parent. A primitive
+ * node only exists where the parser found its name unshadowed, so folding
+ * one never overrides a user binding.
+ */
+
+#include "expr.hpp"
+
+// Simplify a parsed (unresolved) tree; returns the new root. Subtrees are
+// rewritten in place.
+Expr optimize(const Expr &);
+
+#endif // OPTIMIZE_HPP
@@ -9,11 +9,11 @@
 
 #include "Def.hpp"
 #include "RE.hpp"
+#include "cache.hpp"
 #include "expr.hpp"
 #include "syntax.hpp"
 #include "value.hpp"
 #include <iostream>
-#include <map>
 #include <string>
 
 #define mp make_pair
@@ -21,13 +21,105 @@ using std::pair;
 using std::string;
 using std::vector;
 
-extern std::map<std::string, ExprType> primitives;
-extern std::map<std::string, ExprType> reserved_words;
+/**
+ * @brief How an application of a primitive is parsed
+ *
+ * Indexed by the primitive's ExprType; the argument count is checked against
+ * [min_args, max_args] before the node is built.
+ */
+struct PrimitiveForm {
+    ExprType type;
+    int min_args;
+    int max_args;            ///< -1 for no upper bound
+    const char *arity_error; ///< Message for a bad count, or null for "Wrong number of arguments for <name>"
+    Expr (*make)(vector<Expr> &);
+};
+
+static const PrimitiveForm primitive_forms[] = {
+    // (+) => 0; (+ a) => a; (+ a b c...) => a + b + c + ...
+    {E_PLUS, 0, -1, nullptr, [](vector<Expr> &a) { return Expr(new PlusVar(a)); }},
+    // (- a) => -a; (- a b c...) => a - b - c - ...
+    {E_MINUS, 1, -1, "minus requires at least 1 argument",
+     [](vector<Expr> &a) { return a.size() == 1 ? Expr(new Negate(a[0])) : Expr(new MinusVar(a)); }},
+    // (*) => 1; (* a) => a; (* a b c...) => a * b * c * ...
+    {E_MUL, 0, -1, nullptr, [](vector<Expr> &a) { return Expr(new MultVar(a)); }},
+    // (/ a) => 1 / a; (/ a b c...) => a / b / c / ...
+    {E_DIV, 1, -1, "division requires at least 1 argument",
+     [](vector<Expr> &a) { return a.size() == 1 ? Expr(new Div(Expr(new Fixnum(1)), a[0])) : Expr(new DivVar(a)); }},
+    {E_MODULO, 2, 2, nullptr, [](vector<Expr> &a) { return Expr(new Modulo(a[0], a[1])); }},
+    {E_EXPT, 2, 2, nullptr, [](vector<Expr> &a) { return Expr(new Expt(a[0], a[1])); }},
+    {E_EXACT_TO_INEXACT, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new ExactToInexact(a[0])); }},
+    {E_INEXACT_TO_EXACT, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new InexactToExact(a[0])); }},
+    {E_SQRT, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Sqrt(a[0])); }},
+    {E_EXP, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Exp(a[0])); }},
+    {E_LOG, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Log(a[0])); }},
+    {E_SIN, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Sin(a[0])); }},
+    {E_COS, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Cos(a[0])); }},
+    {E_TAN, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Tan(a[0])); }},
+    {E_ASIN, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Asin(a[0])); }},
+    {E_ACOS, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Acos(a[0])); }},
+    // (atan y x) => the angle of the point (x, y)
+    {E_ATAN, 1, 2, nullptr,
+     [](vector<Expr> &a) { return a.size() == 1 ? Expr(new Atan(a[0])) : Expr(new Atan2(a[0], a[1])); }},
+    {E_LIST, 0, -1, nullptr, [](vector<Expr> &a) { return Expr(new ListFunc(a)); }},
+    // Comparisons of zero or one argument are #t
+    {E_LT, 0, -1, nullptr, [](vector<Expr> &a) { return Expr(new LessVar(a)); }},
+    {E_LE, 0, -1, nullptr, [](vector<Expr> &a) { return Expr(new LessEqVar(a)); }},
+    {E_EQ, 0, -1, nullptr, [](vector<Expr> &a) { return Expr(new EqualVar(a)); }},
+    {E_GE, 0, -1, nullptr, [](vector<Expr> &a) { return Expr(new GreaterEqVar(a)); }},
+    {E_GT, 0, -1, nullptr, [](vector<Expr> &a) { return Expr(new GreaterVar(a)); }},
+    {E_AND, 0, -1, nullptr, [](vector<Expr> &a) { return Expr(new AndVar(a)); }},
+    {E_OR, 0, -1, nullptr, [](vector<Expr> &a) { return Expr(new OrVar(a)); }},
+    {E_NOT, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Not(a[0])); }},
+    {E_CONS, 2, 2, nullptr, [](vector<Expr> &a) { return Expr(new Cons(a[0], a[1])); }},
+    {E_CAR, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Car(a[0])); }},
+    {E_CDR, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Cdr(a[0])); }},
+    {E_BOOLQ, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new IsBoolean(a[0])); }},
+    {E_INTQ, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new IsFixnum(a[0])); }},
+    {E_NULLQ, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new IsNull(a[0])); }},
+    {E_PAIRQ, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new IsPair(a[0])); }},
+    {E_PROCQ, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new IsProcedure(a[0])); }},
+    {E_SYMBOLQ, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new IsSymbol(a[0])); }},
+    {E_STRINGQ, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new IsString(a[0])); }},
+    {E_LISTQ, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new IsList(a[0])); }},
+    {E_EQQ, 2, 2, nullptr, [](vector<Expr> &a) { return Expr(new IsEq(a[0], a[1])); }},
+    {E_DISPLAY, 1, 1, nullptr, [](vector<Expr> &a) { return Expr(new Display(a[0])); }},
+    {E_SETCAR, 2, 2, nullptr, [](vector<Expr> &a) { return Expr(new SetCar(a[0], a[1])); }},
+    {E_SETCDR, 2, 2, nullptr, [](vector<Expr> &a) { return Expr(new SetCdr(a[0], a[1])); }},
+    {E_VOID, 0, 0, nullptr, [](vector<Expr> &) { return Expr(new MakeVoid()); }},
+    {E_EXIT, 0, 0, nullptr, [](vector<Expr> &) { return Expr(new Exit()); }},
+};
+
+static const PrimitiveForm &primitiveForm(ExprType type) {
+    static const vector<PrimitiveForm> by_type = [] {
+        vector<PrimitiveForm> v(E_DISPLAY + 1, PrimitiveForm{E_DISPLAY, 0, -1, nullptr, nullptr});
+        for (const PrimitiveForm &form : primitive_forms)
+            v[form.type] = form;
+        return v;
+    }();
+    return by_type[type];
+}
+
+// + - * /, whose variadic node folds its operands left to right. The
+// comparisons chain instead, sharing their middle operands, so three of
+// those stay one variadic node with its operands in the inline buffer.
+static bool isArithmeticFold(ExprType type) {
+    return type == E_PLUS || type == E_MINUS || type == E_MUL || type == E_DIV;
+}
+
+// isGlobalBound, noted down when the parse is being recorded for the cache
+static bool globalBoundAtParse(const Name &op) {
+    bool bound = isGlobalBound(op);
+    if (parse_dependencies) {
+        parse_dependencies->push_back(ParseDependency{op, bound});
+    }
+    return bound;
+}
 
 /**
  * @brief Default parse method (should be overridden by subclasses)
  */
-Expr Syntax::parse(Assoc &env) {
+Expr Syntax::parse(Assoc &env) const {
     // std::string type_name = typeid(*this).name();
     // throw RuntimeError("Unimplemented parse method for class: " + type_name);
     return ptr->parse(env);
@@ -42,12 +134,21 @@ Expr RationalSyntax::parse(Assoc &env) {
     return Expr(new RationalNum(numerator, denominator));
 }
 
+Expr BignumSyntax::parse(Assoc &) {
+    // The value is built once, like a quoted constant
+    return Expr(new Quote(Syntax(this)));
+}
+
+Expr FlonumSyntax::parse(Assoc &) {
+    return Expr(new Quote(Syntax(this)));
+}
+
 Expr SymbolSyntax::parse(Assoc &env) {
     return Expr(new Var(s));
 }
 
 Expr StringSyntax::parse(Assoc &env) {
-    return Expr(new StringExpr(s));
+    return Expr(new StringExpr(std::string(s, len)));
 }
 
 Expr TrueSyntax::parse(Assoc &env) {
@@ -60,7 +161,7 @@ Expr FalseSyntax::parse(Assoc &env) {
 
 Expr List::parse(Assoc &env) {
     if (stxs.empty()) {
-        return Expr(new Quote(Syntax(new List())));
+        return Expr(new Quote(Syntax(this)));
     }
 
     // TODO: check if the first element is a symbol
@@ -77,11 +178,14 @@ Expr List::parse(Assoc &env) {
         }
         return Expr(new Apply(rator, rands));
     } else {
-        string op = id->s;
+        Name op = id->s;
 
         // std::cout << op << '!' << std::endl;
 
-        if (find(op, env).get() != nullptr) {
+        // Only a keyword's meaning depends on what is bound; any other
+        // operator falls through to the application below
+        bool keyword = op->primitive >= 0 || op->reserved >= 0;
+        if (keyword && (find(op, env).v_type != V_UNBOUND || globalBoundAtParse(op))) {
             // 作为变量应用处理（如lambda参数if/begin/quote）
             // std::cout << op << "CNMB" << std::endl;
             Expr rator = stxs[0].parse(env);
@@ -93,7 +197,7 @@ Expr List::parse(Assoc &env) {
         }
 
         // Case 1: Check if it's a primitive operation
-        if (primitives.count(op) != 0) {
+        if (op->primitive >= 0) {
             vector<Expr> parameters;
             // TODO: TO COMPLETE THE PARAMETER PARSER LOGIC
             //  Parse all subsequent elements as parameters
@@ -101,180 +205,32 @@ Expr List::parse(Assoc &env) {
                 parameters.push_back(stxs[i].parse(env));
             }
 
-            ExprType op_type = primitives[op];
-            if (op_type == E_PLUS) {
-                // TODO: TO COMPLETE THE LOGIC
-                //  (+) => 0; (+ a) => a; (+ a b c...) => a + b + c + ...
-                return Expr(new PlusVar(parameters));
-            } else if (op_type == E_MINUS) {
-                // TODO: TO COMPLETE THE LOGIC
-                //  (- a) => 0 - a; (- a b c...) => a - b - c - ...
-                if (parameters.empty()) {
-                    throw RuntimeError("minus requires at least 1 argument");
-                }
-                return Expr(new MinusVar(parameters));
-            } else if (op_type == E_MUL) {
-                // TODO: TO COMPLETE THE LOGIC
-                //  (*) => 1; (* a) => a; (* a b c...) => a * b * c * ...
-                return Expr(new MultVar(parameters));
-            } else if (op_type == E_DIV) {
-                // TODO: TO COMPLETE THE LOGIC
-                //  (/ a) => 1 / a; (/ a b c...) => a / b / c / ...
-                if (parameters.empty()) {
-                    throw RuntimeError("division requires at least 1 argument");
-                }
-                return Expr(new DivVar(parameters));
-            } else if (op_type == E_MODULO) {
-                if (parameters.size() != 2) {
-                    throw RuntimeError("Wrong number of arguments for modulo");
-                }
-                return Expr(new Modulo(parameters[0], parameters[1]));
-            } else if (op_type == E_EXPT) {
-                // std::cout << "CNMB" << std::endl;
-                if (parameters.size() != 2) {
-                    throw RuntimeError("Wrong number of arguments for expt");
-                }
-                return Expr(new Expt(parameters[0], parameters[1]));
-            } else if (op_type == E_LIST) {
-                return Expr(new ListFunc(parameters));
-            } else if (op_type == E_LT) {
-                // TODO: TO COMPLETE THE LOGIC
-                //  (<) => #t; (< a) => #t; (< a b c...) => a < b < c < ...
-                return Expr(new LessVar(parameters));
-            } else if (op_type == E_LE) {
-                // TODO: TO COMPLETE THE LOGIC
-                //  (<=) => #t; (<= a) => #t; (<= a b c...) => a <= b <= c <= ...
-                return Expr(new LessEqVar(parameters));
-            } else if (op_type == E_EQ) {
-                // TODO: TO COMPLETE THE LOGIC
-                //  (=) => #t; (= a) => #t; (= a b c...) => a = b = c = ...
-                return Expr(new EqualVar(parameters));
-            } else if (op_type == E_GE) {
-                // TODO: TO COMPLETE THE LOGIC
-                //  (>=) => #t; (>= a) => #t; (>= a b c...) => a >= b >= c >= ...
-                return Expr(new GreaterEqVar(parameters));
-            } else if (op_type == E_GT) {
-                // TODO: TO COMPLETE THE LOGIC
-                //  (>) => #t; (>) => #t; (> a b c...) => a > b > c > ...
-                return Expr(new GreaterVar(parameters));
-            } else if (op_type == E_AND) {
-                return Expr(new AndVar(parameters));
-            } else if (op_type == E_OR) {
-                return Expr(new OrVar(parameters));
-            } else if (op_type == E_NOT) {
-                if (parameters.size() == 1) {
-                    return Expr(new Not(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for not");
-                }
-            } else if (op_type == E_CONS) {
-                if (parameters.size() == 2) {
-                    return Expr(new Cons(parameters[0], parameters[1]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for cons");
-                }
-            } else if (op_type == E_CAR) {
-                if (parameters.size() == 1) {
-                    return Expr(new Car(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for car");
-                }
-            } else if (op_type == E_CDR) {
-                if (parameters.size() == 1) {
-                    return Expr(new Cdr(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for cdr");
-                }
-            } else if (op_type == E_BOOLQ) {
-                if (parameters.size() == 1) {
-                    return Expr(new IsBoolean(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for boolean?");
-                }
-            } else if (op_type == E_INTQ) {
-                if (parameters.size() == 1) {
-                    return Expr(new IsFixnum(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for number?");
-                }
-            } else if (op_type == E_NULLQ) {
-                if (parameters.size() == 1) {
-                    return Expr(new IsNull(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for null?");
-                }
-            } else if (op_type == E_PAIRQ) {
-                if (parameters.size() == 1) {
-                    return Expr(new IsPair(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for pair?");
-                }
-            } else if (op_type == E_PROCQ) {
-                if (parameters.size() == 1) {
-                    return Expr(new IsProcedure(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for procedure?");
-                }
-            } else if (op_type == E_SYMBOLQ) {
-                if (parameters.size() == 1) {
-                    return Expr(new IsSymbol(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for symbol?");
-                }
-            } else if (op_type == E_STRINGQ) {
-                if (parameters.size() == 1) {
-                    return Expr(new IsString(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for string?");
-                }
-            } else if (op_type == E_EQQ) {
-                if (parameters.size() == 2) {
-                    return Expr(new IsEq(parameters[0], parameters[1]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for eq?");
-                }
-            } else if (op_type == E_DISPLAY) {
-                if (parameters.size() == 1) {
-                    return Expr(new Display(parameters[0]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for display");
-                }
-            } else if (op_type == E_SETCAR) {
-                // Added: Parse set-car! (2 arguments: pair + new-car)
-                if (parameters.size() == 2) {
-                    return Expr(new SetCar(parameters[0], parameters[1]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for set-car!");
-                }
-            } else if (op_type == E_SETCDR) {
-                // Added: Parse set-cdr! (2 arguments: pair + new-cdr)
-                if (parameters.size() == 2) {
-                    return Expr(new SetCdr(parameters[0], parameters[1]));
-                } else {
-                    throw RuntimeError("Wrong number of arguments for set-cdr!");
-                }
-            } else if (op_type == E_VOID) {
-                // Added: Parse void (0 arguments)
-                if (parameters.empty()) {
-                    return Expr(new MakeVoid());
-                } else {
-                    throw RuntimeError("Wrong number of arguments for void");
-                }
-            } else if (op_type == E_EXIT) {
-                // Added: Parse exit (0 arguments)
-                if (parameters.empty()) {
-                    return Expr(new Exit());
-                } else {
-                    throw RuntimeError("Wrong number of arguments for exit");
+            const PrimitiveForm &form = primitiveForm((ExprType)op->primitive);
+            if (form.make == nullptr) {
+                throw RuntimeError("Unsupported primitive operation: " + op.str());
+            }
+            int argc = (int)parameters.size();
+            if (argc < form.min_args || (form.max_args >= 0 && argc > form.max_args)) {
+                throw RuntimeError(form.arity_error ? form.arity_error : "Wrong number of arguments for " + op.str());
+            }
+            if (parameters.size() == 2) {
+                // Two operands go straight to the binary node where there is one,
+                // which evaluates them without an argument list
+                Expr binary = makeBinary(form.type, parameters[0], parameters[1]);
+                if (binary.get() != nullptr) {
+                    return binary;
                 }
-            } else {
-                throw RuntimeError("Unsupported primitive operation: " + op);
             }
+            if (parameters.size() == 3 && isArithmeticFold(form.type)) {
+                // (op a b c) is (op (op a b) c), the fold the variadic node does
+                return makeBinary(form.type, makeBinary(form.type, parameters[0], parameters[1]), parameters[2]);
+            }
+            return form.make(parameters);
         }
 
         // Case 2: Check if it's a reserved word
-        if (reserved_words.count(op) != 0) {
-            switch (reserved_words[op]) {
+        if (op->reserved >= 0) {
+            switch (op->reserved) {
             // TODO: TO COMPLETE THE reserve_words PARSER LOGIC
             case E_QUOTE: {
                 // (quote expr) must have exactly 1 argument
@@ -306,7 +262,7 @@ Expr List::parse(Assoc &env) {
                 }
 
                 // Parse parameters
-                vector<string> params;
+                vector<Name> params;
                 for (const auto &param_stx : param_list->stxs) {
                     SymbolSyntax *param_sym = dynamic_cast<SymbolSyntax *>(param_stx.get());
                     if (!param_sym) {
@@ -319,7 +275,7 @@ Expr List::parse(Assoc &env) {
                 // This ensures that parameter names (even if they match reserved words)
                 // are recognized as variables during body parsing
                 Assoc lambda_env = env; // Copy current environment
-                for (const string &param : params) {
+                for (const Name &param : params) {
                     // Temporarily bind parameter to environment (value is irrelevant here;
                     // we only need to mark that the name is bound)
                     lambda_env = extend(param, VoidV(), lambda_env);
@@ -373,7 +329,7 @@ Expr List::parse(Assoc &env) {
                     // std::cout << func_name_sym->s << '?' << std::endl;
 
                     // Parse parameters
-                    vector<string> params;
+                    vector<Name> params;
                     for (size_t i = 1; i < func_shorthand->stxs.size(); ++i) {
                         SymbolSyntax *param_sym = dynamic_cast<SymbolSyntax *>(func_shorthand->stxs[i].get());
                         if (!param_sym) {
@@ -422,8 +378,8 @@ Expr List::parse(Assoc &env) {
 
                 // Helper function to parse (var expr) binding pairs
                 // Evaluates the expression in the original environment (non-recursive)
-                auto parseBindings = [&](List *bindings_list) -> vector<pair<string, Expr>> {
-                    vector<pair<string, Expr>> bindings;
+                auto parseBindings = [&](List *bindings_list) -> vector<pair<Name, Expr>> {
+                    vector<pair<Name, Expr>> bindings;
                     for (auto &binding_stx : bindings_list->stxs) {
                         List *var_expr_pair = dynamic_cast<List *>(binding_stx.get());
                         if (!var_expr_pair || var_expr_pair->stxs.size() != 2) {
@@ -446,7 +402,7 @@ Expr List::parse(Assoc &env) {
                     throw RuntimeError("let bindings must be a list");
                 }
 
-                vector<pair<string, Expr>> bindings = parseBindings(bindings_list);
+                vector<pair<Name, Expr>> bindings = parseBindings(bindings_list);
 
                 // Critical fix: Create a temporary parsing environment to handle shadowing of special forms
                 // Add placeholder bindings for let variables to prioritize them over special forms/reserved words
@@ -473,8 +429,8 @@ Expr List::parse(Assoc &env) {
                 }
 
                 // Helper function to parse bindings
-                auto parseBindings = [&](List *bindings_list) -> vector<pair<string, Expr>> {
-                    vector<pair<string, Expr>> bindings;
+                auto parseBindings = [&](List *bindings_list) -> vector<pair<Name, Expr>> {
+                    vector<pair<Name, Expr>> bindings;
                     for (auto &binding_stx : bindings_list->stxs) {
                         List *var_expr_pair = dynamic_cast<List *>(binding_stx.get());
                         if (!var_expr_pair || var_expr_pair->stxs.size() != 2) {
@@ -496,7 +452,7 @@ Expr List::parse(Assoc &env) {
                     throw RuntimeError("letrec bindings must be a list");
                 }
 
-                vector<pair<string, Expr>> bindings = parseBindings(bindings_list);
+                vector<pair<Name, Expr>> bindings = parseBindings(bindings_list);
 
                 // Parse body (wrap multiple expressions with Begin)
                 vector<Expr> body_exprs;
@@ -521,7 +477,7 @@ Expr List::parse(Assoc &env) {
                 return Expr(new Set(var_sym->s, expr));
             }
             default:
-                throw RuntimeError("Unknown reserved word: " + op);
+                throw RuntimeError("Unknown reserved word: " + op.str());
             }
         }
 
@@ -0,0 +1,142 @@
+/**
+ * @file profile.cpp
+ * @brief Call counts, inclusive/self time and allocations per procedure
+ */
+
+#include "profile.hpp"
+#include "gc.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+bool profiling = false;
+
+typedef std::chrono::steady_clock Clock;
+
+struct ProfileEntry {
+    Name name;
+    size_t calls;
+    double total_us; ///< Inclusive time, counted once per outermost activation
+    double self_us;
+    size_t total_allocs;
+    size_t self_allocs;
+    int active; ///< Activations currently on the stack (recursion)
+};
+
+// Node of the call tree behind the folded-stack output
+struct PathNode {
+    int parent;
+    Name name;
+    double self_us;
+};
+
+struct Activation {
+    ProfileEntry *entry;
+    int path;
+    Clock::time_point start;
+    double child_us;
+    size_t start_allocs;
+    size_t child_allocs;
+};
+
+static std::unordered_map<const NameEntry *, ProfileEntry> entries;
+static std::vector<PathNode> paths;
+static std::map<std::pair<int, const NameEntry *>, int> path_index;
+static std::vector<Activation> stack;
+
+static int childPath(int parent, const Name &name) {
+    auto key = std::make_pair(parent, name.operator->());
+    auto it = path_index.find(key);
+    if (it != path_index.end())
+        return it->second;
+    paths.push_back(PathNode{parent, name, 0});
+    path_index.emplace(key, (int)paths.size() - 1);
+    return (int)paths.size() - 1;
+}
+
+void profileEnter(const Name &name) {
+    auto it = entries.find(name.operator->());
+    if (it == entries.end())
+        it = entries.emplace(name.operator->(), ProfileEntry{name, 0, 0, 0, 0, 0, 0}).first;
+    ProfileEntry *entry = &it->second;
+    ++entry->calls;
+    ++entry->active;
+    int parent = stack.empty() ? -1 : stack.back().path;
+    stack.push_back(Activation{entry, childPath(parent, name), Clock::now(), 0, gc_stats.allocated, 0});
+}
+
+void profileExit() {
+    Activation act = stack.back();
+    stack.pop_back();
+    double elapsed = std::chrono::duration<double, std::micro>(Clock::now() - act.start).count();
+    size_t allocs = gc_stats.allocated - act.start_allocs;
+
+    ProfileEntry *entry = act.entry;
+    entry->self_us += elapsed - act.child_us;
+    entry->self_allocs += allocs - act.child_allocs;
+    if (--entry->active == 0) {
+        // Only the outermost activation of a recursive procedure adds to its total
+        entry->total_us += elapsed;
+        entry->total_allocs += allocs;
+    }
+    paths[act.path].self_us += elapsed - act.child_us;
+
+    if (!stack.empty()) {
+        stack.back().child_us += elapsed;
+        stack.back().child_allocs += allocs;
+    }
+}
+
+size_t profileDepth() {
+    return stack.size();
+}
+
+void profileUnwind(size_t depth) {
+    while (stack.size() > depth)
+        profileExit();
+}
+
+void profileReport(std::ostream &os) {
+    std::vector<const ProfileEntry *> sorted;
+    for (const auto &it : entries)
+        sorted.push_back(&it.second);
+    std::sort(sorted.begin(), sorted.end(), [](const ProfileEntry *a, const ProfileEntry *b) {
+        return a->self_us > b->self_us;
+    });
+
+    os << std::fixed << std::setprecision(3);
+    os << std::setw(10) << "calls" << std::setw(14) << "total ms" << std::setw(14) << "self ms"
+       << std::setw(14) << "total alloc" << std::setw(14) << "self alloc" << "  procedure\n";
+    for (const ProfileEntry *e : sorted) {
+        os << std::setw(10) << e->calls << std::setw(14) << e->total_us / 1000 << std::setw(14)
+           << e->self_us / 1000 << std::setw(14) << e->total_allocs << std::setw(14) << e->self_allocs
+           << "  " << e->name.str() << '\n';
+    }
+    os.flush();
+}
+
+bool profileWriteFolded(const std::string &path) {
+    std::ofstream out(path);
+    if (!out)
+        return false;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        long long us = (long long)paths[i].self_us;
+        if (us <= 0)
+            continue;
+        // Collect the frames root-first
+        std::vector<int> frames;
+        for (int p = (int)i; p >= 0; p = paths[p].parent)
+            frames.push_back(p);
+        for (size_t j = frames.size(); j-- > 0;) {
+            out << paths[frames[j]].name.str();
+            if (j > 0)
+                out << ';';
+        }
+        out << ' ' << us << '\n';
+    }
+    return (bool)out;
+}
@@ -0,0 +1,48 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+/**
+ * @file profile.hpp
+ * @brief Procedure-level profiler enabled by the --profile flag
+ *
+ * Both backends report every procedure activation: profileEnter when a call
+ * starts and profileExit when the activation ends, either by returning or by
+ * handing off to a tail call, whose callee then takes its place on the
+ * profile stack just as it does on the real one. Activations are keyed by
+ * the name of the procedure's lambda (its define/let name, or
+ * "<enclosing>/lambda" when anonymous).
+ */
+
+#include "Def.hpp"
+#include <iostream>
+#include <string>
+
+extern bool profiling; ///< Set once at startup by --profile
+
+void profileEnter(const Name &);
+void profileExit();
+size_t profileDepth();
+void profileUnwind(size_t depth); ///< Close activations abandoned by an error
+
+// Flat report sorted by self time
+void profileReport(std::ostream &);
+// One line per call path with its self time in microseconds, the input
+// format of flamegraph.pl; returns false if the file cannot be written
+bool profileWriteFolded(const std::string &path);
+
+/**
+ * @brief Activation spanning a C++ scope (tree walker calls)
+ */
+struct ProfileScope {
+    bool active;
+    explicit ProfileScope(const Name &name) : active(profiling) {
+        if (active)
+            profileEnter(name);
+    }
+    ~ProfileScope() {
+        if (active)
+            profileExit();
+    }
+};
+
+#endif // PROFILE_HPP
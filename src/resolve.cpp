@@ -0,0 +1,374 @@
+/**
+ * @file resolve.cpp
+ * @brief Lexical addressing pass run between parsing and evaluation
+ *
+ * This file implements the resolve methods that turn variable names into
+ * runtime addresses. Every Var, Set and Define is assigned a (depth, index)
+ * pair into the frame chain, a capture of the running closure or a slot in
+ * the global table, and every frame-creating form (lambda, let, letrec)
+ * records how many slots its frame needs. Evaluation then never compares
+ * names.
+ *
+ * Closures are flat: each lambda lists its free variables and a closure
+ * copies just those values, so a call frame's chain ends at the lambda
+ * body. A captured variable that is also assigned is boxed when copied.
+ */
+
+#include "RE.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <cctype>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+// We request all valid variable just need to be a symbol, you should promise:
+// The first character of a variable name cannot be a digit or any character from the set: {.@}
+// If a string can be recognized as a number, it will be prioritized as a number. For example: 1, -1, +123, .123, +124., 1e-3
+// Variable names can overlap with primitives and reserve_words
+// Variable names can contain any non-whitespace characters except #, ', ", `, but the first character cannot be a digit
+static bool isValidVariableName(const std::string &x) {
+    if (x.empty() || (isdigit(x[0]) || x[0] == '.' || x[0] == '@')) {
+        return false;
+    }
+
+    // No forbidden characters (#, ', ", `)
+    const std::string forbidden_chars = "#'\"`";
+    for (char c : x) {
+        if (forbidden_chars.find(c) != std::string::npos) {
+            return false;
+        }
+    }
+
+    // Reject names that can be recognized as numbers (prioritized as literals)
+    size_t i = 0;
+    if (x[i] == '+' || x[i] == '-')
+        i++; // Sign
+    bool has_digit = false;
+    bool has_dot = false;
+    bool has_exponent = false;
+    while (i < x.size()) {
+        if (isdigit(x[i])) {
+            has_digit = true;
+        } else if (x[i] == '.') {
+            if (has_dot || has_exponent)
+                return true;
+            has_dot = true;
+        } else if (x[i] == 'e' || x[i] == 'E') {
+            if (has_exponent || !has_digit)
+                return true;
+            has_exponent = true;
+            // Exponent must be followed by sign or digit
+            if (++i >= x.size() || (!isdigit(x[i]) && x[i] != '+' && x[i] != '-')) {
+                return true;
+            }
+            if (x[i] == '+' || x[i] == '-')
+                i++; // Exponent sign
+            if (i >= x.size() || !isdigit(x[i]))
+                return true;
+        } else {
+            return true; // Not numeric, so an ordinary name
+        }
+        i++;
+    }
+    // "." or "+." are names; anything with a digit here is a number
+    return !has_digit;
+}
+
+// Index of the innermost binding of x in this scope, or -1
+static int indexIn(const Scope *scope, const Name &x) {
+    for (int i = (int)scope->names.size() - 1; i >= 0; --i) {
+        if (scope->names[i] == x)
+            return i;
+    }
+    return -1;
+}
+
+// Usage record of slot index in scope
+static SlotUse &useOf(Scope *scope, int index) {
+    if ((int)scope->uses.size() <= index)
+        scope->uses.resize(scope->names.size());
+    return scope->uses[index];
+}
+
+// Index of x among the free variables of lambda, adding it with the given
+// source if it is new. bound/slot identify the binding the source ends at.
+static int capture(Lambda *lambda, const Name &x, VarKind kind, int depth, int index, Scope *bound, int slot) {
+    for (size_t i = 0; i < lambda->free.size(); ++i) {
+        if (lambda->free[i].name == x)
+            return (int)i;
+    }
+    lambda->free.push_back(FreeVar{x, kind, depth, index, false});
+    if (kind == VK_LOCAL)
+        useOf(bound, slot).captures.emplace_back(lambda, (int)lambda->free.size() - 1);
+    return (int)lambda->free.size() - 1;
+}
+
+/**
+ * @brief Locate x from scope
+ *
+ * Returns VK_LOCAL with depth/index filled in while x is bound inside the
+ * innermost lambda, VK_FREE with the capture index if it is bound by an
+ * enclosing one (each lambda crossed captures it in turn), or falls back to
+ * a global slot. bound/slot are set to the binding scope and its slot, or
+ * nullptr for a global.
+ */
+static VarKind lookup(Scope *scope, const Name &x, int &depth, int &index, Scope *&bound, int &slot) {
+    depth = 0;
+    for (Scope *s = scope; s != nullptr; s = s->parent, ++depth) {
+        index = indexIn(s, x);
+        if (index >= 0) {
+            bound = s;
+            slot = index;
+            return VK_LOCAL;
+        }
+        if (s->lambda != nullptr) {
+            int outer_depth, outer_index;
+            VarKind kind = lookup(s->parent, x, outer_depth, outer_index, bound, slot);
+            depth = 0;
+            if (kind == VK_GLOBAL) {
+                index = outer_index;
+                return VK_GLOBAL;
+            }
+            useOf(bound, slot).captured = true;
+            index = capture(s->lambda, x, kind, outer_depth, outer_index, bound, slot);
+            return VK_FREE;
+        }
+    }
+    depth = 0;
+    index = globalSlot(x);
+    bound = nullptr;
+    slot = -1;
+    return VK_GLOBAL;
+}
+
+// Add x to the frame described by scope unless it is already there
+static int declare(Scope *scope, const Name &x) {
+    int index = indexIn(scope, x);
+    if (index >= 0)
+        return index;
+    scope->names.push_back(x);
+    return (int)scope->names.size() - 1;
+}
+
+// Once the body of scope is resolved: a slot that is both captured and
+// assigned must be shared through a box by the closures that copy it
+static void closeScope(Scope *scope) {
+    for (size_t i = 0; i < scope->uses.size(); ++i) {
+        const SlotUse &use = scope->uses[i];
+        if (use.assigned && use.captured) {
+            for (const auto &c : use.captures)
+                c.first->free[c.second].boxed = true;
+        }
+    }
+}
+
+/**
+ * @brief Pre-declare internal defines that belong to the frame being opened
+ *
+ * A define anywhere in a body binds in the frame of that body, so names must
+ * be allocated before the body is resolved; otherwise a reference that
+ * precedes its define (mutual recursion) would resolve to an outer binding.
+ * Nested lambda/let/letrec bodies open frames of their own and are skipped.
+ */
+static void collectDefines(ExprBase *expr, Scope *scope) {
+    if (expr == nullptr)
+        return;
+    if (auto def = dynamic_cast<Define *>(expr)) {
+        declare(scope, def->var);
+        collectDefines(def->e.get(), scope);
+    } else if (auto begin = dynamic_cast<Begin *>(expr)) {
+        for (auto &e : begin->es)
+            collectDefines(e.get(), scope);
+    } else if (auto if_expr = dynamic_cast<If *>(expr)) {
+        collectDefines(if_expr->cond.get(), scope);
+        collectDefines(if_expr->conseq.get(), scope);
+        collectDefines(if_expr->alter.get(), scope);
+    } else if (auto cond = dynamic_cast<Cond *>(expr)) {
+        for (auto &clause : cond->clauses)
+            for (auto &e : clause)
+                collectDefines(e.get(), scope);
+    } else if (auto and_expr = dynamic_cast<AndVar *>(expr)) {
+        for (auto &e : and_expr->rands)
+            collectDefines(e.get(), scope);
+    } else if (auto or_expr = dynamic_cast<OrVar *>(expr)) {
+        for (auto &e : or_expr->rands)
+            collectDefines(e.get(), scope);
+    } else if (auto apply = dynamic_cast<Apply *>(expr)) {
+        collectDefines(apply->rator.get(), scope);
+        for (auto &e : apply->rand)
+            collectDefines(e.get(), scope);
+    } else if (auto unary = dynamic_cast<Unary *>(expr)) {
+        collectDefines(unary->rand.get(), scope);
+    } else if (auto binary = dynamic_cast<Binary *>(expr)) {
+        collectDefines(binary->rand1.get(), scope);
+        collectDefines(binary->rand2.get(), scope);
+    } else if (auto variadic = dynamic_cast<Variadic *>(expr)) {
+        for (auto &e : variadic->rands)
+            collectDefines(e.get(), scope);
+    } else if (auto set = dynamic_cast<Set *>(expr)) {
+        collectDefines(set->e.get(), scope);
+    } else if (auto let = dynamic_cast<Let *>(expr)) {
+        // Initializers run in the enclosing frame; the body has its own
+        for (auto &b : let->bind)
+            collectDefines(b.second.get(), scope);
+    }
+}
+
+// Give a lambda bound by define/let/letrec the name it is bound to
+static void nameLambda(const Expr &expr, const Name &name) {
+    if (auto lambda = dynamic_cast<Lambda *>(expr.get()))
+        lambda->name = name;
+}
+
+// Names of the lambdas whose bodies are being resolved, innermost last
+static std::vector<Name> enclosing_lambdas;
+
+// ============================================================================
+// Resolve methods
+// ============================================================================
+
+void ExprBase::resolve(Scope *) {} // literals have nothing to resolve
+
+void Unary::resolve(Scope *scope) {
+    rand->resolve(scope);
+}
+
+void Binary::resolve(Scope *scope) {
+    rand1->resolve(scope);
+    rand2->resolve(scope);
+}
+
+void Variadic::resolve(Scope *scope) {
+    for (auto &r : rands)
+        r->resolve(scope);
+}
+
+void AndVar::resolve(Scope *scope) {
+    for (auto &r : rands)
+        r->resolve(scope);
+}
+
+void OrVar::resolve(Scope *scope) {
+    for (auto &r : rands)
+        r->resolve(scope);
+}
+
+void Begin::resolve(Scope *scope) {
+    for (auto &expr : es)
+        expr->resolve(scope);
+}
+
+void If::resolve(Scope *scope) {
+    cond->resolve(scope);
+    conseq->resolve(scope);
+    if (alter.get() != nullptr)
+        alter->resolve(scope);
+}
+
+void Cond::resolve(Scope *scope) {
+    for (auto &clause : clauses)
+        for (auto &expr : clause)
+            expr->resolve(scope);
+}
+
+void Var::resolve(Scope *scope) {
+    if (!isValidVariableName(x.str())) {
+        kind = VK_INVALID;
+        return;
+    }
+    Scope *bound;
+    int slot;
+    kind = lookup(scope, x, depth, index, bound, slot);
+}
+
+void Apply::resolve(Scope *scope) {
+    rator->resolve(scope);
+    Var *var = dynamic_cast<Var *>(rator.get());
+    cell = (var != nullptr && var->kind == VK_GLOBAL) ? &globalValue(var->index) : nullptr;
+    linked.reset();
+    for (auto &r : rand)
+        r->resolve(scope);
+}
+
+void Lambda::resolve(Scope *scope) {
+    static const Name anonymous("lambda");
+    if (name == anonymous && !enclosing_lambdas.empty())
+        name = Name(enclosing_lambdas.back().str() + "/lambda");
+    enclosing_lambdas.push_back(name);
+
+    free.clear();
+    Scope body_scope(scope, this);
+    body_scope.names = x;
+    collectDefines(e.get(), &body_scope);
+    e->resolve(&body_scope);
+    closeScope(&body_scope);
+    frame_size = (int)body_scope.names.size();
+
+    LambdaTemplate *old = tmpl;
+    tmpl = new LambdaTemplate(x, e, frame_size, (int)free.size(), name);
+    gcRetain(tmpl);
+    gcRelease(old);
+
+    enclosing_lambdas.pop_back();
+}
+
+void Define::resolve(Scope *scope) {
+    // The name is bound before the value is resolved so that recursive
+    // references inside a lambda body find this binding
+    if (scope == nullptr) {
+        kind = VK_GLOBAL;
+        index = globalSlot(var);
+    } else {
+        kind = VK_LOCAL;
+        index = declare(scope, var);
+        useOf(scope, index).assigned = true;
+    }
+    nameLambda(e, var);
+    e->resolve(scope);
+}
+
+void Let::resolve(Scope *scope) {
+    // Initializers are evaluated in the enclosing environment
+    for (auto &b : bind) {
+        nameLambda(b.second, b.first);
+        b.second->resolve(scope);
+    }
+    Scope body_scope(scope);
+    for (auto &b : bind)
+        body_scope.names.push_back(b.first);
+    collectDefines(body.get(), &body_scope);
+    body->resolve(&body_scope);
+    closeScope(&body_scope);
+    frame_size = (int)body_scope.names.size();
+}
+
+void Letrec::resolve(Scope *scope) {
+    // Initializers see the new frame so they can refer to each other
+    Scope body_scope(scope);
+    for (auto &b : bind)
+        body_scope.names.push_back(b.first);
+    for (auto &b : bind)
+        collectDefines(b.second.get(), &body_scope);
+    collectDefines(body.get(), &body_scope);
+    for (size_t i = 0; i < bind.size(); ++i) {
+        useOf(&body_scope, (int)i).assigned = true; // placeholder until its initializer runs
+        nameLambda(bind[i].second, bind[i].first);
+        bind[i].second->resolve(&body_scope);
+    }
+    body->resolve(&body_scope);
+    closeScope(&body_scope);
+    frame_size = (int)body_scope.names.size();
+}
+
+void Set::resolve(Scope *scope) {
+    Scope *bound;
+    int slot;
+    kind = lookup(scope, var, depth, index, bound, slot);
+    if (bound != nullptr)
+        useOf(bound, slot).assigned = true;
+    e->resolve(scope);
+}
@@ -1,11 +1,24 @@
 #include "syntax.hpp"
+#include "RE.hpp"
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstddef>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 Syntax::Syntax(SyntaxBase *stx) : ptr(stx) {}
-SyntaxBase *Syntax::operator->() const { return ptr.get(); }
-SyntaxBase &Syntax::operator*() { return *ptr; }
-SyntaxBase *Syntax::get() const { return ptr.get(); }
+SyntaxBase *Syntax::operator->() const { return ptr; }
+SyntaxBase &Syntax::operator*() const { return *ptr; }
+SyntaxBase *Syntax::get() const { return ptr; }
 
 Number::Number(int n) : n(n) {}
 void Number::show(std::ostream &os) {
@@ -17,6 +30,16 @@ void RationalSyntax::show(std::ostream &os) {
     os << numerator << "/" << denominator;
 }
 
+BignumSyntax::BignumSyntax(const char *s, size_t len) : s(s), len(len) {}
+void BignumSyntax::show(std::ostream &os) {
+    os.write(s, len);
+}
+
+FlonumSyntax::FlonumSyntax(double d) : d(d) {}
+void FlonumSyntax::show(std::ostream &os) {
+    os << d;
+}
+
 void TrueSyntax::show(std::ostream &os) {
     os << "#t";
 }
@@ -25,17 +48,20 @@ void FalseSyntax::show(std::ostream &os) {
     os << "#f";
 }
 
-SymbolSyntax::SymbolSyntax(const std::string &s1) : s(s1) {}
+SymbolSyntax::SymbolSyntax(const Name &s1) : s(s1) {}
 void SymbolSyntax::show(std::ostream &os) {
-    os << s;
+    os << s.str();
 }
 
-StringSyntax::StringSyntax(const std::string &s1) : s(s1) {}
+StringSyntax::StringSyntax(const char *s1, size_t len) : s(s1), len(len) {}
 void StringSyntax::show(std::ostream &os) {
-    os << "\"" << s << "\"";
+    os << "\"";
+    os.write(s, len);
+    os << "\"";
 }
 
-List::List() {}
+List::List() : stxs{nullptr, 0} {}
+List::List(const Syntax *items, size_t n) : stxs{items, n} {}
 void List::show(std::ostream &os) {
     os << '(';
     for (auto stx : stxs) {
@@ -45,36 +71,230 @@ void List::show(std::ostream &os) {
     os << ')';
 }
 
-std::istream &readSpace(std::istream &is) {
+// ============================================================================
+// Syntax arena
+// ============================================================================
+
+static const size_t kArenaBlock = 32 * 1024;
+static const size_t kArenaAlign = alignof(std::max_align_t);
+
+SyntaxArena::SyntaxArena() : current(0), next(nullptr), end(nullptr) {}
+
+SyntaxArena::~SyntaxArena() {
+    reset();
+    for (char *block : blocks)
+        delete[] block;
+}
+
+void *SyntaxArena::allocate(size_t size) {
+    size = (size + kArenaAlign - 1) & ~(kArenaAlign - 1);
+    if (size > kArenaBlock / 4) {
+        large.push_back(new char[size]);
+        return large.back();
+    }
+    if ((size_t)(end - next) < size) {
+        // Move to the next block, reusing one left from an earlier form
+        if (next != nullptr)
+            ++current;
+        if (current == blocks.size())
+            blocks.push_back(new char[kArenaBlock]);
+        next = blocks[current];
+        end = next + kArenaBlock;
+    }
+    void *p = next;
+    next += size;
+    return p;
+}
+
+const char *SyntaxArena::copy(const char *s, size_t len) {
+    char *p = static_cast<char *>(allocate(len + 1));
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+void SyntaxArena::reset() {
+    for (char *block : large)
+        delete[] block;
+    large.clear();
+    current = 0;
+    next = blocks.empty() ? nullptr : blocks[0];
+    end = blocks.empty() ? nullptr : blocks[0] + kArenaBlock;
+}
+
+// ============================================================================
+// Source buffer
+// ============================================================================
+
+static const size_t kBlockSize = 64 * 1024;
+
+Source::Source(int fd) : data(nullptr), pos(0), len(0), fd(fd), map(nullptr) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        // Map from the current offset so input already consumed stays consumed
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        if (offset >= 0 && offset < st.st_size) {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                map = p;
+                data = static_cast<const char *>(p);
+                pos = offset;
+                len = st.st_size;
+                this->fd = -1;
+            }
+        }
+    }
+}
+
+Source::Source(const std::string &text) : pos(0), len(text.size()), fd(-1), map(nullptr), buffer(text) {
+    data = buffer.data();
+}
+
+Source::~Source() {
+    if (map)
+        munmap(map, len);
+}
+
+bool Source::fill() {
+    if (fd < 0)
+        return false;
+    buffer.resize(len + kBlockSize);
+    ssize_t n;
+    do {
+        n = read(fd, &buffer[len], kBlockSize);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0)
+        len += n;
+    else
+        fd = -1;
+    buffer.resize(len);
+    data = buffer.data(); // resizing may have moved the buffer
+    return n > 0;
+}
+
+void Source::discard() {
+    if (map || pos < kBlockSize)
+        return;
+    buffer.erase(0, pos);
+    len -= pos;
+    pos = 0;
+    data = buffer.data();
+}
+
+// ============================================================================
+// Scanning
+// ============================================================================
+
+// isspace in the C locale, without the locale lookup
+static inline bool isSpace(int c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Bytes that end a token
+static inline bool isDelimiter(int c) {
+    return c == '(' || c == ')' || c == '[' || c == ']' || c == ';' || isSpace(c);
+}
+
+/**
+ * @brief Length of the run of token bytes at p (at most n)
+ *
+ * With SSE2, 16 bytes are tested at a time against a superset of the
+ * delimiters (every byte up to ' ' and the five punctuation characters);
+ * only a block with a candidate is looked at byte by byte.
+ */
+static size_t scanToken(const char *p, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i low = _mm_set1_epi8(' ');
+    const __m128i paren = _mm_set1_epi8(')'); // '(' | 1 == ')'
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i open_bracket = _mm_set1_epi8('[');
+    const __m128i close_bracket = _mm_set1_epi8(']');
+    const __m128i semicolon = _mm_set1_epi8(';');
+    while (i + 16 <= n) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i hit = _mm_cmpeq_epi8(_mm_min_epu8(b, low), b);
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_or_si128(b, one), paren));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(b, open_bracket));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(b, close_bracket));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(b, semicolon));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask == 0) {
+            i += 16;
+            continue;
+        }
+        i += __builtin_ctz(mask);
+        if (isDelimiter((unsigned char)p[i]))
+            return i;
+        ++i; // a control character that is not whitespace
+    }
+#endif
+    while (i < n && !isDelimiter((unsigned char)p[i]))
+        ++i;
+    return i;
+}
+
+// Length of the run at p (at most n) containing no '"' or '\\'
+static size_t scanStringChars(const char *p, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while (i + 16 <= n) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(b, quote), _mm_cmpeq_epi8(b, backslash)));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+        i += 16;
+    }
+#endif
+    while (i < n && p[i] != '"' && p[i] != '\\')
+        ++i;
+    return i;
+}
+
+Source &readSpace(Source &src) {
     while (true) {
         // 跳过空白字符
-        while (isspace(is.peek()))
-            is.get();
+        while (isSpace(src.peek()))
+            ++src.pos;
 
         // 检查是否是注释
-        if (is.peek() == ';') {
+        if (src.peek() == ';') {
             // 跳过注释直到行末
-            while (is.peek() != '\n' && is.peek() != EOF)
-                is.get();
+            while (true) {
+                const char *nl = static_cast<const char *>(memchr(src.data + src.pos, '\n', src.len - src.pos));
+                if (nl) {
+                    src.pos = nl - src.data;
+                    break;
+                }
+                src.pos = src.len;
+                if (!src.fill())
+                    break;
+            }
             // 继续循环以跳过注释后的空白字符
         } else {
             // 没有更多空白字符或注释，退出循环
             break;
         }
     }
-    return is;
+    return src;
 }
 
-Syntax readList(std::istream &is);
+Syntax readList(Source &src, SyntaxArena &arena);
+
+// Elements of the lists being read, innermost list last; a finished list
+// moves its own elements into the arena
+static std::vector<Syntax> pending_elements;
 
 // Helper function to try parsing as integer or rational
-bool tryParseNumber(const std::string &s, int &result) {
+bool tryParseNumber(const char *s, size_t len, int &result) {
     bool neg = false;
-    int n = 0;
-    int i = 0;
+    long long n = 0;
+    size_t i = 0;
 
-    // Single '+' or '-' are not numbers
-    if (s.size() == 1 && (s[0] == '+' || s[0] == '-'))
+    // An empty token and a lone '+' or '-' are not numbers
+    if (len == 0 || (len == 1 && (s[0] == '+' || s[0] == '-')))
         return false;
 
     // Handle sign
@@ -85,151 +305,259 @@ bool tryParseNumber(const std::string &s, int &result) {
         i += 1;
     }
 
-    // Check if all remaining characters are digits
-    for (; i < s.size(); i++) {
+    // Check if all remaining characters are digits; a value outside the int
+    // range is left to isExactNumber
+    long long limit = neg ? -(long long)INT_MIN : INT_MAX;
+    for (; i < len; i++) {
         if ('0' <= s[i] && s[i] <= '9') {
             n = n * 10 + s[i] - '0';
+            if (n > limit) {
+                return false;
+            }
         } else {
             return false; // Not a valid number
         }
     }
 
-    result = neg ? -n : n;
+    result = (int)(neg ? -n : n);
     return true;
 }
 
+// Whether [s, s + len) is a run of at least one digit
+static bool isDigits(const char *s, size_t len) {
+    if (len == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Integer or ratio syntax of any size: [sign] digits [/ digits], with a
+// nonzero denominator
+static bool isExactNumber(const char *s, size_t len) {
+    if (len > 0 && (s[0] == '-' || s[0] == '+')) {
+        s++;
+        len--;
+    }
+    const char *slash = static_cast<const char *>(memchr(s, '/', len));
+    if (slash == nullptr) {
+        return isDigits(s, len);
+    }
+    size_t num_len = slash - s, den_len = len - num_len - 1;
+    if (!isDigits(s, num_len) || !isDigits(slash + 1, den_len)) {
+        return false;
+    }
+    for (size_t i = 0; i < den_len; i++) {
+        if (slash[1 + i] != '0') {
+            return true;
+        }
+    }
+    return false;
+}
+
 // Helper function to try parsing as rational number
-bool tryParseRational(const std::string &s, int &numerator, int &denominator) {
-    size_t slash_pos = s.find('/');
-    if (slash_pos == std::string::npos || slash_pos == 0 || slash_pos == s.size() - 1) {
+bool tryParseRational(const char *s, size_t len, int &numerator, int &denominator) {
+    const char *slash = static_cast<const char *>(memchr(s, '/', len));
+    if (slash == nullptr || slash == s || slash == s + len - 1) {
         return false; // No slash or slash at beginning/end
     }
-
-    std::string num_str = s.substr(0, slash_pos);
-    std::string den_str = s.substr(slash_pos + 1);
+    size_t slash_pos = slash - s;
 
     // Parse numerator (can be negative)
-    if (!tryParseNumber(num_str, numerator)) {
+    if (!tryParseNumber(s, slash_pos, numerator)) {
         return false;
     }
 
     // Parse denominator (must be positive)
-    if (!tryParseNumber(den_str, denominator) || denominator <= 0) {
+    if (!tryParseNumber(slash + 1, len - slash_pos - 1, denominator) || denominator <= 0) {
         return false;
     }
 
     return true;
 }
 
+// Decimal syntax: [sign] digits [. digits] [e [sign] digits], with a '.' or
+// an exponent (else it is an integer) and at least one mantissa digit;
+// also the +inf.0, -inf.0 and +nan.0 that flonums print as
+static bool tryParseFlonum(const char *s, size_t len, double &result) {
+    if (len == 6 && (memcmp(s, "+inf.0", 6) == 0 || memcmp(s, "-inf.0", 6) == 0 || memcmp(s, "+nan.0", 6) == 0)) {
+        result = s[1] == 'n' ? NAN : s[0] == '-' ? -INFINITY : INFINITY;
+        return true;
+    }
+    size_t i = 0;
+    if (i < len && (s[i] == '+' || s[i] == '-'))
+        i++;
+    size_t digits = 0;
+    for (; i < len && '0' <= s[i] && s[i] <= '9'; i++)
+        digits++;
+    bool inexact = false;
+    if (i < len && s[i] == '.') {
+        inexact = true;
+        for (i++; i < len && '0' <= s[i] && s[i] <= '9'; i++)
+            digits++;
+    }
+    if (digits == 0)
+        return false;
+    if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+        inexact = true;
+        i++;
+        if (i < len && (s[i] == '+' || s[i] == '-'))
+            i++;
+        size_t exponent_digits = 0;
+        for (; i < len && '0' <= s[i] && s[i] <= '9'; i++)
+            exponent_digits++;
+        if (exponent_digits == 0)
+            return false;
+    }
+    if (i != len || !inexact)
+        return false;
+    result = strtod(std::string(s, len).c_str(), nullptr);
+    return true;
+}
+
 // Helper function to create identifier/symbol syntax
-Syntax createIdentifierSyntax(const std::string &s) {
-    if (s == "#t")
-        return Syntax(new TrueSyntax());
-    if (s == "#f")
-        return Syntax(new FalseSyntax());
-    return Syntax(new SymbolSyntax(s));
+Syntax createIdentifierSyntax(const char *s, size_t len, SyntaxArena &arena) {
+    if (len == 2 && s[0] == '#' && s[1] == 't')
+        return Syntax(arena.make<TrueSyntax>());
+    if (len == 2 && s[0] == '#' && s[1] == 'f')
+        return Syntax(arena.make<FalseSyntax>());
+    return Syntax(arena.make<SymbolSyntax>(std::string(s, len)));
+}
+
+Syntax readString(Source &src, SyntaxArena &arena) {
+    std::string str;
+    while (true) {
+        size_t run = scanStringChars(src.data + src.pos, src.len - src.pos);
+        str.append(src.data + src.pos, run);
+        src.pos += run;
+        int c = src.peek();
+        if (c == '"') {
+            ++src.pos; // 消费结束的双引号
+            break;
+        }
+        if (c == EOF)
+            throw RuntimeError("unexpected end of input");
+        if (c != '\\')
+            continue; // the run stopped at the end of a block
+        // 处理转义字符
+        ++src.pos;
+        int next = src.get();
+        switch (next) {
+        case 'n':
+            str.push_back('\n');
+            break;
+        case 't':
+            str.push_back('\t');
+            break;
+        case 'r':
+            str.push_back('\r');
+            break;
+        case EOF:
+            throw RuntimeError("unexpected end of input");
+        default: // '\\', '"' and unknown escapes stand for themselves
+            str.push_back(next);
+            break;
+        }
+    }
+    return Syntax(arena.make<StringSyntax>(arena.copy(str.data(), str.size()), str.size()));
 }
 
 // no leading space
-Syntax readItem(std::istream &is) {
-    if (is.peek() == '(' || is.peek() == '[') {
-        is.get();
-        return readList(is);
+Syntax readItem(Source &src, SyntaxArena &arena) {
+    int c = src.peek();
+    if (c == '(' || c == '[') {
+        ++src.pos;
+        return readList(src, arena);
     }
-    if (is.peek() == '\'') {
-        is.get();
+    if (c == '\'') {
+        ++src.pos;
         // 读取单引号后的语法元素
-        Syntax quoted_syntax = readItem(is);
+        Syntax quoted_syntax = readItem(readSpace(src), arena);
 
         // 创建 (quote <syntax>) 的列表结构
-        List *quote_list = new List();
-        quote_list->stxs.push_back(Syntax(new SymbolSyntax("quote")));
-        quote_list->stxs.push_back(quoted_syntax);
+        static const Name quote_name("quote");
+        Syntax *items = static_cast<Syntax *>(arena.allocate(2 * sizeof(Syntax)));
+        new (&items[0]) Syntax(arena.make<SymbolSyntax>(quote_name));
+        new (&items[1]) Syntax(quoted_syntax);
 
-        return Syntax(quote_list);
+        return Syntax(arena.make<List>(items, 2));
     }
     // 处理字符串字面量
-    if (is.peek() == '"') {
-        is.get(); // 消费开始的双引号
-        std::string str;
-        while (is.peek() != '"' && is.peek() != EOF) {
-            char c = is.get();
-            if (c == '\\') {
-                // 处理转义字符
-                char next = is.get();
-                switch (next) {
-                case 'n':
-                    str.push_back('\n');
-                    break;
-                case 't':
-                    str.push_back('\t');
-                    break;
-                case 'r':
-                    str.push_back('\r');
-                    break;
-                case '\\':
-                    str.push_back('\\');
-                    break;
-                case '"':
-                    str.push_back('"');
-                    break;
-                default:
-                    str.push_back(next);
-                    break;
-                }
-            } else {
-                str.push_back(c);
-            }
-        }
-        if (is.peek() == '"') {
-            is.get(); // 消费结束的双引号
-        }
-        return Syntax(new StringSyntax(str));
+    if (c == '"') {
+        ++src.pos; // 消费开始的双引号
+        return readString(src, arena);
     }
 
-    // Read token
-    std::string s;
-    do {
-        int c = is.peek();
-        if (c == '(' || c == ')' ||
-            c == '[' || c == ']' ||
-            c == ';' || // 添加分号作为分隔符
-            isspace(c) ||
-            c == EOF)
+    // Read token; offsets survive the buffer growing under a block read
+    size_t start = src.pos;
+    while (true) {
+        src.pos += scanToken(src.data + src.pos, src.len - src.pos);
+        if (src.pos < src.len || !src.fill())
             break;
-        is.get();
-        s.push_back(c);
-    } while (true);
+    }
+    const char *s = src.data + start;
+    size_t len = src.pos - start;
+    if (c == EOF) // a quote with nothing after it
+        throw RuntimeError("unexpected end of input");
+    if (len == 0) {
+        // A stray ')' or ']'; consume it so the reader makes progress
+        ++src.pos;
+    }
 
     // Try parsing as rational first
     int numerator, denominator;
-    if (tryParseRational(s, numerator, denominator)) {
-        return Syntax(new RationalSyntax(numerator, denominator));
+    if (tryParseRational(s, len, numerator, denominator)) {
+        return Syntax(arena.make<RationalSyntax>(numerator, denominator));
     }
 
     // Try parsing as integer
     int number_value;
-    if (tryParseNumber(s, number_value)) {
-        return Syntax(new Number(number_value));
+    if (tryParseNumber(s, len, number_value)) {
+        return Syntax(arena.make<Number>(number_value));
     }
 
-    // Not a number, treat as identifier/symbol
-    return createIdentifierSyntax(s);
-}
+    // An integer or ratio too large for the forms above
+    if (isExactNumber(s, len)) {
+        return Syntax(arena.make<BignumSyntax>(arena.copy(s, len), len));
+    }
+
+    double flonum_value;
+    if (tryParseFlonum(s, len, flonum_value)) {
+        return Syntax(arena.make<FlonumSyntax>(flonum_value));
+    }
 
-Syntax readList(std::istream &is) {
-    List *stx = new List();
-    while (readSpace(is).peek() != ')' && readSpace(is).peek() != ')')
-        stx->stxs.push_back(readItem(is));
-    is.get(); // ')'
-    return Syntax(stx);
+    // Not a number, treat as identifier/symbol
+    return createIdentifierSyntax(s, len, arena);
 }
 
-Syntax readSyntax(std::istream &is) {
-    return readItem(readSpace(is));
+Syntax readList(Source &src, SyntaxArena &arena) {
+    size_t first = pending_elements.size();
+    int c;
+    while ((c = readSpace(src).peek()) != ')' && c != ']' && c != EOF) {
+        Syntax item = readItem(src, arena);
+        pending_elements.push_back(item);
+    }
+    if (c == EOF)
+        throw RuntimeError("unexpected end of input");
+    ++src.pos; // ')' or ']'
+
+    size_t n = pending_elements.size() - first;
+    Syntax *items = nullptr;
+    if (n > 0) {
+        items = static_cast<Syntax *>(arena.allocate(n * sizeof(Syntax)));
+        for (size_t i = 0; i < n; ++i)
+            new (&items[i]) Syntax(pending_elements[first + i]);
+    }
+    pending_elements.resize(first, Syntax(nullptr));
+    return Syntax(arena.make<List>(items, n));
 }
 
-std::istream &operator>>(std::istream &is, Syntax &stx) {
-    stx = readSyntax(is);
-    return is;
+Syntax readSyntax(Source &src, SyntaxArena &arena) {
+    src.discard();
+    pending_elements.clear(); // left over if an earlier read threw
+    return readItem(readSpace(src), arena);
 }
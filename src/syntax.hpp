@@ -1,24 +1,64 @@
 #ifndef SYNTAX 
 #define SYNTAX
 
+#include <cstdio>
 #include <cstring>
+#include <iterator>
 #include <memory>
+#include <new>
+#include <string>
+#include <utility>
 #include <vector>
 #include "Def.hpp"
 
+/**
+ * @brief Bump allocator holding the Syntax tree of one top-level form
+ *
+ * Nodes are carved from large blocks and never destroyed one by one: no
+ * node owns memory outside the arena (list elements and string text live in
+ * it too), so reset() reclaims a whole tree at once. The parser copies what
+ * it keeps (names are interned, quoted data becomes values), which lets the
+ * caller reset the arena as soon as a form is parsed. Blocks are reused by
+ * the next form.
+ */
+class SyntaxArena {
+public:
+    SyntaxArena();
+    ~SyntaxArena();
+    SyntaxArena(const SyntaxArena &) = delete;
+    SyntaxArena &operator=(const SyntaxArena &) = delete;
+
+    void *allocate(size_t size);
+    const char *copy(const char *s, size_t len);
+    void reset();
+
+    template <class T, class... Args>
+    T *make(Args &&...args) {
+        return new (allocate(sizeof(T))) T(std::forward<Args>(args)...);
+    }
+
+private:
+    std::vector<char *> blocks; ///< Standard-size blocks, reused after reset
+    std::vector<char *> large;  ///< Oversized allocations, freed by reset
+    size_t current;             ///< Index of the block being filled
+    char *next;
+    char *end;
+};
+
 struct SyntaxBase {
     virtual Expr parse(Assoc &) = 0;
     virtual void show(std::ostream &) = 0;
     virtual ~SyntaxBase() = default;
 };
 
+// Non-owning handle; the node belongs to a SyntaxArena
 struct Syntax {
-    std::shared_ptr<SyntaxBase> ptr;
+    SyntaxBase *ptr;
     Syntax(SyntaxBase *);
     SyntaxBase* operator->() const;
-    SyntaxBase& operator*();
+    SyntaxBase& operator*() const;
     SyntaxBase* get() const;
-    Expr parse(Assoc &);
+    Expr parse(Assoc &) const;
 };
 
 struct Number : SyntaxBase {
@@ -36,6 +76,23 @@ struct RationalSyntax : SyntaxBase {
     virtual void show(std::ostream &) override;
 };
 
+// Exact integer or ratio with a part outside the int range; its value is
+// built from the token text when parsed
+struct BignumSyntax : SyntaxBase {
+    const char *s; ///< Token text in the arena
+    size_t len;
+    BignumSyntax(const char *, size_t);
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
+struct FlonumSyntax : SyntaxBase {
+    double d;
+    FlonumSyntax(double);
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
 struct TrueSyntax : SyntaxBase {
     // This will not match
     virtual Expr parse(Assoc &) override;
@@ -49,27 +106,79 @@ struct FalseSyntax : SyntaxBase {
 };
 
 struct SymbolSyntax : SyntaxBase {
-    std::string s;
-    SymbolSyntax(const std::string &);
+    Name s;
+    SymbolSyntax(const Name &);
     virtual Expr parse(Assoc &) override;
     virtual void show(std::ostream &) override;
 };
 
 struct StringSyntax : SyntaxBase {
-    std::string s;
-    StringSyntax(const std::string &);
+    const char *s; ///< Text in the arena, unescaped
+    size_t len;
+    StringSyntax(const char *, size_t);
     virtual Expr parse(Assoc &) override;
     virtual void show(std::ostream &) override;
 };
 
+/**
+ * @brief Elements of a List: a fixed array in the arena
+ */
+struct SyntaxList {
+    const Syntax *items;
+    size_t n;
+
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    const Syntax &operator[](size_t i) const { return items[i]; }
+    const Syntax &back() const { return items[n - 1]; }
+    const Syntax *begin() const { return items; }
+    const Syntax *end() const { return items + n; }
+    std::reverse_iterator<const Syntax *> rbegin() const { return std::reverse_iterator<const Syntax *>(end()); }
+    std::reverse_iterator<const Syntax *> rend() const { return std::reverse_iterator<const Syntax *>(begin()); }
+};
+
 struct List : SyntaxBase {
-    std::vector<Syntax> stxs;
+    SyntaxList stxs;
     List();
+    List(const Syntax *items, size_t n);
     virtual Expr parse(Assoc &) override;
     virtual void show(std::ostream &) override;
 };
 
-Syntax readSyntax(std::istream &);
+/**
+ * @brief Program text in one contiguous buffer
+ *
+ * A regular file is mapped into memory whole. Anything else (a pipe, a
+ * terminal) is read in large blocks, appended as the reader runs out, so a
+ * REPL still evaluates each form as soon as it has arrived. Tokens are
+ * scanned in place and only copied when a Syntax node needs the text.
+ */
+class Source {
+public:
+    explicit Source(int fd);                 ///< Read from fd, which stays open
+    explicit Source(const std::string &text);
+    ~Source();
+    Source(const Source &) = delete;
+    Source &operator=(const Source &) = delete;
+
+    int peek() { return pos < len || fill() ? (unsigned char)data[pos] : EOF; }
+    int get() { return pos < len || fill() ? (unsigned char)data[pos++] : EOF; }
+
+    const char *data; ///< Buffer start; moves when a block read grows it
+    size_t pos;       ///< Next unread byte
+    size_t len;       ///< Bytes available
+
+    bool mapped() const { return map != nullptr; } ///< Whole input is in data
+    bool fill();    ///< Read another block; false at end of input
+    void discard(); ///< Drop the consumed prefix of a block-read buffer
+
+private:
+    int fd;             ///< -1 once the input is exhausted or fully mapped
+    void *map;          ///< Mapping of a regular file, or nullptr
+    std::string buffer; ///< Storage for block reads
+};
+
+Source &readSpace(Source &); // skip whitespace and comments
+Syntax readSyntax(Source &, SyntaxArena &);
 
-std::istream &operator>>(std::istream &, Syntax);
 #endif
\ No newline at end of file
@@ -7,12 +7,19 @@
  */
 
 #include "value.hpp"
+#include "RE.hpp"
+#include "bignum.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
 
 // ============================================================================
 // Base ValueBase Implementation
 // ============================================================================
 
-ValueBase::ValueBase(ValueType vt) : v_type(vt) {}
+ValueBase::ValueBase(ValueType vt, bool container) : GcObject(container), v_type(vt) {}
 
 void ValueBase::showCdr(std::ostream &os) {
     os << " . ";
@@ -21,13 +28,17 @@ void ValueBase::showCdr(std::ostream &os) {
 }
 
 // ============================================================================
-// Value Smart Pointer Implementation
+// Tagged Value Implementation
 // ============================================================================
 
-Value::Value(ValueBase *ptr) : ptr(ptr) {}
+Value::Value(ValueBase *ptr) : v_type(ptr ? ptr->v_type : V_UNBOUND), n(0), ptr(ptr) {
+    gcRetain(ptr);
+}
+
+Value::Value(ValueType vt, int payload) : v_type(vt), n(payload), ptr(nullptr) {}
 
 ValueBase *Value::operator->() const {
-    return ptr.get();
+    return ptr;
 }
 
 ValueBase &Value::operator*() {
@@ -35,19 +46,100 @@ ValueBase &Value::operator*() {
 }
 
 ValueBase *Value::get() const {
-    return ptr.get();
+    return ptr;
+}
+
+// Shortest digits that read back as x, positional for moderate exponents and
+// always marked inexact by a '.' or an exponent
+static void showFlonum(std::ostream &os, double x) {
+    if (std::isnan(x)) {
+        os << "+nan.0";
+        return;
+    }
+    if (std::isinf(x)) {
+        os << (x > 0 ? "+inf.0" : "-inf.0");
+        return;
+    }
+    char text[32];
+    for (int precision = 0; precision < 17; ++precision) {
+        snprintf(text, sizeof text, "%.*e", precision, x);
+        if (strtod(text, nullptr) == x) {
+            break;
+        }
+    }
+    // text is [-]d[.ddd]e<exponent>
+    const char *p = text;
+    if (*p == '-') {
+        os << '-';
+        ++p;
+    }
+    const char *e = strchr(p, 'e');
+    std::string digits;
+    for (const char *q = p; q < e; ++q) {
+        if (*q != '.') {
+            digits += *q;
+        }
+    }
+    int exponent = atoi(e + 1);
+    if (exponent < -7 || exponent >= 21) {
+        os << digits[0];
+        if (digits.size() > 1) {
+            os << '.' << digits.substr(1);
+        }
+        os << e;
+        return;
+    }
+    if (exponent < 0) {
+        os << "0." << std::string(-exponent - 1, '0') << digits;
+        return;
+    }
+    if ((int)digits.size() <= exponent + 1) {
+        os << digits << std::string(exponent + 1 - digits.size(), '0') << ".0";
+    } else {
+        os << digits.substr(0, exponent + 1) << '.' << digits.substr(exponent + 1);
+    }
 }
 
-void Value::show(std::ostream &os) {
-    ptr->show(os);
-    // os << "!" << std::endl;
+void Value::show(std::ostream &os) const {
+    switch (v_type) {
+    case V_INT:
+        os << n;
+        break;
+    case V_FLONUM:
+        showFlonum(os, d);
+        break;
+    case V_BOOL:
+        os << (b ? "#t" : "#f");
+        break;
+    case V_NULL:
+    case V_TERMINATE:
+        os << "()";
+        break;
+    case V_VOID:
+        os << "#<void>";
+        break;
+    default:
+        ptr->show(os);
+    }
+}
+
+void Value::showCdr(std::ostream &os) const {
+    if (v_type == V_NULL) {
+        os << ')';
+    } else if (heap()) {
+        ptr->showCdr(os);
+    } else {
+        os << " . ";
+        show(os);
+        os << ')';
+    }
 }
 
 // ============================================================================
-// Environment (Association List) Implementation
+// Parse-time Environment (Association List) Implementation
 // ============================================================================
 
-AssocList::AssocList(const std::string &x, const Value &v, Assoc &next)
+AssocList::AssocList(const Name &x, const Value &v, Assoc &next)
     : x(x), v(v), next(next) {}
 
 Assoc::Assoc(AssocList *x) : ptr(x) {}
@@ -68,30 +160,11 @@ Assoc empty() {
     return Assoc(nullptr);
 }
 
-Assoc extend(const std::string &x, const Value &v, Assoc &lst) {
+Assoc extend(const Name &x, const Value &v, Assoc &lst) {
     return Assoc(new AssocList(x, v, lst));
 }
 
-void modify(const std::string &x, const Value &v, Assoc &lst) {
-    for (auto i = lst; i.get() != nullptr; i = i->next) {
-        if (x == i->x) {
-            i->v = v;
-            return;
-        }
-    }
-}
-
-void insert(const std::string &x, const Value &v, Assoc &lst) {
-    // Insert new binding at the front of the environment (standard for variable shadowing)
-    if (!lst.get()) {
-        auto head = Assoc(nullptr);
-        lst = extend(x, v, head);
-        return;
-    }
-    lst->next = extend(x, v, lst->next);
-}
-
-Value find(const std::string &x, Assoc &l) {
+Value find(const Name &x, Assoc &l) {
     for (auto i = l; i.get() != nullptr; i = i->next) {
         if (x == i->x) {
             return i->v;
@@ -101,94 +174,142 @@ Value find(const std::string &x, Assoc &l) {
 }
 
 // ============================================================================
-// Simple Value Types Implementation
+// Runtime Environment (Frame) Implementation
 // ============================================================================
 
-// Void
-Void::Void() : ValueBase(V_VOID) {}
+Frame::Frame(size_t size, const Env &parent)
+    : GcObject(true), slots(size, Value(nullptr)), parent(parent),
+      closure(parent.get() ? parent->closure : Value(nullptr)) {}
 
-void Void::show(std::ostream &os) {
-    os << "#<void>";
+void Frame::traverse(GcVisitor visit, void *arg) {
+    for (const Value &slot : slots)
+        visit(slot.heap(), arg);
+    visit(parent.ptr, arg);
+    visit(closure.heap(), arg);
 }
 
-Value VoidV() {
-    return Value(new Void());
+void Frame::clearRefs() {
+    for (Value &slot : slots)
+        slot = Value(nullptr);
+    parent = Env(nullptr);
+    closure = Value(nullptr);
 }
 
-// Integer
-Integer::Integer(int n) : ValueBase(V_INT), n(n) {}
-
-void Integer::show(std::ostream &os) {
-    os << n;
+Env extendFrame(size_t size, const Env &parent) {
+    return Env(new Frame(size, parent));
 }
 
-Value IntegerV(int n) {
-    return Value(new Integer(n));
+Value &frameSlot(Env &env, int depth, int index) {
+    Frame *f = env.get();
+    for (; depth > 0; --depth)
+        f = f->parent.get();
+    return f->slots[index];
 }
 
-// Rational
-// Helper function to calculate greatest common divisor
-static int gcd(int a, int b) {
-    if (a < 0)
-        a = -a;
-    if (b < 0)
-        b = -b;
-    while (b != 0) {
-        int temp = b;
-        b = a % b;
-        a = temp;
-    }
-    return a;
+Value &capturedSlot(Env &env, int index) {
+    return static_cast<Procedure *>(env->closure.get())->captured[index];
 }
 
-Rational::Rational(int num, int den) : ValueBase(V_RATIONAL) {
-    if (den == 0) {
-        throw std::runtime_error("Division by zero");
-    }
+Env callFrame(Procedure *proc) {
+    Env frame(new Frame(proc->tmpl->frame_size, Env(nullptr)));
+    if (proc->tmpl->free_count > 0)
+        frame->closure = Value(proc);
+    return frame;
+}
 
-    // Simplify the fraction
-    int g = gcd(num, den);
-    numerator = num / g;
-    denominator = den / g;
+// Global table: names are assigned slots on first reference and never move,
+// so resolved global references stay valid across top-level forms. The slot
+// is cached in the name's table entry.
+static std::deque<Value> global_values; // never moves a cell, see Apply::cell
 
-    // Ensure denominator is positive
-    if (denominator < 0) {
-        numerator = -numerator;
-        denominator = -denominator;
+int globalSlot(const Name &x) {
+    if (x->global_slot < 0) {
+        x->global_slot = (int)global_values.size();
+        global_values.push_back(Value(nullptr));
     }
+    return x->global_slot;
 }
 
-void Rational::show(std::ostream &os) {
-    if (denominator == 1) {
-        os << numerator;
-    } else {
-        os << numerator << "/" << denominator;
-    }
+Value &globalValue(int slot) {
+    return global_values[slot];
 }
 
-Value RationalV(int num, int den) {
-    return Value(new Rational(num, den));
+bool isGlobalBound(const Name &x) {
+    return x->global_slot >= 0 && global_values[x->global_slot].v_type != V_UNBOUND;
 }
 
-// Boolean
-Boolean::Boolean(bool b) : ValueBase(V_BOOL), b(b) {}
+// ============================================================================
+// Simple Value Types Implementation
+// ============================================================================
 
-void Boolean::show(std::ostream &os) {
-    os << (b ? "#t" : "#f");
+// Immediates
+Value VoidV() {
+    return Value(V_VOID, 0);
+}
+
+Value IntegerV(int n) {
+    return Value(V_INT, n);
+}
+
+Value FlonumV(double x) {
+    Value v(V_FLONUM, 0);
+    v.d = x;
+    return v;
 }
 
 Value BooleanV(bool b) {
-    return Value(new Boolean(b));
+    Value v(V_BOOL, 0);
+    v.b = b;
+    return v;
+}
+
+Value NullV() {
+    return Value(V_NULL, 0);
+}
+
+Value TerminateV() {
+    return Value(V_TERMINATE, 0);
+}
+
+// Rational
+Rational::Rational(const Value &num, const Value &den) : ValueBase(V_RATIONAL), numerator(num), denominator(den) {}
+
+void Rational::show(std::ostream &os) {
+    numerator.show(os);
+    os << "/";
+    denominator.show(os);
+}
+
+Value RationalV(const Value &num, const Value &den) {
+    int sign = intSign(den);
+    if (sign == 0) {
+        throw RuntimeError("Division by zero");
+    }
+    Value n = sign < 0 ? intNegate(num) : num;
+    Value d = sign < 0 ? intNegate(den) : den;
+    Value g = intGcd(n, d);
+    if (!(g.v_type == V_INT && g.n == 1)) {
+        intDivide(n, g, &n, nullptr);
+        intDivide(d, g, &d, nullptr);
+    }
+    if (d.v_type == V_INT && d.n == 1) {
+        return n;
+    }
+    return Value(new Rational(n, d));
+}
+
+Value RationalV(int num, int den) {
+    return RationalV(IntegerV(num), IntegerV(den));
 }
 
 // Symbol
-Symbol::Symbol(const std::string &s) : ValueBase(V_SYM), s(s) {}
+Symbol::Symbol(const Name &s) : ValueBase(V_SYM), s(s) {}
 
 void Symbol::show(std::ostream &os) {
-    os << s;
+    os << s.str();
 }
 
-Value SymbolV(const std::string &s) {
+Value SymbolV(const Name &s) {
     return Value(new Symbol(s));
 }
 
@@ -204,76 +325,154 @@ Value StringV(const std::string &s) {
 }
 
 // ============================================================================
-// Special Value Types Implementation
+// Composite Value Types Implementation
 // ============================================================================
 
-// Null
-Null::Null() : ValueBase(V_NULL) {}
+// Pair
+Pair::Pair(const Value &car, const Value &cdr)
+    : ValueBase(V_PAIR, true), car(car), cdr(cdr), literal(false) {}
 
-void Null::show(std::ostream &os) {
-    os << "()";
+void Pair::traverse(GcVisitor visit, void *arg) {
+    visit(car.heap(), arg);
+    visit(cdr.heap(), arg);
 }
 
-void Null::showCdr(std::ostream &os) {
-    os << ')';
+void Pair::clearRefs() {
+    car = NullV();
+    cdr = NullV();
 }
 
-Value NullV() {
-    return Value(new Null());
+void Pair::show(std::ostream &os) {
+    os << '(';
+    car.show(os);
+    cdr.showCdr(os);
 }
 
-// Terminate
-Terminate::Terminate() : ValueBase(V_TERMINATE) {}
+void Pair::showCdr(std::ostream &os) {
+    os << ' ';
+    car.show(os);
+    cdr.showCdr(os);
+}
 
-void Terminate::show(std::ostream &os) {
-    os << "()";
+Value PairV(const Value &car, const Value &cdr) {
+    return Value(new Pair(car, cdr));
 }
 
-Value TerminateV() {
-    return Value(new Terminate());
+// Box
+Box::Box(const Value &v) : ValueBase(V_BOX, true), v(v) {}
+
+void Box::show(std::ostream &os) {
+    os << "#<box>";
 }
 
-// ============================================================================
-// Composite Value Types Implementation
-// ============================================================================
+void Box::traverse(GcVisitor visit, void *arg) {
+    visit(v.heap(), arg);
+}
 
-// Pair
-Pair::Pair(const Value &car, const Value &cdr)
-    : ValueBase(V_PAIR), car(car), cdr(cdr) {}
+void Box::clearRefs() {
+    v = Value(nullptr);
+}
 
-void Pair::show(std::ostream &os) {
-    os << '(';
-    car->show(os);
-    cdr->showCdr(os);
+Value BoxV(const Value &v) {
+    return Value(new Box(v));
 }
 
-void Pair::showCdr(std::ostream &os) {
-    os << ' ';
-    car->show(os);
-    cdr->showCdr(os);
+// LambdaTemplate
+int lambdaArity(const std::vector<Name> &xs) {
+    if (xs.size() == 1) {
+        const std::string &name = xs[0].str();
+        if (name.size() >= 3 && name.compare(name.size() - 3, 3, "...") == 0)
+            return -1;
+    }
+    return (int)xs.size();
 }
 
-Value PairV(const Value &car, const Value &cdr) {
-    return Value(new Pair(car, cdr));
+LambdaTemplate::LambdaTemplate(const std::vector<Name> &xs, const Expr &e, int frame_size, int free_count, const Name &name)
+    : GcObject(false), parameters(xs), arity(lambdaArity(xs)), frame_size(frame_size), free_count(free_count), e(e),
+      name(name) {
+    static uint64_t templates_made = 0;
+    serial = ++templates_made;
 }
 
 // Procedure
-Procedure::Procedure(const std::vector<std::string> &xs, const Expr &e, const Assoc &env)
-    : ValueBase(V_PROC), parameters(xs), e(e), env(env) {}
+Procedure::Procedure(LambdaTemplate *tmpl, Value *captured) : ValueBase(V_PROC, true), tmpl(tmpl), captured(captured) {
+    gcRetain(tmpl);
+}
+
+Procedure::~Procedure() {
+    gcRelease(tmpl);
+}
+
+void Procedure::traverse(GcVisitor visit, void *arg) {
+    for (int i = 0; i < tmpl->free_count; ++i)
+        visit(captured[i].heap(), arg);
+}
+
+void Procedure::clearRefs() {
+    for (int i = 0; i < tmpl->free_count; ++i)
+        captured[i] = Value(nullptr);
+}
 
 void Procedure::show(std::ostream &os) {
     os << "#<procedure>";
 }
 
-Value ProcedureV(const std::vector<std::string> &xs, const Expr &e, const Assoc &env) {
-    return Value(new Procedure(xs, e, env));
+/**
+ * @brief Procedure with room for N captures in the object
+ *
+ * Each N is its own type, so the pool frees it in the right size class.
+ */
+template <int N>
+struct InlineProcedure : Procedure {
+    alignas(Value) unsigned char storage[N * sizeof(Value)];
+    InlineProcedure(LambdaTemplate *tmpl) : Procedure(tmpl, reinterpret_cast<Value *>(storage)) {
+        for (int i = 0; i < N; ++i)
+            new (&captured[i]) Value(nullptr);
+    }
+    ~InlineProcedure() {
+        for (int i = 0; i < N; ++i)
+            captured[i].~Value();
+    }
+};
+
+// Larger capture lists are rare enough to take a second allocation
+struct WideProcedure : Procedure {
+    std::vector<Value> values;
+    WideProcedure(LambdaTemplate *tmpl)
+        : Procedure(tmpl, nullptr), values(tmpl->free_count, Value(nullptr)) {
+        captured = values.data();
+    }
+};
+
+Value ProcedureV(LambdaTemplate *tmpl) {
+    int n = tmpl->free_count;
+    if (n == 0)
+        return Value(new Procedure(tmpl, nullptr));
+    if (n <= 2)
+        return Value(new InlineProcedure<2>(tmpl));
+    if (n <= 4)
+        return Value(new InlineProcedure<4>(tmpl));
+    if (n <= 8)
+        return Value(new InlineProcedure<8>(tmpl));
+    return Value(new WideProcedure(tmpl));
+}
+
+// Primitive
+Primitive::Primitive(NativeFn fn, int min_args, int max_args, const Name &name)
+    : ValueBase(V_PRIMITIVE), fn(fn), min_args(min_args), max_args(max_args), name(name) {}
+
+void Primitive::show(std::ostream &os) {
+    os << "#<procedure>";
 }
 
+// TailCall
+TailCall::TailCall() : proc(nullptr), pending(false), fits(false) {}
+
 // ============================================================================
 // Utility Functions Implementation
 // ============================================================================
 
-std::ostream &operator<<(std::ostream &os, Value &v) {
-    v->show(os);
+std::ostream &operator<<(std::ostream &os, const Value &v) {
+    v.show(os);
     return os;
 }
@@ -11,7 +11,10 @@
 
 #include "Def.hpp"
 #include "expr.hpp"
+#include "gc.hpp"
+#include <cstdint>
 #include <cstring>
+#include <iterator>
 #include <memory>
 #include <vector>
 
@@ -20,34 +23,110 @@
 // ============================================================================
 
 /**
- * @brief Base class for all values in the Scheme interpreter
+ * @brief Base class for all heap values in the Scheme interpreter
+ *
+ * Values that hold references to other values (pairs, procedures) are
+ * containers for the cycle collector; atoms are only reference counted.
  */
-struct ValueBase {
+struct ValueBase : GcObject {
     ValueType v_type;
-    ValueBase(ValueType);
+    ValueBase(ValueType, bool container = false);
     virtual void show(std::ostream &) = 0;
     virtual void showCdr(std::ostream &);
     virtual ~ValueBase() = default;
 };
 
 /**
- * @brief Smart pointer wrapper for ValueBase objects
+ * @brief Tagged Scheme value
+ *
+ * Fixnums, flonums, booleans, the empty list, void and the terminate marker
+ * are immediates stored inline: building or copying them allocates nothing
+ * and touches no reference count. Every other type lives on the heap behind
+ * ptr, and v_type mirrors the ValueBase tag so dispatch never dereferences.
+ * A flonum's double shares the word of ptr, so Value stays two words; code
+ * that may see any type reads the reference through heap().
  */
 struct Value {
-    std::shared_ptr<ValueBase> ptr;
-    Value(ValueBase *);
-    void show(std::ostream &);
+    ValueType v_type;
+    union {
+        int n;  ///< V_INT payload
+        bool b; ///< V_BOOL payload
+    };
+    union {
+        ValueBase *ptr; ///< Counted reference to the heap payload (nullptr for immediates)
+        double d;       ///< V_FLONUM payload, in place of ptr
+    };
+
+    Value(ValueBase *); ///< Heap value; nullptr gives V_UNBOUND
+    Value(ValueType, int);
+    Value(const Value &other) : v_type(other.v_type), n(other.n), ptr(other.ptr) {
+        gcRetain(heap());
+    }
+    Value(Value &&other) noexcept : v_type(other.v_type), n(other.n), ptr(other.ptr) {
+        other.v_type = V_UNBOUND;
+        other.ptr = nullptr;
+    }
+    Value &operator=(const Value &other) {
+        gcRetain(other.heap());
+        ValueBase *old = heap();
+        v_type = other.v_type;
+        n = other.n;
+        ptr = other.ptr;
+        gcRelease(old);
+        return *this;
+    }
+    Value &operator=(Value &&other) noexcept {
+        ValueBase *old = heap();
+        v_type = other.v_type;
+        n = other.n;
+        ptr = other.ptr;
+        if (&other != this) {
+            other.v_type = V_UNBOUND;
+            other.ptr = nullptr;
+            gcRelease(old);
+        }
+        return *this;
+    }
+    ~Value() {
+        gcRelease(heap());
+    }
+    // The counted reference, or nullptr for any immediate
+    ValueBase *heap() const {
+        return v_type == V_FLONUM ? nullptr : ptr;
+    }
+    void show(std::ostream &) const;
+    void showCdr(std::ostream &) const;
     ValueBase *operator->() const;
     ValueBase &operator*();
     ValueBase *get() const;
 };
 
+/**
+ * @brief Read-only view of consecutive argument values
+ *
+ * Variadic primitives take their operands this way, so a caller can pass a
+ * std::vector, a slice of the VM stack or a small buffer of its own.
+ */
+struct ValueSpan {
+    const Value *first;
+    size_t n;
+    ValueSpan(const Value *first, size_t n) : first(first), n(n) {}
+    ValueSpan(const std::vector<Value> &v) : first(v.data()), n(v.size()) {}
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    const Value &operator[](size_t i) const { return first[i]; }
+    const Value *begin() const { return first; }
+    const Value *end() const { return first + n; }
+    std::reverse_iterator<const Value *> rbegin() const { return std::reverse_iterator<const Value *>(end()); }
+    std::reverse_iterator<const Value *> rend() const { return std::reverse_iterator<const Value *>(begin()); }
+};
+
 // ============================================================================
-// Environment (Association Lists)
+// Parse-time Environment (Association Lists)
 // ============================================================================
 
 /**
- * @brief Smart pointer wrapper for AssocList (Environment)
+ * @brief Smart pointer wrapper for AssocList (parse-time name environment)
  */
 struct Assoc {
     std::shared_ptr<AssocList> ptr;
@@ -58,75 +137,164 @@ struct Assoc {
 };
 
 /**
- * @brief Association list node for variable bindings
+ * @brief Association list node used by the parser to track bound names
  */
 struct AssocList {
-    std::string x; ///< Variable name
-    Value v;       ///< Variable value
+    Name x;  ///< Variable name
+    Value v;       ///< Placeholder value
     Assoc next;    ///< Next binding in the chain
-    AssocList(const std::string &, const Value &, Assoc &);
+    AssocList(const Name &, const Value &, Assoc &);
 };
 
-// Environment operations
+// Association list operations
 Assoc empty();
-Assoc extend(const std::string &, const Value &, Assoc &);
-void modify(const std::string &, const Value &, Assoc &);
-void insert(const std::string &, const Value &, Assoc &);
-Value find(const std::string &, Assoc &);
+Assoc extend(const Name &, const Value &, Assoc &);
+Value find(const Name &, Assoc &);
 
 // ============================================================================
-// Simple Value Types
+// Runtime Environment (Frames)
 // ============================================================================
 
 /**
- * @brief Void value (represents no meaningful return value)
+ * @brief Counted reference to a Frame (runtime environment)
  */
-struct Void : ValueBase {
-    Void();
-    virtual void show(std::ostream &) override;
+struct Env {
+    Frame *ptr;
+    Env(Frame *);
+    Env(const Env &);
+    Env(Env &&) noexcept;
+    Env &operator=(const Env &);
+    Env &operator=(Env &&) noexcept;
+    ~Env();
+    Frame *operator->() const;
+    Frame &operator*();
+    Frame *get() const;
 };
-Value VoidV();
 
 /**
- * @brief Integer value
+ * @brief One lexical frame; slot indices are assigned by the resolve pass
+ *
+ * A call opens a frame with no parent; let and letrec frames link to the
+ * frame they are evaluated in and share its closure. Frames are containers
+ * for the cycle collector.
  */
-struct Integer : ValueBase {
-    int n;
-    Integer(int);
-    virtual void show(std::ostream &) override;
+struct Frame : GcObject {
+    std::vector<Value> slots; ///< Bindings addressed by index
+    Env parent;               ///< Enclosing frame within the same procedure body
+    Value closure;            ///< Procedure whose captures VK_FREE reads (nullptr if none)
+    Frame(size_t, const Env &);
+    virtual void traverse(GcVisitor, void *) override;
+    virtual void clearRefs() override;
 };
+
+inline Env::Env(Frame *f) : ptr(f) {
+    gcRetain(ptr);
+}
+
+inline Env::Env(const Env &other) : ptr(other.ptr) {
+    gcRetain(ptr);
+}
+
+inline Env::Env(Env &&other) noexcept : ptr(other.ptr) {
+    other.ptr = nullptr;
+}
+
+inline Env &Env::operator=(const Env &other) {
+    gcRetain(other.ptr);
+    Frame *old = ptr;
+    ptr = other.ptr;
+    gcRelease(old);
+    return *this;
+}
+
+inline Env &Env::operator=(Env &&other) noexcept {
+    if (&other != this) {
+        Frame *old = ptr;
+        ptr = other.ptr;
+        other.ptr = nullptr;
+        gcRelease(old);
+    }
+    return *this;
+}
+
+inline Env::~Env() {
+    gcRelease(ptr);
+}
+
+inline Frame *Env::operator->() const {
+    return ptr;
+}
+
+inline Frame &Env::operator*() {
+    return *ptr;
+}
+
+inline Frame *Env::get() const {
+    return ptr;
+}
+
+// Frame operations
+Env extendFrame(size_t, const Env &);
+Value &frameSlot(Env &, int, int);
+Value &capturedSlot(Env &, int);
+
+// Global bindings live outside the frame chain, one slot per name
+int globalSlot(const Name &);
+Value &globalValue(int);
+bool isGlobalBound(const Name &);
+
+// ============================================================================
+// Simple Value Types
+// ============================================================================
+
+// Immediates: these build a Value in place without allocating
+Value VoidV();
 Value IntegerV(int);
+Value FlonumV(double);
+Value BooleanV(bool);
+Value NullV();
+Value TerminateV();
 
 /**
- * @brief Rational number value
+ * @brief Exact ratio that is not an integer
+ *
+ * Always in lowest terms with a denominator above 1; a quotient that comes
+ * out whole is a fixnum or bignum instead. The components are exact
+ * integers, so a ratio grows without overflowing.
  */
 struct Rational : ValueBase {
-    int numerator;
-    int denominator;
-    Rational(int, int);
+    Value numerator;   ///< Fixnum or bignum
+    Value denominator; ///< Fixnum or bignum, greater than 1
+    Rational(const Value &, const Value &); ///< Components already reduced
     virtual void show(std::ostream &) override;
 };
+// num/den in lowest terms: reduces, fixes the sign and returns an integer
+// when den divides num
+Value RationalV(const Value &, const Value &);
 Value RationalV(int, int);
 
 /**
- * @brief Boolean value
+ * @brief Exact integer too large for the V_INT immediate
+ *
+ * Arithmetic keeps integers canonical: a result that fits in an int is
+ * always a fixnum, so a Bignum never holds a value an immediate could.
  */
-struct Boolean : ValueBase {
-    bool b;
-    Boolean(bool);
+struct Bignum : ValueBase {
+    bool negative;
+    std::vector<uint32_t> magnitude; ///< Base 2^32 limbs, least significant first, no high zero limb
+    Bignum(bool, std::vector<uint32_t> &&);
     virtual void show(std::ostream &) override;
 };
-Value BooleanV(bool);
 
 /**
  * @brief Symbol value
  */
 struct Symbol : ValueBase {
-    std::string s;
-    Symbol(const std::string &);
+    Name s;
+    Symbol(const Name &);
     virtual void show(std::ostream &) override;
 };
-Value SymbolV(const std::string &);
+Value SymbolV(const Name &);
 
 /**
  * @brief String value
@@ -139,60 +307,156 @@ struct String : ValueBase {
 Value StringV(const std::string &);
 
 // ============================================================================
-// Special Value Types
+// Composite Value Types
 // ============================================================================
 
 /**
- * @brief Null value (empty list)
+ * @brief Pair value (cons cell)
  */
-struct Null : ValueBase {
-    Null();
+struct Pair : ValueBase {
+    Value car; ///< First element
+    Value cdr;    ///< Second element
+    bool literal; ///< Part of a quoted constant: set-car!/set-cdr! are errors
+    Pair(const Value &, const Value &);
     virtual void show(std::ostream &) override;
     virtual void showCdr(std::ostream &) override;
+    virtual void traverse(GcVisitor, void *) override;
+    virtual void clearRefs() override;
 };
-Value NullV();
+Value PairV(const Value &, const Value &);
 
 /**
- * @brief Termination signal value
+ * @brief Shared cell for a variable that is both captured and assigned
+ *
+ * Only ever stored in a frame slot or a closure's captures, in place of the
+ * variable's value; reads and writes go through unbox, so Scheme code never
+ * sees one.
  */
-struct Terminate : ValueBase {
-    Terminate();
+struct Box : ValueBase {
+    Value v;
+    Box(const Value &);
     virtual void show(std::ostream &) override;
+    virtual void traverse(GcVisitor, void *) override;
+    virtual void clearRefs() override;
 };
-Value TerminateV();
+Value BoxV(const Value &);
 
-// ============================================================================
-// Composite Value Types
-// ============================================================================
+// The variable stored in a slot: the slot itself or the Box it holds
+inline Value &unbox(Value &slot) {
+    return slot.v_type == V_BOX ? static_cast<Box *>(slot.ptr)->v : slot;
+}
+
+// Arguments a lambda with these parameters takes, or -1 for a single
+// parameter named "xxx...", which is bound to the list of all arguments
+int lambdaArity(const std::vector<Name> &);
 
 /**
- * @brief Pair value (cons cell)
+ * @brief The part of a closure shared by every closure of one lambda
+ *
+ * Built by resolve and held by the Lambda node and each of its closures, so
+ * making a closure copies none of it.
  */
-struct Pair : ValueBase {
-    Value car; ///< First element
-    Value cdr; ///< Second element
-    Pair(const Value &, const Value &);
-    virtual void show(std::ostream &) override;
-    virtual void showCdr(std::ostream &) override;
+struct LambdaTemplate : GcObject {
+    std::vector<Name> parameters; ///< Parameter names
+    int arity;                    ///< See lambdaArity
+    int frame_size;               ///< Slots needed per call (parameters + internal defines)
+    int free_count;               ///< Captures per closure
+    Expr e;                       ///< Function body expression
+    Name name;                    ///< Name of the lambda, for profiles
+    std::shared_ptr<Chunk> code;  ///< Body compiled by the bytecode backend, built on first use
+    uint64_t serial;              ///< Identifies the template; unlike its address, never reused
+    LambdaTemplate(const std::vector<Name> &, const Expr &, int, int, const Name &);
 };
-Value PairV(const Value &, const Value &);
 
 /**
  * @brief Procedure (function) value
+ *
+ * A template plus the values of its free variables. The captures live in
+ * the object itself, in a subclass sized for them (see ProcedureV), so a
+ * closure is one pooled allocation.
  */
 struct Procedure : ValueBase {
-    std::vector<std::string> parameters; ///< Parameter names
-    Expr e;                              ///< Function body expression
-    Assoc env;                           ///< Closure environment
-    Procedure(const std::vector<std::string> &, const Expr &, const Assoc &);
+    LambdaTemplate *tmpl; ///< Counted reference
+    Value *captured;      ///< tmpl->free_count values (or boxes), stored in the subclass
+    Procedure(LambdaTemplate *, Value *);
+    ~Procedure();
     virtual void show(std::ostream &) override;
+    virtual void traverse(GcVisitor, void *) override;
+    virtual void clearRefs() override;
+};
+// A closure of tmpl whose captures are still unbound; the caller fills them in
+Value ProcedureV(LambdaTemplate *);
+
+// Open the frame for a call to a procedure
+Env callFrame(Procedure *);
+
+// Bind args in a new frame for a call (defined in evaluation.cpp)
+Env bindArguments(Procedure *, std::vector<Value> &);
+
+typedef Value (*NativeFn)(const ValueSpan &);
+
+/**
+ * @brief Built-in procedure used as a value, as in (map car xs)
+ *
+ * There is one per primitive, made the first time its name is evaluated as
+ * a variable. A call checks the argument count and runs fn on the
+ * evaluated arguments: no frame is opened and nothing is allocated.
+ */
+struct Primitive : ValueBase {
+    NativeFn fn;
+    int min_args;
+    int max_args; ///< -1 if any number above min_args is accepted
+    Name name;    ///< For profiles
+    Primitive(NativeFn, int, int, const Name &);
+    virtual void show(std::ostream &) override;
+};
+
+// The procedure of a primitive name such as car or +, or V_UNBOUND if the
+// name has none (defined in evaluation.cpp)
+Value primitiveProcedure(const Name &);
+Value callPrimitive(Primitive *, const ValueSpan &);
+
+inline bool isProcedure(const Value &v) {
+    return v.v_type == V_PROC || v.v_type == V_PRIMITIVE;
+}
+
+/**
+ * @brief Call left pending by an expression in tail position
+ *
+ * evalTail fills this in instead of recursing into the callee; the caller
+ * that owns it runs the call in a loop, so tail calls use no native stack.
+ */
+struct TailCall {
+    Value proc;              ///< Procedure to call
+    std::vector<Value> args; ///< Evaluated arguments
+    bool pending;            ///< Set when proc/args hold a call to run
+    bool fits;               ///< proc is known to take args.size() arguments
+    TailCall();
 };
-Value ProcedureV(const std::vector<std::string> &, const Expr &, const Assoc &);
 
 // ============================================================================
 // Utility Functions
 // ============================================================================
 
-std::ostream &operator<<(std::ostream &, Value &);
+std::ostream &operator<<(std::ostream &, const Value &);
+
+// Datum of a quote form as an immutable constant (defined in evaluation.cpp)
+Value syntaxToValue(SyntaxBase *);
+
+// Numeric kernels shared by the primitive nodes and the bytecode VM
+Value numAdd(const Value &, const Value &);
+Value numSub(const Value &, const Value &);
+Value numNegate(const Value &);
+Value numMul(const Value &, const Value &);
+Value numDiv(const Value &, const Value &);
+int compareNumericValues(const Value &, const Value &);
+
+// compareNumericValues of a NaN: it fails every test (c < 0, c <= 0,
+// c == 0, isGreaterEq(c), c == 1)
+const int kUnordered = 2;
+
+inline bool isGreaterEq(int c) {
+    return c == 0 || c == 1;
+}
 
 #endif // VALUE
\ No newline at end of file
@@ -0,0 +1,738 @@
+/**
+ * @file vm.cpp
+ * @brief Bytecode compiler and virtual machine
+ *
+ * The compiler walks a resolved Expr tree and emits one Chunk per procedure
+ * body; variables are already addressed by (depth, index), capture index or
+ * global slot, so compilation needs no scope information. The VM keeps values and calls on
+ * explicit stacks, so neither nested nor tail calls use native stack.
+ *
+ * Literals and quoted data are the constants their nodes built at parse
+ * time. Anything that only raises an error (malformed quote, invalid
+ * variable) is handed back to the tree walker with OP_EVAL, which keeps the
+ * two backends' behaviour identical by construction.
+ */
+
+#include "vm.hpp"
+#include "RE.hpp"
+#include "expr.hpp"
+#include "profile.hpp"
+#include "value.hpp"
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO
+#endif
+
+// ============================================================================
+// Compiler
+// ============================================================================
+
+static const Name else_name("else");
+
+static void emit(Chunk &chunk, std::initializer_list<int> words) {
+    chunk.code.insert(chunk.code.end(), words);
+}
+
+static int addConst(Chunk &chunk, const Value &v) {
+    chunk.consts.push_back(v);
+    return (int)chunk.consts.size() - 1;
+}
+
+static int addNode(Chunk &chunk, const Expr &e) {
+    chunk.nodes.push_back(e);
+    return (int)chunk.nodes.size() - 1;
+}
+
+// Emit a jump with an unknown target; returns the operand to patch
+static int emitJump(Chunk &chunk, OpCode op) {
+    emit(chunk, {op, -1});
+    return (int)chunk.code.size() - 1;
+}
+
+// Point a jump emitted by emitJump at the next instruction
+static void patchJump(Chunk &chunk, int at) {
+    chunk.code[at] = (int)chunk.code.size();
+}
+
+// Binary numeric primitives that have a dedicated opcode, or -1
+static int numericOp(ExprType t) {
+    switch (t) {
+    case E_PLUS:
+        return OP_ADD;
+    case E_MINUS:
+        return OP_SUB;
+    case E_MUL:
+        return OP_MUL;
+    case E_DIV:
+        return OP_DIV;
+    case E_LT:
+        return OP_LT;
+    case E_LE:
+        return OP_LE;
+    case E_EQ:
+        return OP_NUMEQ;
+    case E_GE:
+        return OP_GE;
+    case E_GT:
+        return OP_GT;
+    default:
+        return -1;
+    }
+}
+
+static void compileExpr(Chunk &chunk, const Expr &expr, bool tail);
+
+// Evaluate es[from..] in order, keeping only the last value
+static void compileSequence(Chunk &chunk, const std::vector<Expr> &es, size_t from, bool tail) {
+    for (size_t i = from; i + 1 < es.size(); ++i) {
+        compileExpr(chunk, es[i], false);
+        emit(chunk, {OP_POP});
+    }
+    compileExpr(chunk, es.back(), tail);
+}
+
+static void compileCond(Chunk &chunk, Cond *cond, bool tail) {
+    std::vector<int> exits;
+    bool closed = false; // an else clause or an error ends the chain
+    for (const auto &clause : cond->clauses) {
+        if (clause.empty()) {
+            emit(chunk, {OP_RAISE, addConst(chunk, StringV("cond: empty clause is invalid"))});
+            closed = true;
+            break;
+        }
+        Var *else_var = dynamic_cast<Var *>(clause[0].get());
+        if (else_var && else_var->x == else_name) {
+            if (clause.size() == 1) {
+                emit(chunk, {OP_CONST, addConst(chunk, BooleanV(true))});
+            } else {
+                compileSequence(chunk, clause, 1, tail);
+            }
+            closed = true;
+            break;
+        }
+        compileExpr(chunk, clause[0], false);
+        if (clause.size() == 1) {
+            // The test's own value is the result
+            exits.push_back(emitJump(chunk, OP_OR_JUMP));
+        } else {
+            int next = emitJump(chunk, OP_JUMP_IF_FALSE);
+            compileSequence(chunk, clause, 1, tail);
+            exits.push_back(emitJump(chunk, OP_JUMP));
+            patchJump(chunk, next);
+        }
+    }
+    if (!closed) {
+        emit(chunk, {OP_CONST, addConst(chunk, BooleanV(false))});
+    }
+    for (int at : exits) {
+        patchJump(chunk, at);
+    }
+}
+
+// A primitive node: operands on the stack, then the node's evalRator
+static void compilePrimitive(Chunk &chunk, const Expr &expr) {
+    if (auto unary = dynamic_cast<Unary *>(expr.get())) {
+        compileExpr(chunk, unary->rand, false);
+        emit(chunk, {OP_PRIM1, addNode(chunk, expr)});
+    } else if (auto binary = dynamic_cast<Binary *>(expr.get())) {
+        compileExpr(chunk, binary->rand1, false);
+        compileExpr(chunk, binary->rand2, false);
+        int op = numericOp(expr->e_type);
+        if (op >= 0) {
+            emit(chunk, {op});
+        } else {
+            emit(chunk, {OP_PRIM2, addNode(chunk, expr)});
+        }
+    } else if (auto variadic = dynamic_cast<Variadic *>(expr.get())) {
+        for (const auto &rand : variadic->rands) {
+            compileExpr(chunk, rand, false);
+        }
+        int op = numericOp(expr->e_type);
+        if (op >= 0 && variadic->rands.size() == 2) {
+            emit(chunk, {op});
+        } else {
+            emit(chunk, {OP_PRIMN, addNode(chunk, expr), (int)variadic->rands.size()});
+        }
+    } else {
+        emit(chunk, {OP_EVAL, addNode(chunk, expr)});
+    }
+}
+
+// Compile expr so that it leaves its value on the stack. With tail set the
+// value is returned right after, so calls may replace the current one.
+static void compileExpr(Chunk &chunk, const Expr &expr, bool tail) {
+    switch (expr->e_type) {
+    case E_FIXNUM:
+    case E_TRUE:
+    case E_FALSE:
+    case E_VOID:
+    case E_EXIT: {
+        // Immediate literals do not depend on the environment
+        Env none(nullptr);
+        emit(chunk, {OP_CONST, addConst(chunk, expr->eval(none))});
+        break;
+    }
+    case E_RATIONAL:
+        emit(chunk, {OP_CONST, addConst(chunk, *static_cast<RationalNum *>(expr.get())->value)});
+        break;
+    case E_STRING:
+        emit(chunk, {OP_CONST, addConst(chunk, *static_cast<StringExpr *>(expr.get())->value)});
+        break;
+    case E_QUOTE: {
+        Quote *quote = static_cast<Quote *>(expr.get());
+        if (quote->value) {
+            emit(chunk, {OP_CONST, addConst(chunk, *quote->value)});
+        } else {
+            emit(chunk, {OP_EVAL, addNode(chunk, expr)});
+        }
+        break;
+    }
+    case E_VAR: {
+        Var *var = static_cast<Var *>(expr.get());
+        if (var->kind == VK_LOCAL && var->depth == 0) {
+            emit(chunk, {OP_LOCAL0, var->index, addNode(chunk, expr)});
+        } else if (var->kind == VK_LOCAL) {
+            emit(chunk, {OP_LOCAL, var->depth, var->index, addNode(chunk, expr)});
+        } else if (var->kind == VK_FREE) {
+            emit(chunk, {OP_FREE, var->index, addNode(chunk, expr)});
+        } else if (var->kind == VK_GLOBAL) {
+            emit(chunk, {OP_GLOBAL, var->index, addNode(chunk, expr)});
+        } else {
+            emit(chunk, {OP_EVAL, addNode(chunk, expr)}); // raises the name error
+        }
+        break;
+    }
+    case E_SET: {
+        // The target is checked before the new value is evaluated
+        Set *set = static_cast<Set *>(expr.get());
+        if (set->kind == VK_GLOBAL) {
+            emit(chunk, {OP_CHECK_GLOBAL, set->index, addNode(chunk, expr)});
+            compileExpr(chunk, set->e, false);
+            emit(chunk, {OP_STORE_GLOBAL, set->index});
+        } else if (set->kind == VK_FREE) {
+            emit(chunk, {OP_CHECK_FREE, set->index, addNode(chunk, expr)});
+            compileExpr(chunk, set->e, false);
+            emit(chunk, {OP_STORE_FREE, set->index});
+        } else {
+            emit(chunk, {OP_CHECK_LOCAL, set->depth, set->index, addNode(chunk, expr)});
+            compileExpr(chunk, set->e, false);
+            emit(chunk, {OP_STORE_LOCAL, set->depth, set->index});
+        }
+        emit(chunk, {OP_CONST, addConst(chunk, VoidV())});
+        break;
+    }
+    case E_DEFINE: {
+        Define *def = static_cast<Define *>(expr.get());
+        compileExpr(chunk, def->e, false);
+        if (def->kind == VK_GLOBAL) {
+            emit(chunk, {OP_STORE_GLOBAL, def->index});
+        } else {
+            emit(chunk, {OP_STORE_LOCAL, 0, def->index});
+        }
+        emit(chunk, {OP_CONST, addConst(chunk, VoidV())});
+        break;
+    }
+    case E_BEGIN: {
+        Begin *begin = static_cast<Begin *>(expr.get());
+        if (begin->es.empty()) {
+            emit(chunk, {OP_CONST, addConst(chunk, VoidV())});
+        } else {
+            compileSequence(chunk, begin->es, 0, tail);
+        }
+        break;
+    }
+    case E_IF: {
+        If *if_expr = static_cast<If *>(expr.get());
+        compileExpr(chunk, if_expr->cond, false);
+        int else_jump = emitJump(chunk, OP_JUMP_IF_FALSE);
+        compileExpr(chunk, if_expr->conseq, tail);
+        int end_jump = emitJump(chunk, OP_JUMP);
+        patchJump(chunk, else_jump);
+        if (if_expr->alter.get() != nullptr) {
+            compileExpr(chunk, if_expr->alter, tail);
+        } else {
+            emit(chunk, {OP_CONST, addConst(chunk, BooleanV(false))});
+        }
+        patchJump(chunk, end_jump);
+        break;
+    }
+    case E_COND:
+        compileCond(chunk, static_cast<Cond *>(expr.get()), tail);
+        break;
+    case E_AND:
+    case E_OR: {
+        const std::vector<Expr> &rands = (expr->e_type == E_AND)
+                                             ? static_cast<AndVar *>(expr.get())->rands
+                                             : static_cast<OrVar *>(expr.get())->rands;
+        if (rands.empty()) {
+            emit(chunk, {OP_CONST, addConst(chunk, BooleanV(expr->e_type == E_AND))});
+            break;
+        }
+        OpCode op = (expr->e_type == E_AND) ? OP_AND_JUMP : OP_OR_JUMP;
+        std::vector<int> exits;
+        for (size_t i = 0; i + 1 < rands.size(); ++i) {
+            compileExpr(chunk, rands[i], false);
+            exits.push_back(emitJump(chunk, op));
+        }
+        compileExpr(chunk, rands.back(), tail);
+        for (int at : exits) {
+            patchJump(chunk, at);
+        }
+        break;
+    }
+    case E_LAMBDA: {
+        Lambda *lambda = static_cast<Lambda *>(expr.get());
+        if (!lambda->tmpl->code) {
+            lambda->tmpl->code = compileChunk(lambda->e); // shared by all its closures
+        }
+        emit(chunk, {OP_CLOSURE, addNode(chunk, expr)});
+        break;
+    }
+    case E_APPLY: {
+        // The operator is checked before any operand is evaluated
+        Apply *apply = static_cast<Apply *>(expr.get());
+        compileExpr(chunk, apply->rator, false);
+        emit(chunk, {OP_CHECK_PROC});
+        for (const auto &rand : apply->rand) {
+            compileExpr(chunk, rand, false);
+        }
+        if (apply->cell != nullptr) {
+            chunk.links.push_back(Value(nullptr));
+            emit(chunk, {tail ? OP_TAIL_CALL_GLOBAL : OP_CALL_GLOBAL, (int)apply->rand.size(),
+                         (int)chunk.links.size() - 1});
+        } else {
+            emit(chunk, {tail ? OP_TAIL_CALL : OP_CALL, (int)apply->rand.size()});
+        }
+        break;
+    }
+    case E_LET: {
+        // Initializers run in the enclosing frame
+        Let *let = static_cast<Let *>(expr.get());
+        for (const auto &b : let->bind) {
+            compileExpr(chunk, b.second, false);
+        }
+        emit(chunk, {OP_LET, (int)let->bind.size(), let->frame_size});
+        compileExpr(chunk, let->body, tail);
+        if (!tail) {
+            emit(chunk, {OP_LEAVE});
+        }
+        break;
+    }
+    case E_LETREC: {
+        Letrec *letrec = static_cast<Letrec *>(expr.get());
+        emit(chunk, {OP_LETREC, (int)letrec->bind.size(), letrec->frame_size});
+        for (size_t i = 0; i < letrec->bind.size(); ++i) {
+            compileExpr(chunk, letrec->bind[i].second, false);
+            emit(chunk, {OP_STORE_LOCAL, 0, (int)i});
+        }
+        compileExpr(chunk, letrec->body, tail);
+        if (!tail) {
+            emit(chunk, {OP_LEAVE});
+        }
+        break;
+    }
+    default:
+        compilePrimitive(chunk, expr);
+        break;
+    }
+}
+
+std::shared_ptr<Chunk> compileChunk(const Expr &expr) {
+    std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+    compileExpr(*chunk, expr, true);
+    emit(*chunk, {OP_RETURN});
+    return chunk;
+}
+
+// ============================================================================
+// Virtual machine
+// ============================================================================
+
+/**
+ * @brief Saved state of a suspended caller
+ */
+struct CallInfo {
+    Value proc;      ///< Running procedure; keeps its chunk alive
+    Chunk *chunk;    ///< Code being executed
+    const int *pc;   ///< Resume point
+    Env env;         ///< Current frame
+};
+
+static inline bool isFalse(const Value &v) {
+    return v.v_type == V_BOOL && !v.b;
+}
+
+static Value run(Chunk *chunk, Env env) {
+    std::vector<Value> stack;
+    std::vector<CallInfo> calls;
+    stack.reserve(256);
+    Value proc(nullptr);
+    const int *pc = chunk->code.data();
+    bool tail_call = false;
+    int argc = 0;
+    Value *link = nullptr; // cache of the call site being entered, if any
+
+#ifdef VM_COMPUTED_GOTO
+    static void *const labels[] = {
+        &&L_OP_CONST, &&L_OP_LOCAL0, &&L_OP_LOCAL, &&L_OP_FREE, &&L_OP_GLOBAL,
+        &&L_OP_CHECK_LOCAL, &&L_OP_CHECK_FREE, &&L_OP_CHECK_GLOBAL,
+        &&L_OP_STORE_LOCAL, &&L_OP_STORE_FREE, &&L_OP_STORE_GLOBAL,
+        &&L_OP_POP, &&L_OP_JUMP, &&L_OP_JUMP_IF_FALSE, &&L_OP_AND_JUMP,
+        &&L_OP_OR_JUMP, &&L_OP_CHECK_PROC, &&L_OP_CLOSURE, &&L_OP_CALL,
+        &&L_OP_TAIL_CALL, &&L_OP_CALL_GLOBAL, &&L_OP_TAIL_CALL_GLOBAL, &&L_OP_RETURN, &&L_OP_LET, &&L_OP_LETREC,
+        &&L_OP_LEAVE, &&L_OP_EVAL, &&L_OP_PRIM1, &&L_OP_PRIM2,
+        &&L_OP_PRIMN, &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL,
+        &&L_OP_DIV, &&L_OP_LT, &&L_OP_LE, &&L_OP_NUMEQ,
+        &&L_OP_GE, &&L_OP_GT, &&L_OP_RAISE};
+    static_assert(sizeof(labels) / sizeof(labels[0]) == OP_COUNT, "dispatch table out of sync with OpCode");
+#define VM_CASE(op) L_##op
+#define VM_NEXT() goto *labels[*pc++]
+    VM_NEXT();
+    {
+#else
+#define VM_CASE(op) case op
+#define VM_NEXT() goto dispatch
+dispatch:
+    switch (*pc++) {
+#endif
+    VM_CASE(OP_CONST) : {
+        stack.push_back(chunk->consts[pc[0]]);
+        pc += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_LOCAL0) : {
+        const Value &v = unbox(env->slots[pc[0]]);
+        if (v.v_type == V_UNBOUND || v.v_type == V_VOID) {
+            // Let Var::eval raise the error or build the primitive's closure
+            stack.push_back(chunk->nodes[pc[1]]->eval(env));
+        } else {
+            stack.push_back(v);
+        }
+        pc += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_LOCAL) : {
+        const Value &v = unbox(frameSlot(env, pc[0], pc[1]));
+        if (v.v_type == V_UNBOUND || v.v_type == V_VOID) {
+            stack.push_back(chunk->nodes[pc[2]]->eval(env));
+        } else {
+            stack.push_back(v);
+        }
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(OP_FREE) : {
+        const Value &v = unbox(capturedSlot(env, pc[0]));
+        if (v.v_type == V_UNBOUND || v.v_type == V_VOID) {
+            stack.push_back(chunk->nodes[pc[1]]->eval(env));
+        } else {
+            stack.push_back(v);
+        }
+        pc += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_GLOBAL) : {
+        const Value &v = globalValue(pc[0]);
+        if (v.v_type == V_UNBOUND || v.v_type == V_VOID) {
+            stack.push_back(chunk->nodes[pc[1]]->eval(env));
+        } else {
+            stack.push_back(v);
+        }
+        pc += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_CHECK_LOCAL) : {
+        if (unbox(frameSlot(env, pc[0], pc[1])).v_type == V_UNBOUND) {
+            Set *set = static_cast<Set *>(chunk->nodes[pc[2]].get());
+            throw RuntimeError("set!: undefined variable '" + set->var.str() + "'");
+        }
+        pc += 3;
+        VM_NEXT();
+    }
+    VM_CASE(OP_CHECK_FREE) : {
+        if (unbox(capturedSlot(env, pc[0])).v_type == V_UNBOUND) {
+            Set *set = static_cast<Set *>(chunk->nodes[pc[1]].get());
+            throw RuntimeError("set!: undefined variable '" + set->var.str() + "'");
+        }
+        pc += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_CHECK_GLOBAL) : {
+        if (globalValue(pc[0]).v_type == V_UNBOUND) {
+            Set *set = static_cast<Set *>(chunk->nodes[pc[1]].get());
+            throw RuntimeError("set!: undefined variable '" + set->var.str() + "'");
+        }
+        pc += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_STORE_LOCAL) : {
+        unbox(frameSlot(env, pc[0], pc[1])) = std::move(stack.back());
+        stack.pop_back();
+        pc += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_STORE_FREE) : {
+        unbox(capturedSlot(env, pc[0])) = std::move(stack.back());
+        stack.pop_back();
+        pc += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_STORE_GLOBAL) : {
+        globalValue(pc[0]) = std::move(stack.back());
+        stack.pop_back();
+        pc += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_POP) : {
+        stack.pop_back();
+        VM_NEXT();
+    }
+    VM_CASE(OP_JUMP) : {
+        pc = chunk->code.data() + pc[0];
+        VM_NEXT();
+    }
+    VM_CASE(OP_JUMP_IF_FALSE) : {
+        bool is_false = isFalse(stack.back());
+        stack.pop_back();
+        pc = is_false ? chunk->code.data() + pc[0] : pc + 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_AND_JUMP) : {
+        if (isFalse(stack.back())) {
+            pc = chunk->code.data() + pc[0];
+        } else {
+            stack.pop_back();
+            pc += 1;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OP_OR_JUMP) : {
+        if (!isFalse(stack.back())) {
+            pc = chunk->code.data() + pc[0];
+        } else {
+            stack.pop_back();
+            pc += 1;
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OP_CHECK_PROC) : {
+        if (!isProcedure(stack.back())) {
+            throw RuntimeError("Attempt to apply a non-procedure");
+        }
+        VM_NEXT();
+    }
+    VM_CASE(OP_CLOSURE) : {
+        Lambda *lambda = static_cast<Lambda *>(chunk->nodes[pc[0]].get());
+        stack.push_back(lambda->eval(env)); // copies the free variables
+        pc += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_CALL) : {
+        tail_call = false;
+        argc = pc[0];
+        link = nullptr;
+        pc += 1;
+        goto call;
+    }
+    VM_CASE(OP_TAIL_CALL) : {
+        tail_call = true;
+        argc = pc[0];
+        link = nullptr;
+        pc += 1;
+        goto call;
+    }
+    VM_CASE(OP_CALL_GLOBAL) : {
+        tail_call = false;
+        argc = pc[0];
+        link = &chunk->links[pc[1]];
+        pc += 2;
+        goto call;
+    }
+    VM_CASE(OP_TAIL_CALL_GLOBAL) : {
+        tail_call = true;
+        argc = pc[0];
+        link = &chunk->links[pc[1]];
+        pc += 2;
+        goto call;
+    }
+    VM_CASE(OP_RETURN) : {
+        if (profiling && proc.v_type == V_PROC) {
+            profileExit();
+        }
+        if (calls.empty()) {
+            return std::move(stack.back());
+        }
+        CallInfo &caller = calls.back();
+        proc = std::move(caller.proc);
+        chunk = caller.chunk;
+        pc = caller.pc;
+        env = std::move(caller.env);
+        calls.pop_back();
+        VM_NEXT();
+    }
+    VM_CASE(OP_LET) : {
+        int count = pc[0];
+        Env frame = extendFrame(pc[1], env);
+        size_t first = stack.size() - count;
+        for (int i = 0; i < count; ++i) {
+            frame->slots[i] = std::move(stack[first + i]);
+        }
+        stack.resize(first, Value(nullptr));
+        env = std::move(frame);
+        pc += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_LETREC) : {
+        Env frame = extendFrame(pc[1], env);
+        for (int i = 0; i < pc[0]; ++i) {
+            frame->slots[i] = VoidV(); // placeholder until the initializer runs
+        }
+        env = std::move(frame);
+        pc += 2;
+        VM_NEXT();
+    }
+    VM_CASE(OP_LEAVE) : {
+        env = Env(env->parent);
+        VM_NEXT();
+    }
+    VM_CASE(OP_EVAL) : {
+        stack.push_back(chunk->nodes[pc[0]]->eval(env));
+        pc += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_PRIM1) : {
+        Unary *node = static_cast<Unary *>(chunk->nodes[pc[0]].get());
+        stack.back() = node->evalRator(stack.back());
+        pc += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_PRIM2) : {
+        Binary *node = static_cast<Binary *>(chunk->nodes[pc[0]].get());
+        Value result = node->evalRator(stack[stack.size() - 2], stack.back());
+        stack.pop_back();
+        stack.back() = std::move(result);
+        pc += 1;
+        VM_NEXT();
+    }
+    VM_CASE(OP_PRIMN) : {
+        Variadic *node = static_cast<Variadic *>(chunk->nodes[pc[0]].get());
+        size_t first = stack.size() - pc[1];
+        // The operands are read in place on the stack
+        Value result = node->evalRator(ValueSpan(stack.data() + first, pc[1]));
+        stack.resize(first, Value(nullptr));
+        stack.push_back(std::move(result));
+        pc += 2;
+        VM_NEXT();
+    }
+#define VM_BINARY(op, expr)                                  \
+    VM_CASE(op) : {                                          \
+        const Value &a = stack[stack.size() - 2];            \
+        const Value &b = stack.back();                       \
+        Value result = (expr);                               \
+        stack.pop_back();                                    \
+        stack.back() = std::move(result);                    \
+        VM_NEXT();                                           \
+    }
+    VM_BINARY(OP_ADD, numAdd(a, b))
+    VM_BINARY(OP_SUB, numSub(a, b))
+    VM_BINARY(OP_MUL, numMul(a, b))
+    VM_BINARY(OP_DIV, numDiv(a, b))
+    VM_BINARY(OP_LT, BooleanV(compareNumericValues(a, b) < 0))
+    VM_BINARY(OP_LE, BooleanV(compareNumericValues(a, b) <= 0))
+    VM_BINARY(OP_NUMEQ, BooleanV(compareNumericValues(a, b) == 0))
+    VM_BINARY(OP_GE, BooleanV(isGreaterEq(compareNumericValues(a, b))))
+    VM_BINARY(OP_GT, BooleanV(compareNumericValues(a, b) == 1))
+#undef VM_BINARY
+    VM_CASE(OP_RAISE) : {
+        throw RuntimeError(static_cast<String *>(chunk->consts[pc[0]].get())->s);
+    }
+#ifndef VM_COMPUTED_GOTO
+    default:
+        throw RuntimeError("vm: invalid opcode");
+#endif
+    }
+
+call : {
+    // Stack: procedure, then argc arguments
+    gcSafepoint();
+    size_t first = stack.size() - argc;
+    if (stack[first - 1].v_type == V_PRIMITIVE) {
+        // Built-in: runs on the arguments in place; a tail call's value
+        // still reaches OP_RETURN, which always follows it
+        Primitive *prim = static_cast<Primitive *>(stack[first - 1].get());
+        if (profiling) {
+            profileEnter(prim->name);
+        }
+        Value result = callPrimitive(prim, ValueSpan(stack.data() + first, argc));
+        if (profiling) {
+            profileExit();
+        }
+        stack.resize(first - 1, Value(nullptr));
+        stack.push_back(std::move(result));
+        VM_NEXT();
+    }
+    Procedure *clos = static_cast<Procedure *>(stack[first - 1].get());
+    LambdaTemplate *tmpl = clos->tmpl;
+    if (!tmpl->code) {
+        tmpl->code = compileChunk(tmpl->e); // lambda only evaluated by the tree walker so far
+    }
+
+    Env frame(nullptr);
+    bool fits = link != nullptr && link->ptr == clos;
+    if (!fits && tmpl->arity == argc) {
+        fits = true;
+        if (link != nullptr) {
+            *link = stack[first - 1]; // arity is not checked again until relinked
+        }
+    }
+    if (fits) {
+        frame = callFrame(clos);
+        for (int i = 0; i < argc; ++i) {
+            frame->slots[i] = std::move(stack[first + i]);
+        }
+    } else {
+        std::vector<Value> args(std::make_move_iterator(stack.begin() + first),
+                                std::make_move_iterator(stack.end()));
+        frame = bindArguments(clos, args);
+    }
+
+    if (profiling) {
+        // A tail call ends the current activation
+        if (tail_call && proc.v_type == V_PROC) {
+            profileExit();
+        }
+        profileEnter(tmpl->name);
+    }
+    Value callee = std::move(stack[first - 1]);
+    stack.resize(first - 1, Value(nullptr));
+    if (!tail_call) {
+        calls.push_back(CallInfo{std::move(proc), chunk, pc, std::move(env)});
+    }
+    proc = std::move(callee);
+    chunk = tmpl->code.get();
+    pc = chunk->code.data();
+    env = std::move(frame);
+    VM_NEXT();
+}
+#undef VM_CASE
+#undef VM_NEXT
+}
+
+Value vmEval(const Expr &expr, Env &env) {
+    std::shared_ptr<Chunk> chunk = compileChunk(expr);
+    if (!profiling) {
+        return run(chunk.get(), env);
+    }
+    // An error leaves the activations of this run open
+    size_t depth = profileDepth();
+    try {
+        return run(chunk.get(), env);
+    } catch (...) {
+        profileUnwind(depth);
+        throw;
+    }
+}
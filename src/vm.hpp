@@ -0,0 +1,87 @@
+#ifndef VM_HPP
+#define VM_HPP
+
+/**
+ * @file vm.hpp
+ * @brief Bytecode backend for the Scheme interpreter
+ *
+ * An alternative to tree-walking evaluation: a resolved Expr tree is compiled
+ * into a flat instruction stream and run by a dispatch loop with an explicit
+ * value stack and call stack. It shares frames, procedures and primitives
+ * with the tree walker and is selected with the --vm flag.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Instruction set
+ *
+ * Each instruction is an opcode word followed by its operands, listed in the
+ * comment. Jump targets are offsets into the chunk's code; `node` operands
+ * index Chunk::nodes.
+ */
+enum OpCode {
+    OP_CONST,         // k: push consts[k]
+    OP_LOCAL0,        // index node: push slot of the current frame
+    OP_LOCAL,         // depth index node: push slot of an enclosing frame
+    OP_FREE,          // index node: push capture of the running closure
+    OP_GLOBAL,        // slot node: push global
+    OP_CHECK_LOCAL,   // depth index node: set! target must be bound
+    OP_CHECK_FREE,    // index node: same for a capture
+    OP_CHECK_GLOBAL,  // slot node: same for a global
+    OP_STORE_LOCAL,   // depth index: pop into a frame slot
+    OP_STORE_FREE,    // index: pop into a (boxed) capture
+    OP_STORE_GLOBAL,  // slot: pop into a global
+    OP_POP,           // discard top
+    OP_JUMP,          // target
+    OP_JUMP_IF_FALSE, // target: pop, jump if #f
+    OP_AND_JUMP,      // target: jump keeping top if #f, else pop
+    OP_OR_JUMP,       // target: jump keeping top unless #f, else pop
+    OP_CHECK_PROC,    // top must be a procedure
+    OP_CLOSURE,       // node: push a closure of the Lambda node
+    OP_CALL,          // argc: call the procedure below the arguments
+    OP_TAIL_CALL,     // argc: same, replacing the current call
+    OP_CALL_GLOBAL,   // argc link: OP_CALL where the operator is a global; links[link] caches it
+    OP_TAIL_CALL_GLOBAL, // argc link: same, replacing the current call
+    OP_RETURN,        // return top to the caller
+    OP_LET,           // count size: open a frame, popping count initial values
+    OP_LETREC,        // count size: open a frame with count placeholders
+    OP_LEAVE,         // return to the enclosing frame
+    OP_EVAL,          // node: evaluate node with the tree walker
+    OP_PRIM1,         // node: apply Unary node to top
+    OP_PRIM2,         // node: apply Binary node to the top two
+    OP_PRIMN,         // node argc: apply Variadic node to the top argc
+    OP_ADD,           // numeric kernels on the top two values
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_LT,
+    OP_LE,
+    OP_NUMEQ,
+    OP_GE,
+    OP_GT,
+    OP_RAISE,         // k: throw RuntimeError with the string consts[k]
+    OP_COUNT
+};
+
+/**
+ * @brief Compiled code for one procedure body or top-level form
+ */
+struct Chunk {
+    std::vector<int> code;                      ///< Opcodes and operands
+    std::vector<Value> consts;                  ///< Constant pool
+    std::vector<Expr> nodes;   ///< Expr nodes used by slow paths and OP_EVAL
+    std::vector<Value> links;  ///< Per global call site: last procedure that fit its argc
+};
+
+// Compile an expression into a chunk that ends by returning its value
+std::shared_ptr<Chunk> compileChunk(const Expr &);
+
+// Evaluate a resolved expression on the VM
+Value vmEval(const Expr &, Env &);
+
+#endif // VM_HPP